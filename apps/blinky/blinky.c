@@ -4,26 +4,61 @@
 // Description:  Application that blinks an LED using libgpiod2.
 //
 // Notes:
-// - Uses libgpiod2 API for GPIO control.
-// - Requests the GPIO line once, toggles it in a loop.
+// - GPIO access goes through a backend (gpio_backend.h): libgpiod v2 by
+//   default, or raw chardev ioctls, the gpio_button LED, or a mock (-b).
+//   --bench N compares toggle throughput, call latency, syscalls per toggle
+//   and user/system CPU across them, for N toggles or a duration.
+// - Requests the GPIO line(s) once, toggles them in a loop.
 // - Supports daemon mode (background) or foreground execution (-D).
-// - Command-line options to pick chip, line, and interval.
+// - Command-line options to pick chip, lines, and interval. Lines may sit
+//   on several gpiochips ("-l gpiochip1:1,gpiochip3:24"): each chip is
+//   opened once with one request, and an edge is written to all chips
+//   back-to-back with the cross-chip skew measured.
+// - Optional control socket (-s) to change period, pattern, polarity,
+//   direction and the active line set live. Polarity/direction go through
+//   the backend's in-place reconfigure on the existing request
+//   (gpiod_line_request_reconfigure_lines() with libgpiod), so the line is
+//   never released and the LED does not glitch.
+// - Optional software PWM mode (-f/-d) for LED dimming: absolute-deadline
+//   sleeps with a short busy-wait tail.
+// - Timing goes through an injectable clock (clock_src.h). --simulate N
+//   runs the blink/pattern or PWM loop on virtual time against the mock
+//   backend and checks every recorded transition against the ideal
+//   schedule, so a million edges of a pattern verify in well under a second.
+//   --sim-flip K also flips active-low every K edges to check that the
+//   electrical edges are unaffected.
+// - Opt-in realtime profile (-R, -r, -C or RT_PROFILE): scheduling policy,
+//   affinity, mlockall, stack prefault, minimal timer slack.
 // - Graceful shutdown on SIGINT/SIGTERM; sets line low at exit.
-// - Syslog + stderr diagnostics.
+// - Syslog + stderr diagnostics. Per-toggle events go to a lock-free trace
+//   ring instead; only summaries reach syslog, SIGUSR1 dumps recent history.
+// - Edge-timing error and set_value call duration are kept in log-linear
+//   histograms; percentiles go to a stats file every few seconds and to
+//   syslog on SIGUSR1.
 //-----------------------------------------------------------------------------
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <signal.h>
-#include <gpiod.h>
+#include <getopt.h>
 #include <errno.h>
 #include <string.h>
 #include <time.h>
 
+#include "blinky.h"
+#include "clock_src.h"
+#include "gpio_backend.h"
+#include "gpio_bench.h"
+#include "hist.h"
+#include "rt_profile.h"
+#include "trace_ring.h"
+
 #define DEBUG_PRINT(fmt, ...) \
     fprintf(stderr, "%s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #define ERROR_PRINT(fmt, ...) \
@@ -33,15 +68,82 @@ static volatile sig_atomic_t stop_flag = 0;
 
 // Defaults match my breadboard wiring.
 static const char *chip_arg = "/dev/gpiochip3";
-static int line_offset = 24;
+static struct blinky_line line_args[BLINKY_MAX_LINES] = { { "", 24 } };
+static int num_line_args = 1;
 
 static int interval_ms = 1000;   /* blink period: 1000ms high + 1000ms low */
 static int initial_value = 0;    /* start low */
 static int active_low = 0;       /* if set, invert electrical level */
+static const char *ctl_path = NULL;  /* control socket, NULL = none */
+
+#ifdef HAVE_LIBGPIOD
+static const struct gpio_backend *backend = &gpio_backend_gpiod;
+#else
+static const struct gpio_backend *backend = &gpio_backend_cdev;
+#endif
+
+/* One chip and its single line request */
+struct chip_group {
+    char path[BLINKY_CHIP_NAME + 8];
+    struct gpio_req *req;
+    int n;
+    unsigned int offsets[BLINKY_MAX_LINES];
+    bool active[BLINKY_MAX_LINES];
+    int val[BLINKY_MAX_LINES];                 /* logical value per line */
+    unsigned int active_offsets[BLINKY_MAX_LINES];
+    int num_active;
+};
+
+/*
+ * Live line state. Everything below is owned by line_lock: the toggling
+ * thread holds it across each write, the control thread across each
+ * reconfiguration, so the two never interleave on a request.
+ */
+static pthread_mutex_t line_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct chip_group groups[BLINKY_MAX_CHIPS];
+static int num_groups;
+static int num_lines;
+static bool output_enabled = true;             /* false = lines are inputs */
+static struct blinky_pattern pattern;          /* blink mode step durations */
+
+/* Software PWM (enabled by -f) */
+static int pwm_hz = 0;           /* 0 = plain blink mode */
+static double pwm_duty = 50.0;   /* percent high */
+
+/* Realtime profile for the toggling thread (-R/-r/-C or RT_PROFILE) */
+static struct rt_profile rt;
+static const struct clock_src *clk = &clock_src_mono;
+
+#define NSEC_PER_SEC        1000000000LL
+#define PWM_MAX_HZ          10000
+#define PWM_REPORT_SEC      10        /* duty-cycle error report period */
+
+/* Hot-path trace records (see trace_ring.h) */
+enum {
+    TR_TOGGLE,          /* id = first active line, arg = value */
+    TR_PWM_RESYNC,      /* id = first active line, arg = periods skipped */
+    TR_RECONFIG,        /* id = 0, arg = reconfigure duration in ns */
+    TR_CHIP_SKEW,       /* id = chips written, arg = skew in ns (> SKEW_WARN_NS) */
+};
+static const char *const trace_names[TRACE_MAX_TYPES] = {
+    [TR_TOGGLE]     = "toggle",
+    [TR_PWM_RESYNC] = "pwm_resync",
+    [TR_RECONFIG]   = "reconfig",
+    [TR_CHIP_SKEW]  = "chip_skew",
+};
+#define TRACE_CAPACITY      4096
+#define TRACE_SUMMARY_SEC   60
+#define TRACE_DUMP_PATH     "/run/blinky.trace"
+static struct trace_ring trace;
 
-/* libgpiod2 objects kept for the whole program lifetime */
-static struct gpiod_chip *chip = NULL;
-static struct gpiod_line_request *req = NULL;
+/* Timing statistics (see hist.h), all in ns */
+#define STATS_PERIOD_SEC    10
+static const char *stats_path = "/run/blinky.stats";
+static struct hist edge_hist;    /* actual edge time - scheduled edge time */
+static struct hist call_hist;    /* duration of one edge's writes, all chips */
+static struct hist skew_hist;    /* first to last chip write completion */
+#define SKEW_WARN_NS        50000LL
+static volatile sig_atomic_t stats_requested = 0;
 
 /* Normalize chip argument: if it's just "gpiochip4", turn into "/dev/gpiochip4" */
 static const char *normalize_chip_arg(const char *arg, char *buf, size_t bufsz)
@@ -62,181 +164,915 @@ static void msleep(int ms)
     }
 }
 
+/* Edge timing goes through clk: CLOCK_MONOTONIC, or virtual time (--simulate) */
+static inline int64_t now_ns(void)
+{
+    return clk->now();
+}
+
+/*
+ * Sleep until an absolute deadline. On the real clock the kernel sleep is
+ * aimed CLOCK_SPIN_NS early and the rest is a busy-wait, which hides most
+ * of the hrtimer wakeup latency from the edge.
+ */
+static inline void sleep_until_ns(int64_t deadline)
+{
+    clk->sleep_until(deadline);
+}
+
+/* Rebuild a group's active_offsets[] from active[]. Caller holds line_lock. */
+static void refresh_active(struct chip_group *g)
+{
+    g->num_active = 0;
+    for (int i = 0; i < g->n; i++)
+        if (g->active[i])
+            g->active_offsets[g->num_active++] = g->offsets[i];
+}
+
+/* Group for a chip given by name or path; adds it if new. NULL if full. */
+static struct chip_group *group_for(const char *chip_name, bool add)
+{
+    char buf[sizeof(groups[0].path)];
+    const char *path = normalize_chip_arg(*chip_name ? chip_name : chip_arg,
+                                          buf, sizeof(buf));
+
+    for (int k = 0; k < num_groups; k++)
+        if (!strcmp(groups[k].path, path))
+            return &groups[k];
+    if (!add || num_groups == BLINKY_MAX_CHIPS)
+        return NULL;
+
+    struct chip_group *g = &groups[num_groups++];
+    memset(g, 0, sizeof(*g));
+    snprintf(g->path, sizeof(g->path), "%s", path);
+    return g;
+}
+
+static void gpio_cleanup(void);
+
 static int gpio_prepare(void)
 {
-    int ret = -1;
-    char chipbuf[128];
-    const char *chip_path = normalize_chip_arg(chip_arg, chipbuf, sizeof(chipbuf));
+    /* -p overrides -i */
+    if (pattern.n == 0) {
+        pattern.n = 1;
+        pattern.ms[0] = interval_ms;
+    }
 
-    /* Open chip */
-    chip = gpiod_chip_open(chip_path);
-    if (!chip) {
-        syslog(LOG_ERR, "gpiod_chip_open(%s) failed: %s", chip_path, strerror(errno));
-        ERROR_PRINT("gpiod_chip_open(%s) failed: %s", chip_path, strerror(errno));
-        return -1;
+    /* Group the lines by chip, in command-line order */
+    num_groups = 0;
+    for (int i = 0; i < num_line_args; i++) {
+        struct chip_group *g = group_for(line_args[i].chip, true);
+        if (!g) {
+            syslog(LOG_ERR, "Too many chips (max %d)", BLINKY_MAX_CHIPS);
+            ERROR_PRINT("Too many chips (max %d)", BLINKY_MAX_CHIPS);
+            return -1;
+        }
+        g->offsets[g->n] = line_args[i].offset;
+        g->active[g->n] = true;
+        g->val[g->n] = initial_value;
+        g->n++;
     }
+    num_lines = num_line_args;
+
+    for (int k = 0; k < num_groups; k++) {
+        struct chip_group *g = &groups[k];
+        refresh_active(g);
 
-    /* Line settings: output, optionally active-low */
-    struct gpiod_line_settings *settings = gpiod_line_settings_new();
-    if (!settings) {
-        syslog(LOG_ERR, "gpiod_line_settings_new() failed");
-        ERROR_PRINT("gpiod_line_settings_new() failed");
-        goto out_chip;
-    }
-    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
-    if (active_low)
-        gpiod_line_settings_set_active_low(settings, true);
-
-    /* Line config: assign our single line's settings */
-    struct gpiod_line_config *lcfg = gpiod_line_config_new();
-    if (!lcfg) {
-        syslog(LOG_ERR, "gpiod_line_config_new() failed");
-        ERROR_PRINT("gpiod_line_config_new() failed");
-        gpiod_line_settings_free(settings);
-        goto out_chip;
-    }
-    unsigned int offsets[1] = { (unsigned int)line_offset };
-    if (gpiod_line_config_add_line_settings(lcfg, offsets, 1, settings) < 0) {
-        syslog(LOG_ERR, "gpiod_line_config_add_line_settings() failed: %s", strerror(errno));
-        ERROR_PRINT("gpiod_line_config_add_line_settings() failed: %s", strerror(errno));
-        gpiod_line_config_free(lcfg);
-        gpiod_line_settings_free(settings);
-        goto out_chip;
-    }
-    gpiod_line_settings_free(settings);
-
-    /* Request config */
-    struct gpiod_request_config *rcfg = gpiod_request_config_new();
-    if (!rcfg) {
-        syslog(LOG_ERR, "gpiod_request_config_new() failed");
-        ERROR_PRINT("gpiod_request_config_new() failed");
-        gpiod_line_config_free(lcfg);
-        goto out_chip;
-    }
-    gpiod_request_config_set_consumer(rcfg, "blinky");
-
-    /* Make the request */
-    req = gpiod_chip_request_lines(chip, rcfg, lcfg);
-    gpiod_request_config_free(rcfg);
-    gpiod_line_config_free(lcfg);
-
-    if (!req) {
-        syslog(LOG_ERR, "gpiod_chip_request_lines() failed on %s offset %d: %s",
-               chip_path, line_offset, strerror(errno));
-        ERROR_PRINT("gpiod_chip_request_lines() failed on %s offset %d: %s",
-                    chip_path, line_offset, strerror(errno));
-        goto out_chip;
-    }
-
-    /* Set initial value */
-    if (gpiod_line_request_set_value(req, line_offset, initial_value) < 0) {
-        syslog(LOG_ERR, "Initial set_value failed: %s", strerror(errno));
-        ERROR_PRINT("Initial set_value failed: %s", strerror(errno));
-        goto out_req;
+        /* One request per chip: output, optionally active-low, initial values */
+        g->req = backend->request(g->path, g->offsets, g->n, g->val, active_low, "blinky");
+        if (!g->req) {
+            syslog(LOG_ERR, "%s: request failed on %s (%d lines from %u): %s",
+                   backend->name, g->path, g->n, g->offsets[0], strerror(errno));
+            ERROR_PRINT("%s: request failed on %s (%d lines from %u): %s",
+                        backend->name, g->path, g->n, g->offsets[0], strerror(errno));
+            goto fail;
+        }
     }
 
     return 0;
 
-out_req:
-    gpiod_line_request_release(req);
-    req = NULL;
-out_chip:
-    gpiod_chip_close(chip);
-    chip = NULL;
-    return ret;
+fail:
+    gpio_cleanup();
+    return -1;
 }
 
 static void gpio_cleanup(void)
 {
-    if (req) {
-        /* ensure LOW on exit unless active_low wants the opposite */
-        int final = 0;
-        (void)gpiod_line_request_set_value(req, line_offset, final);
-        gpiod_line_request_release(req);
-        req = NULL;
+    for (int k = 0; k < num_groups; k++) {
+        struct chip_group *g = &groups[k];
+        if (g->req) {
+            /* ensure LOW on exit unless active_low wants the opposite */
+            if (output_enabled)
+                (void)backend->set(g->req, g->n, g->offsets, 0);
+            backend->release(g->req);
+            g->req = NULL;
+        }
+    }
+}
+
+/*
+ * Write val to every active line, one call per chip, back-to-back. With
+ * more than one chip the spread between the first and the last write
+ * completing is the cross-chip phase error; it goes into skew_hist.
+ * Caller holds line_lock.
+ */
+static int line_write_locked(int val)
+{
+    int64_t first = 0, last = 0;
+    int chips = 0;
+
+    if (!output_enabled)
+        return 0;
+
+    for (int k = 0; k < num_groups; k++) {
+        struct chip_group *g = &groups[k];
+        int rc;
+
+        if (g->num_active == 0)
+            continue;
+        rc = backend->set(g->req, g->num_active, g->active_offsets, val);
+        if (rc < 0)
+            return rc;
+        if (num_groups > 1) {
+            last = now_ns();
+            if (chips == 0)
+                first = last;
+        }
+        chips++;
+        for (int i = 0; i < g->n; i++)
+            if (g->active[i])
+                g->val[i] = val;
+    }
+
+    if (chips > 1) {
+        hist_record(&skew_hist, (uint64_t)(last - first));
+        if (last - first > SKEW_WARN_NS)
+            trace_emit_at(&trace, (uint64_t)last, TR_CHIP_SKEW, (uint32_t)chips, last - first);
+    }
+    return 0;
+}
+
+static int line_write(int val)
+{
+    pthread_mutex_lock(&line_lock);
+    int rc = line_write_locked(val);
+    pthread_mutex_unlock(&line_lock);
+    return rc;
+}
+
+/*
+ * Blink edge: write the opposite of the lines' current logical value. The
+ * value comes from groups[] under line_lock, not from a copy the toggling
+ * thread keeps, because a polarity change inverts it in between. Returns
+ * the value written, or -1.
+ */
+static int line_toggle(void)
+{
+    int val = !initial_value;
+
+    pthread_mutex_lock(&line_lock);
+    for (int k = 0; k < num_groups; k++) {
+        if (groups[k].num_active) {
+            int i = 0;
+            while (!groups[k].active[i])
+                i++;
+            val = !groups[k].val[i];
+            break;
+        }
+    }
+    int rc = line_write_locked(val);
+    pthread_mutex_unlock(&line_lock);
+    return rc < 0 ? -1 : val;
+}
+
+/* Flip every line's logical value. Caller holds line_lock. */
+static void invert_values_locked(void)
+{
+    for (int k = 0; k < num_groups; k++)
+        for (int i = 0; i < groups[k].n; i++)
+            groups[k].val[i] = !groups[k].val[i];
+}
+
+/* Apply direction/polarity to every live request. Caller holds line_lock. */
+static int reconfigure_locked(bool output, bool low)
+{
+    int64_t t0 = now_ns();
+
+    for (int k = 0; k < num_groups; k++) {
+        if (backend->reconfigure(groups[k].req, output, low, groups[k].val) < 0) {
+            int err = errno;
+            syslog(LOG_ERR, "%s: reconfigure(%s) failed: %s",
+                   backend->name, groups[k].path, strerror(err));
+            errno = err;
+            return -1;
+        }
+    }
+    trace_emit(&trace, TR_RECONFIG, 0, now_ns() - t0);
+    return 0;
+}
+
+/* ---- Control interface (see blinky.h, control.c) ---- */
+
+int blinky_ctl_set_pattern(const int *ms, int n)
+{
+    if (n < 1 || n > BLINKY_PATTERN_MAX)
+        return -EINVAL;
+    for (int i = 0; i < n; i++)
+        if (ms[i] < 1 || ms[i] > 600000)
+            return -EINVAL;
+    if (pwm_hz)
+        return -EBUSY;
+
+    pthread_mutex_lock(&line_lock);
+    memcpy(pattern.ms, ms, sizeof(int) * (size_t)n);
+    pattern.n = n;
+    pthread_mutex_unlock(&line_lock);
+    return 0;
+}
+
+int blinky_ctl_set_active_low(bool low)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&line_lock);
+    if (low != (bool)active_low) {
+        /*
+         * Flip every logical value along with the polarity: the physical
+         * level stays put, the LED does not blink on the change.
+         */
+        invert_values_locked();
+        if (reconfigure_locked(output_enabled, low) < 0) {
+            rc = -errno;
+            /* Put back whatever chips already took the new config */
+            invert_values_locked();
+            (void)reconfigure_locked(output_enabled, active_low);
+        } else {
+            active_low = low;
+        }
+    }
+    pthread_mutex_unlock(&line_lock);
+    return rc;
+}
+
+int blinky_ctl_set_output(bool output)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&line_lock);
+    if (output != output_enabled) {
+        if (reconfigure_locked(output, active_low) < 0) {
+            rc = -errno;
+            (void)reconfigure_locked(output_enabled, active_low);
+        } else {
+            output_enabled = output;
+        }
+    }
+    pthread_mutex_unlock(&line_lock);
+    return rc;
+}
+
+int blinky_ctl_set_lines(const struct blinky_line *lines, int n)
+{
+    bool want[BLINKY_MAX_CHIPS][BLINKY_MAX_LINES];
+    int rc = 0, phase = 0;
+
+    if (n < 1)
+        return -EINVAL;
+    memset(want, 0, sizeof(want));
+    for (int j = 0; j < n; j++) {
+        struct chip_group *g = group_for(lines[j].chip, false);
+        int i = 0;
+        while (g && i < g->n && g->offsets[i] != lines[j].offset)
+            i++;
+        if (!g || i == g->n)
+            return -ENOENT;     /* not part of any request */
+        want[g - groups][i] = true;
+    }
+
+    pthread_mutex_lock(&line_lock);
+    for (int k = 0; k < num_groups; k++)
+        for (int i = 0; i < groups[k].n; i++)
+            if (groups[k].active[i])
+                phase = groups[k].val[i];
+
+    for (int k = 0; k < num_groups && rc == 0; k++) {
+        struct chip_group *g = &groups[k];
+        for (int i = 0; i < g->n && rc == 0; i++) {
+            if (want[k][i] == g->active[i] || !output_enabled)
+                continue;
+            /* Leaving lines go low, joining lines pick up the current phase */
+            int v = want[k][i] ? phase : 0;
+            if (backend->set(g->req, 1, &g->offsets[i], v) < 0)
+                rc = -errno;
+            else
+                g->val[i] = v;
+        }
+    }
+    if (rc == 0) {
+        for (int k = 0; k < num_groups; k++) {
+            memcpy(groups[k].active, want[k], sizeof(want[k][0]) * (size_t)groups[k].n);
+            refresh_active(&groups[k]);
+        }
     }
-    if (chip) {
-        gpiod_chip_close(chip);
-        chip = NULL;
+    pthread_mutex_unlock(&line_lock);
+    return rc;
+}
+
+int blinky_ctl_status(char *buf, size_t len)
+{
+    size_t off;
+
+    pthread_mutex_lock(&line_lock);
+    off = (size_t)snprintf(buf, len, "mode=%s pattern=", pwm_hz ? "pwm" : "blink");
+    for (int i = 0; i < pattern.n && off < len; i++)
+        off += (size_t)snprintf(buf + off, len - off, "%s%d", i ? "," : "", pattern.ms[i]);
+    if (off < len)
+        off += (size_t)snprintf(buf + off, len - off, " active_low=%d direction=%s lines=",
+                                active_low, output_enabled ? "out" : "in");
+    for (int k = 0, first = 1; k < num_groups; k++) {
+        const struct chip_group *g = &groups[k];
+        const char *name = strrchr(g->path, '/') ? strrchr(g->path, '/') + 1 : g->path;
+        for (int i = 0; i < g->n && off < len; i++, first = 0)
+            off += (size_t)snprintf(buf + off, len - off, "%s%s:%u%s", first ? "" : ",",
+                                    name, g->offsets[i], g->active[i] ? "" : "(off)");
     }
+    pthread_mutex_unlock(&line_lock);
+    return (int)off;
+}
+
+/*
+ * Drive the line and account for it: set_value duration and how late the
+ * edge landed relative to its schedule. Returns the post-call timestamp.
+ */
+static int64_t timed_done(int64_t t0, int64_t scheduled)
+{
+    int64_t t1 = now_ns();
+
+    hist_record(&call_hist, (uint64_t)(t1 - t0));
+    hist_record(&edge_hist, t1 > scheduled ? (uint64_t)(t1 - scheduled) : 0);
+    return t1;
+}
+
+static int64_t timed_set(int val, int64_t scheduled)
+{
+    int64_t t0 = now_ns();
+    if (line_write(val) < 0)
+        return -1;
+    return timed_done(t0, scheduled);
+}
+
+/* Same for a blink edge; *val gets the value written. */
+static int64_t timed_toggle(int *val, int64_t scheduled)
+{
+    int64_t t0 = now_ns();
+    if ((*val = line_toggle()) < 0)
+        return -1;
+    return timed_done(t0, scheduled);
+}
+
+/* Duration of the current pattern step; advances the step. */
+static int64_t next_step_ns(unsigned int *step)
+{
+    pthread_mutex_lock(&line_lock);
+    int ms = pattern.ms[*step % (unsigned int)pattern.n];
+    (*step)++;
+    pthread_mutex_unlock(&line_lock);
+    return (int64_t)ms * 1000000LL;
+}
+
+static uint32_t trace_line(void)
+{
+    for (int k = 0; k < num_groups; k++)
+        if (groups[k].num_active)
+            return groups[k].active_offsets[0];
+    return 0;
 }
 
 static void *blinky_thread(void *arg)
 {
     (void)arg;
-    int val = initial_value;
+    int val;
+    unsigned int step = 0;
+    int64_t next = now_ns();
 
+    rt_profile_apply_thread(&rt);
+    rt_profile_report("blinky");
+
+    /* Absolute deadlines: the edge schedule never drifts */
     while (!stop_flag) {
-        val = !val;
-        if (gpiod_line_request_set_value(req, line_offset, val) < 0) {
+        int64_t t = timed_toggle(&val, next);
+        if (t < 0) {
             syslog(LOG_ERR, "set_value failed: %s", strerror(errno));
             ERROR_PRINT("set_value failed: %s", strerror(errno));
             break;
         }
-        syslog(LOG_DEBUG, "Set gpio %d to %d", line_offset, val);
-        msleep(interval_ms);
+        trace_emit_at(&trace, (uint64_t)t, TR_TOGGLE, trace_line(), val);
+
+        /* Pattern/period changes from the control socket apply here */
+        int64_t step_ns = next_step_ns(&step);
+        next += step_ns;
+        if (next <= t)
+            next += ((t - next) / step_ns + 1) * step_ns;
+        sleep_until_ns(next);
     }
 
     /* drive low at exit */
-    (void)gpiod_line_request_set_value(req, line_offset, 0);
+    (void)line_write(0);
     return NULL;
 }
 
+static void pwm_report(const char *what, int64_t high_ns, int64_t total_ns,
+                       uint64_t periods, uint64_t missed)
+{
+    if (total_ns <= 0)
+        return;
+    double measured = 100.0 * (double)high_ns / (double)total_ns;
+    syslog(LOG_INFO, "PWM %s: %d Hz target %.2f%% measured %.3f%% error %+.3f%% "
+           "periods=%llu missed=%llu", what, pwm_hz, pwm_duty, measured,
+           measured - pwm_duty, (unsigned long long)periods,
+           (unsigned long long)missed);
+}
+
+/*
+ * Software PWM. Edges are scheduled on absolute deadlines derived from a
+ * single start time, so sleep overshoot never accumulates. The duty-cycle
+ * error is measured from timestamps taken right after each set_value call,
+ * i.e. what the line actually saw, not what was asked for.
+ */
+static void *pwm_thread(void *arg)
+{
+    (void)arg;
+    const int64_t period_ns = NSEC_PER_SEC / pwm_hz;
+    const int64_t high_ns = (int64_t)((double)period_ns * pwm_duty / 100.0);
+    int64_t high_sum = 0, total_sum = 0;
+    uint64_t periods = 0, missed = 0;
+    int64_t next_report;
+
+    rt_profile_apply_thread(&rt);
+    rt_profile_report("blinky pwm");
+
+    /* 0% and 100% are just a static level */
+    if (high_ns <= 0 || high_ns >= period_ns) {
+        int level = high_ns > 0;
+        if (line_write(level) < 0) {
+            syslog(LOG_ERR, "set_value failed: %s", strerror(errno));
+            ERROR_PRINT("set_value failed: %s", strerror(errno));
+        }
+        while (!stop_flag)
+            msleep(200);
+        (void)line_write(0);
+        return NULL;
+    }
+
+    int64_t start = now_ns() + period_ns;
+    int64_t rise_actual = 0, last_high = 0;
+    next_report = start + PWM_REPORT_SEC * NSEC_PER_SEC;
+
+    for (uint64_t n = 0; !stop_flag; n++) {
+        int64_t rise = start + (int64_t)n * period_ns;
+
+        sleep_until_ns(rise);
+        int64_t t = timed_set(1, rise);
+        if (t < 0) {
+            syslog(LOG_ERR, "set_value failed: %s", strerror(errno));
+            ERROR_PRINT("set_value failed: %s", strerror(errno));
+            break;
+        }
+        /* A period is complete once the next rising edge is out */
+        if (rise_actual) {
+            total_sum += t - rise_actual;
+            high_sum += last_high;
+            periods++;
+        }
+        rise_actual = t;
+
+        sleep_until_ns(rise + high_ns);
+        t = timed_set(0, rise + high_ns);
+        if (t < 0) {
+            syslog(LOG_ERR, "set_value failed: %s", strerror(errno));
+            ERROR_PRINT("set_value failed: %s", strerror(errno));
+            break;
+        }
+        last_high = t - rise_actual;
+
+        /* Fell behind by a whole period (preempted, SIGSTOP, ...): resync */
+        if (t >= rise + period_ns) {
+            uint64_t behind = (uint64_t)((t - rise) / period_ns);
+            missed += behind;
+            n += behind;
+            rise_actual = 0;
+            trace_emit(&trace, TR_PWM_RESYNC, trace_line(), (int64_t)behind);
+        }
+
+        if (t >= next_report) {
+            pwm_report("running", high_sum, total_sum, periods, missed);
+            next_report += PWM_REPORT_SEC * NSEC_PER_SEC;
+        }
+    }
+
+    pwm_report("final", high_sum, total_sum, periods, missed);
+    fprintf(stderr, "PWM %d Hz: target %.2f%% measured %.3f%% (%llu periods, %llu missed)\n",
+            pwm_hz, pwm_duty,
+            total_sum ? 100.0 * (double)high_sum / (double)total_sum : 0.0,
+            (unsigned long long)periods, (unsigned long long)missed);
+
+    (void)line_write(0);
+    return NULL;
+}
+
+/* Percentiles to syslog (on request) and/or the stats file. */
+static void stats_report(bool to_syslog)
+{
+    char edge[256], call[256], skew[256];
+
+    hist_format(&edge_hist, "edge_error_ns", edge, sizeof(edge));
+    hist_format(&call_hist, "set_value_ns", call, sizeof(call));
+    hist_format(&skew_hist, "chip_skew_ns", skew, sizeof(skew));
+
+    if (to_syslog) {
+        syslog(LOG_INFO, "stats: %s", edge);
+        syslog(LOG_INFO, "stats: %s", call);
+        if (num_groups > 1)
+            syslog(LOG_INFO, "stats: %s", skew);
+    }
+
+    if (!stats_path || !*stats_path)
+        return;
+
+    /* Write-then-rename so readers never see a torn file */
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", stats_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
+    fprintf(f, "# blinky timing stats, ns (log-linear buckets, ~3%% resolution)\n"
+               "mode=%s chips=%d lines=%d\n%s\n%s\n%s\n",
+            pwm_hz ? "pwm" : "blink", num_groups, num_lines, edge, call,
+            num_groups > 1 ? skew : "chip_skew_ns n/a");
+    if (fclose(f) == 0)
+        rename(tmp, stats_path);
+}
+
+/* ---- Virtual-clock simulation (--simulate) ---- */
+
+#define SIM_START_NS        NSEC_PER_SEC
+#define SIM_REPORT_ERRORS   10
+
+/*
+ * Every transition the mock backend records is checked against the ideal
+ * schedule computed independently here: edge k of each line must land at
+ * exactly its scheduled virtual time with the expected value.
+ */
+struct sim_line {
+    const struct gpio_req *req;
+    unsigned int offset;
+    unsigned long edges;
+    int64_t expect;             /* virtual time of the next edge */
+};
+
+static struct {
+    struct sim_line lines[BLINKY_MAX_LINES];
+    int n;
+    unsigned long target;       /* edges per line */
+    int done;                   /* lines that reached target */
+    unsigned long errors;
+    int64_t period_ns, high_ns; /* PWM */
+    bool low;                   /* polarity at start: edges are levels */
+    unsigned long flip_every;   /* --sim-flip: edges between flips */
+    unsigned long next_flip, flips;
+} sim;
+
+/* Ideal time of edge k+1 given edge k on a line */
+static int64_t sim_next_edge(int64_t t, unsigned long k)
+{
+    if (pwm_hz)
+        return t + (k % 2 == 0 ? sim.high_ns : sim.period_ns - sim.high_ns);
+    return t + (int64_t)pattern.ms[k % (unsigned long)pattern.n] * 1000000LL;
+}
+
+static void sim_record(void *ctx, const struct gpio_req *r, unsigned int offset, int val)
+{
+    struct sim_line *sl = NULL;
+    (void)ctx;
+
+    if (sim.done == sim.n)
+        return;     /* the drive-low at exit */
+    for (int i = 0; i < sim.n && !sl; i++)
+        if (sim.lines[i].req == r && sim.lines[i].offset == offset)
+            sl = &sim.lines[i];
+    if (!sl) {
+        sim.errors++;
+        return;
+    }
+
+    int64_t t = now_ns();
+    int want = (pwm_hz ? sl->edges % 2 == 0 : (int)(sl->edges % 2 == 0) ^ initial_value) ^ sim.low;
+    if (t != sl->expect || val != want) {
+        if (sim.errors < SIM_REPORT_ERRORS)
+            fprintf(stderr, "line %u edge %lu: got %d at %+lld ns, expected %d at %+lld ns\n",
+                    offset, sl->edges, val, (long long)(t - SIM_START_NS), want,
+                    (long long)(sl->expect - SIM_START_NS));
+        sim.errors++;
+    }
+    sl->expect = sim_next_edge(sl->expect, sl->edges);
+    if (++sl->edges == sim.target && ++sim.done == sim.n)
+        stop_flag = 1;
+}
+
+static int64_t sim_now(void)
+{
+    return clock_src_virtual.now();
+}
+
+/*
+ * --sim-flip: virtual time, plus a polarity change through the control
+ * entry point halfway into every flip_every-th step, i.e. while the
+ * toggling thread sleeps, which is where a control thread lands. The
+ * edges must not notice.
+ */
+static void sim_sleep_until(int64_t deadline)
+{
+    if (sim.flip_every && sim.lines[0].edges >= sim.next_flip) {
+        clock_src_virtual.sleep_until(sim_now() + (deadline - sim_now()) / 2);
+        if (blinky_ctl_set_active_low(!active_low) < 0)
+            sim.errors++;
+        sim.flips++;
+        sim.next_flip += sim.flip_every;
+    }
+    clock_src_virtual.sleep_until(deadline);
+}
+
+static const struct clock_src sim_clock_flip = {
+    .name        = "virtual+flip",
+    .now         = sim_now,
+    .sleep_until = sim_sleep_until,
+};
+
+/*
+ * Run the blink or PWM loop for 'edges' edges per line on the mock backend
+ * and the virtual clock, checking every edge. Returns 0 if all were exact.
+ */
+static int simulate(unsigned long edges)
+{
+    struct timespec w0, w1;
+
+    backend = &gpio_backend_mock;
+    clk = sim.flip_every ? &sim_clock_flip : &clock_src_virtual;
+    clock_virtual_set(SIM_START_NS);
+    sim.low = active_low;
+    sim.next_flip = sim.flip_every;
+
+    if (pwm_hz) {
+        sim.period_ns = NSEC_PER_SEC / pwm_hz;
+        sim.high_ns = (int64_t)((double)sim.period_ns * pwm_duty / 100.0);
+        if (sim.high_ns <= 0 || sim.high_ns >= sim.period_ns) {
+            fprintf(stderr, "Nothing to simulate: %.2f%% duty is a static level\n", pwm_duty);
+            return -1;
+        }
+    }
+    if (gpio_prepare() < 0)
+        return -1;
+
+    for (int k = 0; k < num_groups; k++) {
+        for (int i = 0; i < groups[k].n; i++) {
+            struct sim_line *sl = &sim.lines[sim.n++];
+            sl->req = groups[k].req;
+            sl->offset = groups[k].offsets[i];
+            sl->expect = SIM_START_NS + (pwm_hz ? sim.period_ns : 0);
+        }
+    }
+    sim.target = edges;
+    hist_init(&edge_hist);
+    hist_init(&call_hist);
+    hist_init(&skew_hist);
+    gpio_mock_set_hook(sim_record, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    (pwm_hz ? pwm_thread : blinky_thread)(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+
+    gpio_mock_set_hook(NULL, NULL);
+    gpio_cleanup();
+
+    double wall_ms = (double)(w1.tv_sec - w0.tv_sec) * 1e3 +
+                     (double)(w1.tv_nsec - w0.tv_nsec) / 1e6;
+    printf("simulated %lu edges x %d line(s): %.3f s of schedule in %.1f ms, "
+           "edge error max %llu ns, %lu polarity flips, %lu mismatches\n",
+           edges, sim.n, (double)(now_ns() - SIM_START_NS) / 1e9, wall_ms,
+           (unsigned long long)HIST_PEEK(edge_hist.max), sim.flips, sim.errors);
+    return sim.errors || sim.done != sim.n ? -1 : 0;
+}
+
 static void signal_handler(int signo)
 {
-    (void) signo;
+    if (signo == SIGUSR1) {
+        trace_request_dump(&trace);
+        stats_requested = 1;
+        return;
+    }
     stop_flag = 1;
 }
 
 static void print_usage(const char *prog)
 {
     fprintf(stderr,
-        "Usage: %s [-D] [-c CHIP] [-l LINE] [-i MS] [-a]\n"
+        "Usage: %s [-D] [-c CHIP] [-l [CHIP:]LINE[,...]] [-i MS | -p MS,...] [-a] [-f HZ [-d PCT]]\n"
+        "          [-R SPEC | -r PRIO -C CPU] [-S FILE] [-s SOCKET] [-b BACKEND]\n"
+        "       %s --bench N[s|ms] [--backends LIST] [--max-syscalls N] [-c CHIP] [-l LINES] [-a]\n"
+        "       %s --simulate N [-l LINES] [-a] [-i MS | -p MS,... [--sim-flip K] | -f HZ [-d PCT]]\n"
         "  -D        Do not daemonize (stay in foreground)\n"
         "  -c CHIP   GPIO chip path or name (default: /dev/gpiochip4)\n"
-        "  -l LINE   GPIO line offset (default: 25)\n"
+        "  -l LINES  GPIO line offset(s), comma separated; CHIP:LINE picks a\n"
+        "            chip other than -c (default: 24)\n"
         "  -i MS     Blink interval in milliseconds (default: 1000)\n"
+        "  -p MS,... Blink pattern: edge k is followed by MS[k %% n]\n"
         "  -a        Active-low (invert electrical level)\n"
-        "  -h        Show this help\n",
-        prog);
+        "  -f HZ     Software PWM at HZ (1-%d) instead of blinking\n"
+        "  -d PCT    PWM duty cycle in percent (default: 50)\n"
+        "  -R SPEC   Realtime profile POLICY[:PRIO][@CPUS], e.g. fifo:80@3\n"
+        "            (default: $" RT_PROFILE_ENV " if set)\n"
+        "  -r PRIO   Shorthand: SCHED_FIFO at PRIO (1-99)\n"
+        "  -C CPU    Pin the toggling thread to CPU (no realtime policy by itself)\n"
+        "  -S FILE   Timing stats file, \"\" to disable (default: /run/blinky.stats)\n"
+        "  -s SOCKET Control socket path, e.g. " BLINKY_CTL_DEFAULT " (default: none)\n"
+        "  -b NAME   GPIO backend (default: %s):",
+        prog, prog, prog, PWM_MAX_HZ, backend->name);
+    for (int i = 0; gpio_backends[i]; i++)
+        fprintf(stderr, " %s", gpio_backends[i]->name);
+    fprintf(stderr, "\n"
+        "  --bench N     Toggle the lines N times (or for a duration such as 10s)\n"
+        "                on each backend and report throughput, per-call\n"
+        "                latency, syscalls per toggle and user/system CPU, then\n"
+        "                exit. Only lines on the first line's chip are used.\n"
+        "  --backends L  Backends to benchmark, comma separated (default: all)\n"
+        "  --max-syscalls N  Fail the benchmark if a backend needs more than N\n"
+        "                syscalls per toggle\n"
+        "  --simulate N  Run N edges per line on virtual time and the mock\n"
+        "                backend, check every edge against the schedule, exit\n"
+        "  --sim-flip K  With --simulate in blink mode: flip active-low through\n"
+        "                the control path every K edges, between two edges\n"
+        "  -h        Show this help\n");
 }
 
 int main(int argc, char *argv[])
 {
     bool daemonize = true;
     int opt;
+    bool bench = false;
+    bool pin_only = false;
+    struct gpio_bench_opts bo = { .backends = "all", .max_syscalls = GPIO_BENCH_NO_LIMIT };
+    unsigned long sim_edges = 0;
+    enum { OPT_BENCH = 0x100, OPT_BACKENDS, OPT_SIMULATE, OPT_SIM_FLIP, OPT_MAX_SYSCALLS };
+    static const struct option long_opts[] = {
+        { "bench",    required_argument, NULL, OPT_BENCH },
+        { "backends", required_argument, NULL, OPT_BACKENDS },
+        { "max-syscalls", required_argument, NULL, OPT_MAX_SYSCALLS },
+        { "simulate", required_argument, NULL, OPT_SIMULATE },
+        { "sim-flip", required_argument, NULL, OPT_SIM_FLIP },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
 
-    while ((opt = getopt(argc, argv, "Dc:l:i:ah")) != -1) {
+    rt_profile_init(&rt);
+    if (rt_profile_from_env(&rt) < 0) {
+        fprintf(stderr, "Bad %s: %s\n", RT_PROFILE_ENV, getenv(RT_PROFILE_ENV));
+        return EXIT_FAILURE;
+    }
+
+    while ((opt = getopt_long(argc, argv, "Dc:l:i:p:af:d:R:r:C:S:s:b:h",
+                              long_opts, NULL)) != -1) {
         switch (opt) {
         case 'D': daemonize = false; break;
         case 'c': chip_arg = optarg; break;
-        case 'l': {
-            long v = strtol(optarg, NULL, 0);
-            if (v < 0 || v > 1023) { fprintf(stderr, "Bad line: %s\n", optarg); return EXIT_FAILURE; }
-            line_offset = (int)v;
+        case 'l':
+            num_line_args = blinky_parse_lines(optarg, line_args, BLINKY_MAX_LINES);
+            if (num_line_args < 1) { fprintf(stderr, "Bad line list: %s\n", optarg); return EXIT_FAILURE; }
             break;
-        }
         case 'i': {
             long v = strtol(optarg, NULL, 0);
             if (v < 1 || v > 600000) { fprintf(stderr, "Bad interval: %s\n", optarg); return EXIT_FAILURE; }
             interval_ms = (int)v;
             break;
         }
+        case 'p':
+            pattern.n = blinky_parse_pattern(optarg, pattern.ms, BLINKY_PATTERN_MAX);
+            if (pattern.n < 1) { fprintf(stderr, "Bad pattern: %s\n", optarg); return EXIT_FAILURE; }
+            break;
         case 'a': active_low = 1; break;
+        case 'f': {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1 || v > PWM_MAX_HZ) { fprintf(stderr, "Bad PWM frequency: %s\n", optarg); return EXIT_FAILURE; }
+            pwm_hz = (int)v;
+            break;
+        }
+        case 'd': {
+            double v = strtod(optarg, NULL);
+            if (v < 0.0 || v > 100.0) { fprintf(stderr, "Bad duty cycle: %s\n", optarg); return EXIT_FAILURE; }
+            pwm_duty = v;
+            break;
+        }
+        case 'R':
+            if (rt_profile_parse(&rt, optarg) < 0) { fprintf(stderr, "Bad realtime profile: %s\n", optarg); return EXIT_FAILURE; }
+            break;
+        case 'r': {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1 || v > 99) { fprintf(stderr, "Bad priority: %s\n", optarg); return EXIT_FAILURE; }
+            rt.enabled = true;
+            rt.policy = SCHED_FIFO;
+            rt.priority = (int)v;
+            break;
+        }
+        case 'C': {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 0 || v >= CPU_SETSIZE) { fprintf(stderr, "Bad CPU: %s\n", optarg); return EXIT_FAILURE; }
+            rt.pin = true;
+            CPU_SET((int)v, &rt.cpus);
+            break;
+        }
+        case 'S': stats_path = optarg; break;
+        case 's': ctl_path = optarg; break;
+        case 'b':
+            backend = gpio_backend_find(optarg);
+            if (!backend) { fprintf(stderr, "Unknown backend: %s\n", optarg); return EXIT_FAILURE; }
+            break;
+        case OPT_BENCH:
+            if (gpio_bench_parse(&bo, optarg) < 0) { fprintf(stderr, "Bad iteration count or duration: %s\n", optarg); return EXIT_FAILURE; }
+            bench = true;
+            break;
+        case OPT_BACKENDS: bo.backends = optarg; break;
+        case OPT_MAX_SYSCALLS:
+            if (gpio_bench_parse_budget(&bo.max_syscalls, optarg) < 0) { fprintf(stderr, "Bad syscall budget: %s\n", optarg); return EXIT_FAILURE; }
+            break;
+        case OPT_SIMULATE: {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1) { fprintf(stderr, "Bad edge count: %s\n", optarg); return EXIT_FAILURE; }
+            sim_edges = (unsigned long)v;
+            break;
+        }
+        case OPT_SIM_FLIP: {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1) { fprintf(stderr, "Bad flip interval: %s\n", optarg); return EXIT_FAILURE; }
+            sim.flip_every = (unsigned long)v;
+            break;
+        }
         case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
         default:  print_usage(argv[0]); return EXIT_FAILURE;
         }
     }
 
+    /* -C alone only pins: no realtime policy, no locked memory. */
+    if (rt.pin && !rt.enabled) {
+        rt.enabled = true;
+        rt.policy = SCHED_OTHER;
+        rt.lock_memory = false;
+        pin_only = true;
+    }
+
+    if (bench) {
+        char buf[sizeof(groups[0].path)];
+        unsigned int offs[BLINKY_MAX_LINES];
+        unsigned int n = 0;
+
+        for (int i = 0; i < num_line_args; i++)
+            if (!strcmp(line_args[i].chip, line_args[0].chip))
+                offs[n++] = line_args[i].offset;
+        bo.chip = normalize_chip_arg(line_args[0].chip[0] ? line_args[0].chip : chip_arg,
+                                     buf, sizeof(buf));
+        bo.offsets = offs;
+        bo.num_offsets = n;
+        bo.active_low = active_low;
+        rt_profile_apply_process(&rt);
+        rt_profile_apply_thread(&rt);
+        return gpio_bench_run(&bo, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (sim.flip_every && (!sim_edges || pwm_hz)) {
+        fprintf(stderr, "--sim-flip needs --simulate in blink mode\n");
+        return EXIT_FAILURE;
+    }
+    if (sim_edges)
+        return simulate(sim_edges) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    /*
+     * PWM always wants locked memory and a prefaulted stack, even when no
+     * realtime policy was asked for.
+     */
+    if (pwm_hz && (!rt.enabled || pin_only)) {
+        rt.enabled = true;
+        rt.policy = SCHED_OTHER;
+        rt.lock_memory = true;
+    }
+
     /* Signals */
     signal(SIGINT,  signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGSEGV, signal_handler);
+    signal(SIGUSR1, signal_handler);
 
     setlogmask(LOG_UPTO(LOG_DEBUG));
     openlog("blinky", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);
-    syslog(LOG_INFO, "Starting: chip=%s line=%d interval_ms=%d active_low=%d",
-           chip_arg, line_offset, interval_ms, active_low);
+    syslog(LOG_INFO, "Starting: backend=%s chip=%s lines=%d interval_ms=%d active_low=%d pwm_hz=%d duty=%.2f",
+           backend->name, chip_arg, num_line_args, interval_ms, active_low, pwm_hz, pwm_duty);
 
     if (gpio_prepare() < 0) {
         syslog(LOG_ERR, "GPIO setup failed");
@@ -253,19 +1089,49 @@ int main(int argc, char *argv[])
         }
     }
 
+    hist_init(&edge_hist);
+    hist_init(&call_hist);
+    hist_init(&skew_hist);
+    rt_profile_apply_process(&rt);
+
+    /* Flusher is a thread, so it has to start after daemon() */
+    if (trace_ring_init(&trace, TRACE_CAPACITY) < 0 ||
+        trace_flusher_start(&trace, "blinky", trace_names, TRACE_DUMP_PATH,
+                            TRACE_SUMMARY_SEC) < 0) {
+        syslog(LOG_WARNING, "Trace ring unavailable: %s", strerror(errno));
+        ERROR_PRINT("Trace ring unavailable: %s", strerror(errno));
+    }
+
     pthread_t th;
-    if (pthread_create(&th, NULL, blinky_thread, NULL) != 0) {
+    if (pthread_create(&th, NULL, pwm_hz ? pwm_thread : blinky_thread, NULL) != 0) {
         syslog(LOG_ERR, "pthread_create failed");
+        trace_flusher_stop(&trace);
+        trace_ring_destroy(&trace);
         gpio_cleanup();
         closelog();
         return EXIT_FAILURE;
     }
 
-    while (!stop_flag) {
+    if (ctl_path && control_start(ctl_path) < 0) {
+        syslog(LOG_WARNING, "Control socket %s unavailable: %s", ctl_path, strerror(errno));
+        ERROR_PRINT("Control socket %s unavailable: %s", ctl_path, strerror(errno));
+    }
+
+    for (int ticks = 0; !stop_flag; ticks++) {
         msleep(200);
+        if (stats_requested) {
+            stats_requested = 0;
+            stats_report(true);
+        } else if (ticks % (STATS_PERIOD_SEC * 5) == 0) {
+            stats_report(false);
+        }
     }
 
+    control_stop();
     pthread_join(th, NULL);
+    stats_report(true);
+    trace_flusher_stop(&trace);
+    trace_ring_destroy(&trace);
     gpio_cleanup();
     syslog(LOG_INFO, "Exiting");
     closelog();
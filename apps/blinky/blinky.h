@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// File:         blinky.h
+//
+// Description:  Internal interfaces shared between blinky's source files.
+//-----------------------------------------------------------------------------
+#ifndef BLINKY_H
+#define BLINKY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BLINKY_MAX_LINES    32      /* in total, across all chips */
+#define BLINKY_MAX_CHIPS    8
+#define BLINKY_CHIP_NAME    64
+#define BLINKY_PATTERN_MAX  64
+#define BLINKY_CTL_DEFAULT  "/run/blinky.sock"
+
+/* A line as given on the command line: "gpiochip1:5", or "5" on -c CHIP. */
+struct blinky_line {
+    char chip[BLINKY_CHIP_NAME];    /* "" = the default chip (-c) */
+    unsigned int offset;
+};
+
+/* Blink mode step durations: edge k is followed by a wait of ms[k % n]. */
+struct blinky_pattern {
+    int n;
+    int ms[BLINKY_PATTERN_MAX];
+};
+
+/*
+ * Live reconfiguration, implemented in blinky.c. Safe to call from any
+ * thread; each returns 0 or a negative errno. Timing changes take effect
+ * from the next edge, line changes immediately.
+ */
+int blinky_ctl_set_pattern(const int *ms, int n);
+int blinky_ctl_set_active_low(bool low);
+int blinky_ctl_set_output(bool output);
+int blinky_ctl_set_lines(const struct blinky_line *lines, int n);
+int blinky_ctl_status(char *buf, size_t len);
+
+/* "24,gpiochip1:5" -> lines. Returns the count, or -1 on a bad list. */
+int blinky_parse_lines(const char *arg, struct blinky_line *lines, int max);
+
+/* "500,100,500,900" -> ms[]. Returns the count, or -1 on a bad list. */
+int blinky_parse_pattern(const char *arg, int *ms, int max);
+
+/* Control socket (control.c). */
+int control_start(const char *path);
+void control_stop(void);
+
+#endif /* BLINKY_H */
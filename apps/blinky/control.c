@@ -0,0 +1,251 @@
+//-----------------------------------------------------------------------------
+// File:         control.c
+//
+// Description:  Unix-socket control interface for blinky.
+//
+// Notes:
+// - Line-oriented text protocol on a SOCK_STREAM socket, one command per
+//   line, one "ok ..." or "err ..." reply per command:
+//       status
+//       period MS                 square wave, MS high + MS low
+//       pattern MS[,MS...]        edge k is followed by MS[k % n]
+//       active-low 0|1
+//       direction in|out          'in' releases the pin to high-Z
+//       lines [CHIP:]N[,...]      active subset of the requested lines
+//   e.g.  echo "period 100" | socat - UNIX-CONNECT:/run/blinky.sock
+// - Clients are served one at a time by a single thread; nothing here runs
+//   on the toggling thread.
+//-----------------------------------------------------------------------------
+#include "blinky.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define CTL_POLL_MS     200
+#define CTL_IDLE_MS     30000   /* drop clients idle this long */
+#define CTL_LINE_MAX    512
+
+static int listen_fd = -1;
+static const char *sock_path;
+static pthread_t ctl_thread;
+static bool ctl_running;
+static _Atomic int ctl_stop;
+
+int blinky_parse_lines(const char *arg, struct blinky_line *lines, int max)
+{
+    char buf[1024];
+    int n = 0;
+
+    if (strlen(arg) >= sizeof(buf))
+        return -1;
+    strcpy(buf, arg);
+
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        /* Split at the last ':' so "/dev/gpiochip1:5" works too */
+        char *colon = strrchr(tok, ':');
+        const char *num = colon ? colon + 1 : tok;
+        char *end;
+        long v = strtol(num, &end, 0);
+
+        if (n == max || end == num || *end || v < 0 || v > 1023)
+            return -1;
+        lines[n].chip[0] = '\0';
+        if (colon) {
+            *colon = '\0';
+            if (!*tok || strlen(tok) >= sizeof(lines[n].chip))
+                return -1;
+            strcpy(lines[n].chip, tok);
+        }
+        lines[n++].offset = (unsigned int)v;
+    }
+    return n ? n : -1;
+}
+
+int blinky_parse_pattern(const char *arg, int *ms, int max)
+{
+    int n = 0;
+    const char *s = arg;
+
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > 600000 || n == max)
+            return -1;
+        ms[n++] = (int)v;
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return -1;
+    }
+    return n ? n : -1;
+}
+
+/* Execute one command line, write the reply into out. */
+static void handle_command(char *line, char *out, size_t len)
+{
+    char *cmd = strtok(line, " \t\r\n");
+    char *arg = strtok(NULL, " \t\r\n");
+    int rc = -EINVAL;
+
+    if (!cmd) {
+        snprintf(out, len, "err empty command\n");
+        return;
+    }
+
+    if (!strcmp(cmd, "status")) {
+        char st[CTL_LINE_MAX];
+        blinky_ctl_status(st, sizeof(st));
+        snprintf(out, len, "ok %s\n", st);
+        return;
+    } else if (!strcmp(cmd, "period") && arg) {
+        int ms[1];
+        if (blinky_parse_pattern(arg, ms, 1) == 1)
+            rc = blinky_ctl_set_pattern(ms, 1);
+    } else if (!strcmp(cmd, "pattern") && arg) {
+        int ms[BLINKY_PATTERN_MAX];
+        int n = blinky_parse_pattern(arg, ms, BLINKY_PATTERN_MAX);
+        if (n > 0)
+            rc = blinky_ctl_set_pattern(ms, n);
+    } else if (!strcmp(cmd, "active-low") && arg) {
+        if (!strcmp(arg, "0") || !strcmp(arg, "1"))
+            rc = blinky_ctl_set_active_low(arg[0] == '1');
+    } else if (!strcmp(cmd, "direction") && arg) {
+        if (!strcmp(arg, "in") || !strcmp(arg, "out"))
+            rc = blinky_ctl_set_output(!strcmp(arg, "out"));
+    } else if (!strcmp(cmd, "lines") && arg) {
+        struct blinky_line lines[BLINKY_MAX_LINES];
+        int n = blinky_parse_lines(arg, lines, BLINKY_MAX_LINES);
+        if (n > 0)
+            rc = blinky_ctl_set_lines(lines, n);
+    } else {
+        snprintf(out, len, "err unknown command (status, period, pattern, "
+                 "active-low, direction, lines)\n");
+        return;
+    }
+
+    if (rc == 0)
+        snprintf(out, len, "ok\n");
+    else if (rc == -ENOENT)
+        snprintf(out, len, "err line not in the request (add it with -l)\n");
+    else if (rc == -EBUSY)
+        snprintf(out, len, "err not in blink mode\n");
+    else
+        snprintf(out, len, "err %s\n", strerror(-rc));
+}
+
+static void serve_client(int fd)
+{
+    char buf[CTL_LINE_MAX];
+    size_t used = 0;
+    int idle_ms = 0;
+
+    while (!atomic_load(&ctl_stop) && idle_ms < CTL_IDLE_MS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int rc = poll(&pfd, 1, CTL_POLL_MS);
+        if (rc < 0 && errno != EINTR)
+            return;
+        if (rc <= 0) {
+            idle_ms += CTL_POLL_MS;
+            continue;
+        }
+        idle_ms = 0;
+
+        ssize_t n = read(fd, buf + used, sizeof(buf) - 1 - used);
+        if (n <= 0)
+            return;
+        used += (size_t)n;
+        buf[used] = '\0';
+
+        char *nl;
+        while ((nl = strchr(buf, '\n')) != NULL) {
+            char reply[CTL_LINE_MAX + 16];
+            *nl = '\0';
+            handle_command(buf, reply, sizeof(reply));
+            if (write(fd, reply, strlen(reply)) < 0)
+                return;
+            used -= (size_t)(nl + 1 - buf);
+            memmove(buf, nl + 1, used + 1);
+        }
+        if (used == sizeof(buf) - 1)
+            return;     /* overlong line */
+    }
+}
+
+static void *control_thread(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&ctl_stop)) {
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, CTL_POLL_MS) <= 0)
+            continue;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int control_start(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(path, 0660) < 0 ||
+        listen(listen_fd, 4) < 0)
+        goto fail;
+
+    sock_path = path;
+    atomic_store(&ctl_stop, 0);
+    int rc = pthread_create(&ctl_thread, NULL, control_thread, NULL);
+    if (rc != 0) {
+        errno = rc;
+        unlink(path);
+        goto fail;
+    }
+    ctl_running = true;
+    syslog(LOG_INFO, "Control socket listening on %s", path);
+    return 0;
+
+fail:
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+}
+
+void control_stop(void)
+{
+    if (!ctl_running)
+        return;
+    atomic_store(&ctl_stop, 1);
+    pthread_join(ctl_thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(sock_path);
+    ctl_running = false;
+}
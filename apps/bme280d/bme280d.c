@@ -0,0 +1,660 @@
+//-----------------------------------------------------------------------------
+// File:         bme280d.c
+//
+// Description:  BME280 sampling daemon on the IIO triggered buffer: fixed
+//               rate, kernel-timestamped scans read in batches from
+//               /dev/iio:deviceN.
+//
+// Notes:
+// - One trigger fires one conversion of every enabled channel, so temp,
+//   humidity, pressure and the timestamp in a scan belong together (sysfs
+//   _input reads convert per channel, per read, untimed).
+// - The rate comes from an hrtimer trigger created through configfs
+//   (iio-trig-hrtimer) and removed again on exit if we made it. -t none
+//   leaves the device's current_trigger alone.
+// - buffer/watermark makes poll() wake only once that many scans are
+//   queued; each wakeup drains them with one read(). The latency to the
+//   newest sample is therefore up to watermark/rate; use -w 1 for control
+//   loops that care about freshness more than wakeups.
+// - current_timestamp_clock is set to monotonic so ts_ns compares directly
+//   with clock_gettime(CLOCK_MONOTONIC) in this and other processes.
+// - Gaps between consecutive timestamps of more than 1.5 periods count as
+//   missed scans (the kfifo drops new scans when full, so a stalled reader
+//   shows up here).
+// - Other processes get the newest sample and rolling stats from the
+//   shared-memory cache (bme280_shm.h, -M), refreshed once per read; the
+//   sensor sees one conversion per period however many readers there are.
+// - -H keeps a history in an mmap'ed ring file (tsring.h): every sample,
+//   plus the button app's events taken from its bus (-B), compressed into
+//   the mapping with plain stores. tsq queries it, also after a crash.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <syslog.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "bme280_sample.h"
+#include "bme280_shm.h"
+#include "button_bus_wire.h"
+#include "hist.h"
+#include "iio.h"
+#include "tsring.h"
+
+#define DEFAULT_NAME        "bme280"
+#define DEFAULT_TRIGGER     "bme280d"
+#define DEFAULT_RATE        "10"
+#define DEFAULT_WATERMARK   16
+#define STATS_PERIOD_SEC    10
+#define DEFAULT_WINDOW_SEC  60
+
+static const char *const scan_names[] = {
+    "temp", "humidityrelative", "pressure", "timestamp",
+};
+
+static const char *stats_path = "/run/bme280d.stats";
+
+static char dev_dir[320];
+static char trig_dir[320];
+static char trig_name[64];
+static bool trig_created;
+static bool buffer_enabled;
+static int dev_fd = -1;
+static int sig_fd = -1;
+
+static struct iio_scan scan;
+static const struct iio_scan_chan *c_temp, *c_hum, *c_press, *c_ts;
+static uint64_t period_ns;
+static unsigned int watermark = DEFAULT_WATERMARK;
+static unsigned int buf_len;
+static bool print_samples;
+
+static uint64_t n_samples, n_reads, n_missed, max_batch;
+static uint64_t last_ts;
+static struct hist period_hist;     // |scan-to-scan - period|
+static struct hist age_hist;        // newest scan's age when read
+
+static struct tsr hist_ring;
+static bool hist_open;
+static const char *bus_path = BUTTON_BUS_PATH;
+static int button_fd = -1;
+static uint64_t n_events;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// CLOCK_REALTIME - CLOCK_MONOTONIC in µs: history records wall-clock time.
+static int64_t realtime_offset_us(void)
+{
+    struct timespec rt, mono;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    return ((int64_t)rt.tv_sec - mono.tv_sec) * 1000000 + (rt.tv_nsec - mono.tv_nsec) / 1000;
+}
+
+static int64_t div_round(int64_t a, int64_t b)
+{
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// Channel value in its IIO unit, nano-scaled.
+static int64_t chan_value(const struct iio_scan_chan *c, const void *p)
+{
+    return iio_apply_scale(iio_scan_raw(c, p) * IIO_NANO, c->offset_nano, c->scale_nano);
+}
+
+static void decode(const unsigned char *p, struct bme280_sample *s)
+{
+    memset(s, 0, sizeof(*s));
+    if (c_ts)
+        s->ts_ns = (uint64_t)iio_scan_raw(c_ts, p);
+    if (c_temp) {
+        // milli °C
+        s->temp_mdegc = (int32_t)div_round(chan_value(c_temp, p), IIO_NANO);
+        s->have |= BME280_HAVE_TEMP;
+    }
+    if (c_hum) {
+        // milli %RH
+        s->humidity_mpct = (uint32_t)div_round(chan_value(c_hum, p), IIO_NANO);
+        s->have |= BME280_HAVE_HUMIDITY;
+    }
+    if (c_press) {
+        // kPa: mPa = kPa * 1e6
+        s->pressure_mpa = (uint32_t)div_round(chan_value(c_press, p), 1000);
+        s->have |= BME280_HAVE_PRESSURE;
+    }
+}
+
+// Thousandths as "12.345" / "-0.004".
+static const char *milli(char *buf, size_t len, int64_t v)
+{
+    snprintf(buf, len, "%s%lld.%03lld", v < 0 ? "-" : "", (long long)(llabs(v) / 1000),
+             (long long)(llabs(v) % 1000));
+    return buf;
+}
+
+static void print_sample(const struct bme280_sample *s)
+{
+    char b[32];
+
+    printf("%llu.%09llu", (unsigned long long)(s->ts_ns / 1000000000ULL),
+           (unsigned long long)(s->ts_ns % 1000000000ULL));
+    if (s->have & BME280_HAVE_TEMP)
+        printf(" temp_c=%s", milli(b, sizeof(b), s->temp_mdegc));
+    if (s->have & BME280_HAVE_HUMIDITY)
+        printf(" humidity_rh=%s", milli(b, sizeof(b), s->humidity_mpct));
+    if (s->have & BME280_HAVE_PRESSURE)
+        printf(" pressure_hpa=%s", milli(b, sizeof(b), s->pressure_mpa / 100));
+    printf("\n");
+}
+
+static void stats_report(bool to_syslog)
+{
+    char period[256], age[256];
+
+    hist_format(&period_hist, "period_error_ns", period, sizeof(period));
+    hist_format(&age_hist, "read_age_ns", age, sizeof(age));
+
+    if (to_syslog) {
+        syslog(LOG_INFO, "stats: samples=%llu reads=%llu max_batch=%llu missed=%llu",
+               (unsigned long long)n_samples, (unsigned long long)n_reads,
+               (unsigned long long)max_batch, (unsigned long long)n_missed);
+        syslog(LOG_INFO, "stats: %s", period);
+        syslog(LOG_INFO, "stats: %s", age);
+    }
+
+    if (!stats_path || !*stats_path)
+        return;
+
+    // Write-then-rename so readers never see a torn file
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", stats_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
+    fprintf(f, "# bme280d sampling stats, ns (log-linear buckets, ~3%% resolution)\n"
+               "period_ns=%llu watermark=%u samples=%llu reads=%llu max_batch=%llu missed=%llu\n"
+               "%s\n%s\n",
+            (unsigned long long)period_ns, watermark, (unsigned long long)n_samples,
+            (unsigned long long)n_reads, (unsigned long long)max_batch,
+            (unsigned long long)n_missed, period, age);
+    if (hist_open) {
+        struct tsr_usage u;
+        tsr_usage(&hist_ring, TSR_SERIES_BME280, &u);
+        fprintf(f, "history_records=%llu history_bytes=%llu button_events=%llu\n",
+                (unsigned long long)u.records, (unsigned long long)u.bytes,
+                (unsigned long long)n_events);
+    }
+    if (fclose(f) == 0)
+        rename(tmp, stats_path);
+}
+
+static void handle_batch(const unsigned char *buf, size_t n, uint64_t t_read)
+{
+    struct bme280_sample s;
+    size_t count = n / scan.size;
+    int64_t off_us = hist_open ? realtime_offset_us() : 0;
+
+    n_reads++;
+    if (count > max_batch)
+        max_batch = count;
+    for (size_t i = 0; i < count; i++) {
+        decode(buf + i * scan.size, &s);
+        n_samples++;
+        if (s.ts_ns && last_ts && s.ts_ns > last_ts) {
+            uint64_t dt = s.ts_ns - last_ts;
+            hist_record(&period_hist, dt > period_ns ? dt - period_ns : period_ns - dt);
+            if (dt > period_ns + period_ns / 2) {
+                uint64_t lost = (dt + period_ns / 2) / period_ns - 1;
+                n_missed += lost;
+                bme280_shm_missed(lost);
+            }
+        }
+        if (s.ts_ns)
+            last_ts = s.ts_ns;
+        bme280_shm_sample(&s);
+        if (hist_open) {
+            int64_t v[3] = { s.temp_mdegc, s.humidity_mpct, s.pressure_mpa };
+            uint64_t ts = s.ts_ns ? s.ts_ns : t_read;
+            tsr_append(&hist_ring, TSR_SERIES_BME280, (int64_t)(ts / 1000) + off_us, v, 3);
+        }
+        if (print_samples)
+            print_sample(&s);
+    }
+    if (last_ts && t_read > last_ts)
+        hist_record(&age_hist, t_read - last_ts);
+    bme280_shm_flush();
+}
+
+// ---- Device setup / teardown ----
+
+static int attr_set(const char *dir, const char *attr, const char *val)
+{
+    if (iio_attr_write(dir, attr, val) == 0)
+        return 0;
+    syslog(LOG_ERR, "%s/%s = %s: %s", dir, attr, val, strerror(errno));
+    fprintf(stderr, "%s/%s = %s: %s\n", dir, attr, val, strerror(errno));
+    return -1;
+}
+
+static int attr_set_uint(const char *dir, const char *attr, unsigned int val)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", val);
+    return attr_set(dir, attr, buf);
+}
+
+// Existing trigger by name, or a new hrtimer one. 0 or -1.
+static int trigger_setup(const char *rate)
+{
+    char path[384];
+
+    if (iio_find("trigger", trig_name, trig_dir, sizeof(trig_dir)) < 0) {
+        snprintf(path, sizeof(path), IIO_HRTIMER_CONFIGFS "/%s", trig_name);
+        if (mkdir(path, 0755) < 0) {
+            syslog(LOG_ERR, "create trigger %s: %s", path, strerror(errno));
+            fprintf(stderr, "create trigger %s: %s (modprobe iio-trig-hrtimer; "
+                            "is configfs mounted?)\n", path, strerror(errno));
+            return -1;
+        }
+        trig_created = true;
+        if (iio_find("trigger", trig_name, trig_dir, sizeof(trig_dir)) < 0) {
+            syslog(LOG_ERR, "trigger %s did not appear", trig_name);
+            fprintf(stderr, "trigger %s did not appear\n", trig_name);
+            return -1;
+        }
+    }
+    return attr_set(trig_dir, "sampling_frequency", rate);
+}
+
+static void device_teardown(void)
+{
+    if (buffer_enabled)
+        iio_attr_write(dev_dir, "buffer/enable", "0");
+    buffer_enabled = false;
+    if (trig_dir[0]) {
+        iio_attr_write(dev_dir, "trigger/current_trigger", "");
+        trig_dir[0] = '\0';
+    }
+    if (trig_created) {
+        char path[384];
+        snprintf(path, sizeof(path), IIO_HRTIMER_CONFIGFS "/%s", trig_name);
+        if (rmdir(path) < 0)
+            syslog(LOG_WARNING, "remove trigger %s: %s", path, strerror(errno));
+        trig_created = false;
+    }
+    if (dev_fd >= 0)
+        close(dev_fd);
+    dev_fd = -1;
+}
+
+static int device_setup(int dev_num, const char *rate, bool use_trigger)
+{
+    char path[64];
+
+    // Layout and trigger can only change while the buffer is off
+    iio_attr_write(dev_dir, "buffer/enable", "0");
+
+    if (use_trigger && trigger_setup(rate) < 0)
+        return -1;
+    if (iio_attr_write(dev_dir, "current_timestamp_clock", "monotonic") < 0)
+        syslog(LOG_WARNING, "%s: cannot select monotonic timestamps: %s", dev_dir,
+               strerror(errno));
+
+    if (iio_scan_setup(dev_dir, scan_names, sizeof(scan_names) / sizeof(scan_names[0]),
+                       &scan) < 0) {
+        syslog(LOG_ERR, "%s: scan_elements: %s", dev_dir, strerror(errno));
+        fprintf(stderr, "%s: scan_elements: %s\n", dev_dir, strerror(errno));
+        return -1;
+    }
+    c_temp = iio_scan_find(&scan, "temp");
+    c_hum = iio_scan_find(&scan, "humidityrelative");
+    c_press = iio_scan_find(&scan, "pressure");
+    c_ts = iio_scan_find(&scan, "timestamp");
+    if (!c_ts)
+        syslog(LOG_WARNING, "%s: no timestamp channel, gaps go undetected", dev_dir);
+
+    if (use_trigger && attr_set(dev_dir, "trigger/current_trigger", trig_name) < 0)
+        return -1;
+    if (attr_set_uint(dev_dir, "buffer/length", buf_len) < 0 ||
+        attr_set_uint(dev_dir, "buffer/watermark", watermark) < 0 ||
+        attr_set(dev_dir, "buffer/enable", "1") < 0)
+        return -1;
+    buffer_enabled = true;
+
+    snprintf(path, sizeof(path), "/dev/iio:device%d", dev_num);
+    dev_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (dev_fd < 0) {
+        syslog(LOG_ERR, "open %s: %s", path, strerror(errno));
+        fprintf(stderr, "open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Button events into the history ----
+
+// Subscribe to the button app's bus. Quiet when it is not running.
+static void bus_connect(void)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct button_bus_sub sub = { .magic = BUTTON_BUS_MAGIC };
+    int fd;
+
+    if (!hist_open || !bus_path || !*bus_path || button_fd >= 0 ||
+        strlen(bus_path) >= sizeof(addr.sun_path))
+        return;
+    strcpy(addr.sun_path, bus_path);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        send(fd, &sub, sizeof(sub), MSG_NOSIGNAL) != (ssize_t)sizeof(sub)) {
+        close(fd);
+        return;
+    }
+    syslog(LOG_INFO, "Recording button events from %s", bus_path);
+    button_fd = fd;
+}
+
+static void bus_drain(void)
+{
+    struct button_bus_event e;
+    int64_t off_us = realtime_offset_us();
+    ssize_t n;
+
+    while ((n = recv(button_fd, &e, sizeof(e), MSG_DONTWAIT)) > 0) {
+        if (n != (ssize_t)sizeof(e) || e.type >= BUTTON_BUS_TYPES)
+            continue;
+        int64_t v[3] = { e.type, e.dev, e.value };
+        tsr_append(&hist_ring, TSR_SERIES_BUTTON, (int64_t)(e.ts_ns / 1000) + off_us, v, 3);
+        n_events++;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        // The app went away; bus_connect() retries every stats period
+        syslog(LOG_INFO, "Button bus %s closed", bus_path);
+        close(button_fd);
+        button_fd = -1;
+    }
+}
+
+// ---- Main loop ----
+
+// false when asked to stop.
+static bool handle_signals(void)
+{
+    struct signalfd_siginfo si;
+    bool run = true;
+
+    while (read(sig_fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGUSR1)
+            stats_report(true);
+        else
+            run = false;
+    }
+    return run;
+}
+
+static int run(void)
+{
+    // Room for everything the kernel buffer can hold: one read drains it
+    size_t cap = (size_t)buf_len * scan.size;
+    unsigned char *buf = malloc(cap);
+    struct pollfd pfd[3] = {
+        { .fd = dev_fd, .events = POLLIN },
+        { .fd = sig_fd, .events = POLLIN },
+        { .fd = -1, .events = POLLIN },
+    };
+    uint64_t next_stats = now_ns() + STATS_PERIOD_SEC * 1000000000ULL;
+    int rc = -1;
+
+    if (!buf) {
+        syslog(LOG_ERR, "out of memory");
+        return -1;
+    }
+    for (;;) {
+        pfd[2].fd = button_fd;
+        if (poll(pfd, 3, STATS_PERIOD_SEC * 1000) < 0) {
+            if (errno == EINTR)
+                continue;
+            syslog(LOG_ERR, "poll: %s", strerror(errno));
+            break;
+        }
+        if ((pfd[1].revents & POLLIN) && !handle_signals()) {
+            rc = 0;
+            break;
+        }
+        if (pfd[0].revents & POLLIN) {
+            ssize_t n;
+            while ((n = read(dev_fd, buf, cap)) > 0) {
+                handle_batch(buf, (size_t)n, now_ns());
+                if ((size_t)n < cap)
+                    break;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                syslog(LOG_ERR, "read: %s", strerror(errno));
+                break;
+            }
+        }
+        if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            syslog(LOG_ERR, "%s: buffer poll error 0x%x", dev_dir, pfd[0].revents);
+            break;
+        }
+        if (button_fd >= 0 && pfd[2].revents)
+            bus_drain();
+        if (print_samples)
+            fflush(stdout);
+        uint64_t t = now_ns();
+        if (t >= next_stats) {
+            stats_report(false);
+            bus_connect();
+            next_stats = t + STATS_PERIOD_SEC * 1000000000ULL;
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-n NAME | -d DIR] [-r HZ] [-w N] [-l N] [-t NAME|none] [-M NAME] [-W SEC]\n"
+        "          [-H FILE [-z SIZE] [-B PATH]] [-p] [-S FILE] [-D]\n"
+        "  -n NAME   IIO device name attribute to look for (default: " DEFAULT_NAME ")\n"
+        "  -d DIR    Use this IIO device directory (or iio:deviceN) instead\n"
+        "  -r HZ     Sampling rate of the hrtimer trigger (default: " DEFAULT_RATE ")\n"
+        "  -w N      Buffer watermark: scans per wakeup (default: %d)\n"
+        "  -l N      Buffer length in scans (default: 4 x watermark, at least 64)\n"
+        "  -t NAME   Trigger name; created under configfs if missing\n"
+        "            (default: " DEFAULT_TRIGGER "); 'none' keeps current_trigger\n"
+        "  -M NAME   Shared-memory sample cache (default: " BME280_SHM_NAME ", empty to disable)\n"
+        "  -W SEC    Window of the rolling stats in the cache (default: %d)\n"
+        "  -H FILE   History ring file of samples and button events (see tsq)\n"
+        "  -z SIZE   Size of a new history file, K/M suffixes (default: %uM)\n"
+        "  -B PATH   Button bus to record events from (default: " BUTTON_BUS_PATH ",\n"
+        "            empty to disable)\n"
+        "  -p        Print every sample (with -D)\n"
+        "  -S FILE   Stats file, rewritten every %ds and on SIGUSR1 (default: /run/bme280d.stats,\n"
+        "            empty to disable)\n"
+        "  -D        Do not daemonize (stay in foreground)\n"
+        "  -h        Show this help\n",
+        prog, DEFAULT_WATERMARK, DEFAULT_WINDOW_SEC, TSR_DEFAULT_SIZE >> 20, STATS_PERIOD_SEC);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = DEFAULT_NAME;
+    const char *dev = NULL;
+    const char *rate = DEFAULT_RATE;
+    const char *trigger = DEFAULT_TRIGGER;
+    const char *shm_name = BME280_SHM_NAME;
+    unsigned long window_sec = DEFAULT_WINDOW_SEC;
+    const char *hist_path = NULL;
+    unsigned long long hist_size = TSR_DEFAULT_SIZE;
+    char *end;
+    bool daemonize = true;
+    int64_t rate_nano;
+    int opt, dev_num, rc = EXIT_SUCCESS;
+
+    while ((opt = getopt(argc, argv, "n:d:r:w:l:t:M:W:H:z:B:pS:Dh")) != -1) {
+        switch (opt) {
+        case 'n': name = optarg; break;
+        case 'd': dev = optarg; break;
+        case 'r': rate = optarg; break;
+        case 'w': watermark = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'l': buf_len = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 't': trigger = optarg; break;
+        case 'M': shm_name = optarg; break;
+        case 'W': window_sec = strtoul(optarg, NULL, 0); break;
+        case 'H': hist_path = optarg; break;
+        case 'z':
+            hist_size = strtoull(optarg, &end, 0);
+            if (*end == 'K' || *end == 'k')
+                hist_size <<= 10;
+            else if (*end == 'M' || *end == 'm')
+                hist_size <<= 20;
+            break;
+        case 'B': bus_path = optarg; break;
+        case 'p': print_samples = true; break;
+        case 'S': stats_path = optarg; break;
+        case 'D': daemonize = false; break;
+        case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+        default:  print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (iio_parse_fixed(rate, &rate_nano) < 0 || rate_nano <= 0) {
+        fprintf(stderr, "Bad rate: %s\n", rate);
+        return EXIT_FAILURE;
+    }
+    period_ns = (uint64_t)(IIO_NANO * IIO_NANO / rate_nano);
+    if (!watermark) {
+        fprintf(stderr, "Watermark must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+    if (!buf_len)
+        buf_len = watermark * 4 < 64 ? 64 : watermark * 4;
+    if (buf_len < watermark) {
+        fprintf(stderr, "Buffer length %u is below the watermark %u\n", buf_len, watermark);
+        return EXIT_FAILURE;
+    }
+    if (strlen(trigger) >= sizeof(trig_name)) {
+        fprintf(stderr, "Trigger name too long: %s\n", trigger);
+        return EXIT_FAILURE;
+    }
+    snprintf(trig_name, sizeof(trig_name), "%s", trigger);
+    if (hist_path && hist_size < TSR_HEADER_SIZE + 2 * TSR_BLOCK_SIZE) {
+        fprintf(stderr, "History size must be at least %d bytes\n",
+                TSR_HEADER_SIZE + 2 * TSR_BLOCK_SIZE);
+        return EXIT_FAILURE;
+    }
+    if (daemonize)
+        print_samples = false;
+
+    if (dev) {
+        const char *base = strrchr(dev, '/');
+        if (base)
+            snprintf(dev_dir, sizeof(dev_dir), "%s", dev);
+        else
+            snprintf(dev_dir, sizeof(dev_dir), IIO_DEVICES "/%s", dev);
+        base = strrchr(dev_dir, '/') + 1;
+        if (sscanf(base, "iio:device%d", &dev_num) != 1) {
+            fprintf(stderr, "%s: not an iio:deviceN directory\n", dev_dir);
+            return EXIT_FAILURE;
+        }
+    } else if ((dev_num = iio_find_device(name, dev_dir, sizeof(dev_dir))) < 0) {
+        fprintf(stderr, "No IIO device named %s: %s\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    openlog("bme280d", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+    syslog(LOG_INFO, "Starting: dev=%s rate=%s watermark=%u length=%u trigger=%s", dev_dir,
+           rate, watermark, buf_len, trig_name);
+
+    if (device_setup(dev_num, rate, strcmp(trig_name, "none") != 0) < 0) {
+        device_teardown();
+        closelog();
+        return EXIT_FAILURE;
+    }
+    printf("%s: %u channels, %u-byte scans, period %llu ns, watermark %u\n", dev_dir,
+           scan.count, scan.size, (unsigned long long)period_ns, watermark);
+
+    // Before daemon(): a relative -H path names the same file with or without -D
+    if (hist_path) {
+        if (tsr_open(&hist_ring, hist_path, (size_t)hist_size) < 0) {
+            syslog(LOG_WARNING, "History %s unavailable: %s", hist_path, strerror(errno));
+            fprintf(stderr, "History %s unavailable: %s\n", hist_path, strerror(errno));
+        } else {
+            hist_open = true;
+        }
+    }
+
+    if (daemonize && daemon(0, 0) < 0) {
+        syslog(LOG_ERR, "daemon() failed: %s", strerror(errno));
+        if (hist_open)
+            tsr_close(&hist_ring);
+        device_teardown();
+        closelog();
+        return EXIT_FAILURE;
+    }
+
+    sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sig_fd < 0) {
+        syslog(LOG_ERR, "signalfd: %s", strerror(errno));
+        if (hist_open)
+            tsr_close(&hist_ring);
+        device_teardown();
+        closelog();
+        return EXIT_FAILURE;
+    }
+    hist_init(&period_hist);
+    hist_init(&age_hist);
+
+    // After daemon(), so the segment records the daemon's pid
+    if (*shm_name &&
+        bme280_shm_open(shm_name, period_ns, period_ns * (watermark + 2),
+                        window_sec * 1000000000ULL) < 0) {
+        syslog(LOG_WARNING, "Sample cache %s unavailable: %s", shm_name, strerror(errno));
+        fprintf(stderr, "Sample cache %s unavailable: %s\n", shm_name, strerror(errno));
+    }
+    bus_connect();
+
+    if (run() < 0)
+        rc = EXIT_FAILURE;
+
+    stats_report(true);
+    if (button_fd >= 0)
+        close(button_fd);
+    if (hist_open)
+        tsr_close(&hist_ring);
+    bme280_shm_close();
+    device_teardown();
+    close(sig_fd);
+    syslog(LOG_INFO, "Stopped after %llu samples", (unsigned long long)n_samples);
+    closelog();
+    return rc;
+}
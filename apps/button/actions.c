@@ -0,0 +1,377 @@
+//-----------------------------------------------------------------------------
+// File:         actions.c
+//
+// Description:  Event -> action mapping, run by a bounded worker pool.
+//
+// Notes:
+// - Mapping file, one rule per line, '#' starts a comment:
+//       EVENT[@DEV]  ACTION  ARGS...
+//   EVENT is "press" or "double", DEV a device index (-d order; default:
+//   any). ACTION is one of
+//       led                       toggle the LED (inline in the event loop)
+//       exec PROG [ARG...]        run PROG (no shell) with BUTTON_EVENT,
+//                                 BUTTON_DEVICE and BUTTON_TS_NS set;
+//                                 at most 16 words, longer rules are
+//                                 rejected
+//       send SOCKET MESSAGE...    datagram "MESSAGE dev=N ts_ns=T" to a
+//                                 Unix SOCK_DGRAM socket
+//   D-Bus calls go through exec (busctl / dbus-send), which keeps libdbus
+//   out of the process.
+// - The event loop hands jobs to the workers through a bounded lock-free
+//   queue (mpmc_queue.h) and a counting semaphore, so
+//   dispatch is a CAS, a copy and at most one futex wake. When the queue
+//   is full the job is dropped and counted against its action: a slow
+//   action can never hold up reading the next press.
+// - Workers inherit the event loop's blocked signal mask; spawned children
+//   get it cleared and the default dispositions back.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "actions.h"
+#include "mpmc_queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define ACTION_MAX_ARGS     16
+#define ACTION_LINE_MAX     512
+#define ACTIONS_MAX_WORKERS 16
+
+extern char **environ;
+
+enum action_kind {
+    ACT_LED,
+    ACT_EXEC,
+    ACT_SEND,
+};
+
+struct action {
+    enum button_event ev;
+    uint32_t dev;
+    enum action_kind kind;
+    char *argv[ACTION_MAX_ARGS + 1];    // exec: program and arguments
+    struct sockaddr_un addr;            // send
+    char msg[ACTION_LINE_MAX];          // send
+    char text[ACTION_LINE_MAX];         // rule as written, for reports
+    char *store;                        // backing storage for argv
+    _Atomic uint64_t queued, dropped, done, failed;
+};
+
+struct job {
+    uint32_t action;
+    uint32_t dev;
+    uint32_t event;
+    uint64_t ts_ns;
+};
+
+static const char *const event_names[BTN_EV_COUNT] = {
+    [BTN_EV_PRESS]  = "press",
+    [BTN_EV_DOUBLE] = "double",
+};
+
+static struct action actions[ACTIONS_MAX];
+static int num_actions;
+
+static struct mpmc_queue queue;
+static sem_t queue_items;
+
+static pthread_t workers[ACTIONS_MAX_WORKERS];
+static unsigned int num_workers;
+static _Atomic int workers_stop;
+
+/* ---- mapping ---- */
+
+static int parse_rule(struct action *a, char *line, int lineno, const char *path)
+{
+    char *save = NULL;
+    char *ev = strtok_r(line, " \t", &save);
+    char *kind = strtok_r(NULL, " \t", &save);
+    char *at;
+
+    if (!ev || !kind)
+        goto bad;
+
+    a->dev = ACTIONS_ANY_DEVICE;
+    if ((at = strchr(ev, '@'))) {
+        char *end;
+        *at = '\0';
+        unsigned long v = strtoul(at + 1, &end, 10);
+        if (end == at + 1 || *end)
+            goto bad;
+        a->dev = (uint32_t)v;
+    }
+    for (a->ev = 0; a->ev < BTN_EV_COUNT; a->ev++)
+        if (!strcmp(ev, event_names[a->ev]))
+            break;
+    if (a->ev == BTN_EV_COUNT)
+        goto bad;
+
+    if (!strcmp(kind, "led")) {
+        a->kind = ACT_LED;
+    } else if (!strcmp(kind, "exec")) {
+        int n = 0;
+        a->kind = ACT_EXEC;
+        for (char *tok; (tok = strtok_r(NULL, " \t", &save)); ) {
+            if (n == ACTION_MAX_ARGS) {
+                syslog(LOG_ERR, "%s:%d: exec takes at most %d words", path, lineno,
+                       ACTION_MAX_ARGS);
+                fprintf(stderr, "%s:%d: exec takes at most %d words (program and arguments)\n",
+                        path, lineno, ACTION_MAX_ARGS);
+                return -1;
+            }
+            a->argv[n++] = tok;
+        }
+        if (!n)
+            goto bad;
+    } else if (!strcmp(kind, "send")) {
+        char *sock = strtok_r(NULL, " \t", &save);
+        char *msg = save ? save + strspn(save, " \t") : NULL;
+        a->kind = ACT_SEND;
+        if (!sock || !msg || !*msg || strlen(sock) >= sizeof(a->addr.sun_path))
+            goto bad;
+        a->addr.sun_family = AF_UNIX;
+        strcpy(a->addr.sun_path, sock);
+        snprintf(a->msg, sizeof(a->msg), "%s", msg);
+    } else {
+        goto bad;
+    }
+    return 0;
+
+bad:
+    syslog(LOG_ERR, "%s:%d: bad action rule", path, lineno);
+    fprintf(stderr, "%s:%d: bad action rule (EVENT[@DEV] led|exec PROG...|send SOCKET MSG...)\n",
+            path, lineno);
+    return -1;
+}
+
+int actions_load(const char *path)
+{
+    char line[ACTION_LINE_MAX];
+    int lineno = 0;
+    FILE *f;
+
+    num_actions = 0;
+    if (!path) {
+        actions[0].ev = BTN_EV_PRESS;
+        actions[0].dev = ACTIONS_ANY_DEVICE;
+        actions[0].kind = ACT_LED;
+        snprintf(actions[0].text, sizeof(actions[0].text), "press led");
+        num_actions = 1;
+        return 0;
+    }
+
+    f = fopen(path, "r");
+    if (!f) {
+        syslog(LOG_ERR, "Cannot open %s: %s", path, strerror(errno));
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *p = line + strspn(line, " \t");
+        if (!*p)
+            continue;
+        if (num_actions == ACTIONS_MAX) {
+            fprintf(stderr, "%s:%d: too many rules (max %d)\n", path, lineno, ACTIONS_MAX);
+            fclose(f);
+            return -1;
+        }
+
+        struct action *a = &actions[num_actions];
+        memset(a, 0, sizeof(*a));
+        snprintf(a->text, sizeof(a->text), "%s", p);
+        a->store = strdup(p);
+        if (!a->store || parse_rule(a, a->store, lineno, path) < 0) {
+            free(a->store);
+            a->store = NULL;
+            fclose(f);
+            return -1;
+        }
+        num_actions++;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* ---- workers ---- */
+
+static int run_exec(const struct action *a, const struct job *j)
+{
+    char ev[32], dev[32], ts[48];
+    size_t n = 0;
+    posix_spawnattr_t attr;
+    sigset_t none, dfl;
+    pid_t pid;
+    int status, rc;
+
+    while (environ[n])
+        n++;
+    char **envp = malloc((n + 4) * sizeof(*envp));
+    if (!envp)
+        return -1;
+    memcpy(envp, environ, n * sizeof(*envp));
+    snprintf(ev, sizeof(ev), "BUTTON_EVENT=%s", event_names[j->event]);
+    snprintf(dev, sizeof(dev), "BUTTON_DEVICE=%u", j->dev);
+    snprintf(ts, sizeof(ts), "BUTTON_TS_NS=%llu", (unsigned long long)j->ts_ns);
+    envp[n++] = ev;
+    envp[n++] = dev;
+    envp[n++] = ts;
+    envp[n] = NULL;
+
+    // The event loop blocks its signals; the child gets a clean slate.
+    sigemptyset(&none);
+    sigemptyset(&dfl);
+    sigaddset(&dfl, SIGINT);
+    sigaddset(&dfl, SIGTERM);
+    sigaddset(&dfl, SIGUSR1);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &dfl);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    rc = posix_spawnp(&pid, a->argv[0], NULL, &attr, a->argv, envp);
+    posix_spawnattr_destroy(&attr);
+    free(envp);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int run_send(const struct action *a, const struct job *j)
+{
+    char buf[ACTION_LINE_MAX + 64];
+    int len = snprintf(buf, sizeof(buf), "%s dev=%u ts_ns=%llu", a->msg, j->dev,
+                       (unsigned long long)j->ts_ns);
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    ssize_t n = sendto(fd, buf, (size_t)len, MSG_DONTWAIT,
+                       (const struct sockaddr *)&a->addr, sizeof(a->addr));
+    close(fd);
+    return n == len ? 0 : -1;
+}
+
+static void *worker_main(void *arg)
+{
+    struct job j;
+    (void)arg;
+
+    for (;;) {
+        while (sem_wait(&queue_items) < 0 && errno == EINTR) {
+            /* resume */
+        }
+        if (!mpmc_queue_pop(&queue, &j)) {
+            if (atomic_load(&workers_stop))
+                break;
+            continue;
+        }
+
+        struct action *a = &actions[j.action];
+        int rc = a->kind == ACT_EXEC ? run_exec(a, &j) : run_send(a, &j);
+        if (rc < 0) {
+            atomic_fetch_add_explicit(&a->failed, 1, memory_order_relaxed);
+            syslog(LOG_WARNING, "action '%s' failed: %s", a->text, strerror(errno));
+        } else {
+            atomic_fetch_add_explicit(&a->done, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+int actions_start(unsigned int nworkers, unsigned int queue_len)
+{
+    if (nworkers < 1 || nworkers > ACTIONS_MAX_WORKERS || queue_len < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mpmc_queue_init(&queue, queue_len, sizeof(struct job)) < 0)
+        return -1;
+    atomic_store(&workers_stop, 0);
+    sem_init(&queue_items, 0, 0);
+
+    for (num_workers = 0; num_workers < nworkers; num_workers++) {
+        if (pthread_create(&workers[num_workers], NULL, worker_main, NULL) != 0) {
+            actions_stop();
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void actions_stop(void)
+{
+    if (!queue.slots)
+        return;
+    atomic_store(&workers_stop, 1);
+    for (unsigned int i = 0; i < num_workers; i++)
+        sem_post(&queue_items);
+    for (unsigned int i = 0; i < num_workers; i++)
+        pthread_join(workers[i], NULL);
+    num_workers = 0;
+    sem_destroy(&queue_items);
+    mpmc_queue_destroy(&queue);
+}
+
+/* ---- dispatch ---- */
+
+int actions_dispatch(enum button_event ev, uint32_t dev, uint64_t ts_ns)
+{
+    int leds = 0;
+
+    for (int i = 0; i < num_actions; i++) {
+        struct action *a = &actions[i];
+
+        if (a->ev != ev || (a->dev != ACTIONS_ANY_DEVICE && a->dev != dev))
+            continue;
+        if (a->kind == ACT_LED) {
+            leds++;
+            continue;
+        }
+
+        struct job j = { .action = (uint32_t)i, .dev = dev, .event = ev, .ts_ns = ts_ns };
+        if (mpmc_queue_push(&queue, &j)) {
+            atomic_fetch_add_explicit(&a->queued, 1, memory_order_relaxed);
+            sem_post(&queue_items);
+        } else {
+            atomic_fetch_add_explicit(&a->dropped, 1, memory_order_relaxed);
+        }
+    }
+    return leds;
+}
+
+void actions_report(void)
+{
+    for (int i = 0; i < num_actions; i++) {
+        struct action *a = &actions[i];
+        if (a->kind == ACT_LED)
+            continue;
+        uint64_t q = atomic_load_explicit(&a->queued, memory_order_relaxed);
+        uint64_t d = atomic_load_explicit(&a->dropped, memory_order_relaxed);
+        uint64_t ok = atomic_load_explicit(&a->done, memory_order_relaxed);
+        uint64_t f = atomic_load_explicit(&a->failed, memory_order_relaxed);
+        syslog(LOG_INFO, "action '%s': queued=%llu dropped=%llu done=%llu failed=%llu",
+               a->text, (unsigned long long)q, (unsigned long long)d,
+               (unsigned long long)ok, (unsigned long long)f);
+        printf("action '%s': queued=%llu dropped=%llu done=%llu failed=%llu\n",
+               a->text, (unsigned long long)q, (unsigned long long)d,
+               (unsigned long long)ok, (unsigned long long)f);
+    }
+}
@@ -0,0 +1,44 @@
+//-----------------------------------------------------------------------------
+// File:         actions.h
+//
+// Description:  Event -> action mapping for the button app.
+//-----------------------------------------------------------------------------
+#ifndef ACTIONS_H
+#define ACTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ACTIONS_MAX             32
+#define ACTIONS_ANY_DEVICE      UINT32_MAX
+#define ACTIONS_DEFAULT_WORKERS 2
+#define ACTIONS_DEFAULT_QUEUE   64
+
+enum button_event {
+    BTN_EV_PRESS,       // every press
+    BTN_EV_DOUBLE,      // second press within the double-press window
+    BTN_EV_COUNT,
+};
+
+/*
+ * Load the mapping from path (see actions.c for the format). Without a
+ * file the mapping is "press led". Returns 0, or -1 after logging why.
+ */
+int actions_load(const char *path);
+
+/* Start / stop the worker pool; stop lets queued jobs finish. */
+int actions_start(unsigned int workers, unsigned int queue_len);
+void actions_stop(void);
+
+/*
+ * Called from the event loop for each event. Queues the matching actions
+ * for the workers (never blocks; a full queue drops and counts) and
+ * returns how many built-in "led" actions matched, which the caller runs
+ * inline.
+ */
+int actions_dispatch(enum button_event ev, uint32_t dev, uint64_t ts_ns);
+
+/* Per-action queued/dropped/done/failed counters to syslog and stderr. */
+void actions_report(void);
+
+#endif /* ACTIONS_H */
@@ -5,116 +5,1789 @@
 //               RockPro64.
 //
 // Notes:
-// - Uses blocking I/O on /dev/gpio_button for event detection
-// - Relies on kernel-managed GPIO via character device + sysfs
+// - One epoll loop services every button device (-d, repeatable), a
+//   signalfd for SIGINT/SIGTERM/SIGUSR1 and a timerfd that retries devices
+//   which failed or went away; it sleeps in epoll_wait() otherwise, so
+//   there are no periodic wakeups
+// - Presses are read from the gpio_button character device(s), or from a
+//   GPIO line with -d gpiod:CHIP:LINE (below)
+// - LED goes through a GPIO backend (gpio_backend.h); the default is the
+//   gpio_button driver's LED, one-byte write() on its chardev (pwrite()
+//   on sysfs led_status with older drivers), -b picks another (cdev,
+//   mock, ...)
+// - --bench N compares LED toggle cost (throughput, latency, syscalls,
+//   CPU split) across backends
+// - Presses (and double presses) are mapped to actions (-A FILE, see
+//   actions.c): the LED toggle runs inline, scripts and socket messages
+//   run on a bounded worker pool fed through a lock-free queue, with drops
+//   counted when it is full
 // - Implements atomic state toggling using simple integer flip
-// - Handles file position reset with lseek() for sysfs writes
-// - Guarantees LED turn-off on exit during cleanup
+// - Turns the LED off on exit, except when an --fdstore run is stopped by
+//   a signal after READY=1: that is a handoff, and the LED keeps its state
+//   for the next run
+// - Presses are recorded in a lock-free trace ring; a flusher thread logs
+//   summaries to syslog and SIGUSR1 dumps the recent history
+// - Press latency: with a driver that returns timestamped event records the
+//   IRQ -> debounce-confirmed -> read -> LED-applied chain is measured,
+//   otherwise from read return only. Histograms (p50/p99/max) go to
+//   syslog, stdout and a stats file on SIGUSR1 and at exit
+// - -d gpiod:CHIP:LINE skips the driver and takes the button straight from
+//   a GPIO line with libgpiod edge events (kernel debounce, batched reads;
+//   needs WITH_LIBGPIOD=1). Stats carry CPU time per press so the two
+//   paths can be compared on the same board; --path-bench N compares them
+//   reproducibly, a mock driver against a gpio-sim line
+// - --loop uring swaps epoll for io_uring: multishot reads into a provided
+//   buffer ring stay posted on every device and LED writes are queued as
+//   SQEs, so a burst of presses costs one io_uring_enter(). --sqpoll MS
+//   adds a kernel submission thread. --loop-bench N pits the loops against
+//   each other on synthetic pipe devices
+// - Per-button counters, last-press times and the LED state are published
+//   in a seqlocked shared-memory segment (-M, see button_shm.h) for any
+//   number of local readers; --state samples it
+// - Acts as a broker: local clients subscribe on a SOCK_SEQPACKET socket
+//   (-P, see button_bus.h) and get binary event records, batched with one
+//   sendmmsg() per subscriber per wakeup; slow ones are dropped by policy
+// - --record FILE appends every received press (device, timestamps,
+//   latency at receipt) to a compact binary file (button_rec.h);
+//   --replay FILE feeds one back through the loop, actions, LED and
+//   histograms over pipes, in real time or at --replay-speed
+// - Type=notify service: READY=1 once devices are open. With --fdstore
+//   the device fds and a state memfd go to systemd's FD store, and a
+//   restart resumes from them (button_fdstore.h) instead of reopening
+//   devices and re-reading the LED from sysfs
+// - Opt-in realtime profile (-R SPEC or RT_PROFILE) for the reader loop
 //-----------------------------------------------------------------------------
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
 #include <stdatomic.h>
+#include <stdint.h>
+#include <syslog.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "actions.h"
+#include "button_bus.h"
+#include "button_fdstore.h"
+#include "button_gpiod.h"
+#include "button_rec.h"
+#include "button_shm.h"
+#include "gpio_backend.h"
+#include "gpio_bench.h"
+#include "gpio_button_event.h"
+#include "hist.h"
+#include "rt_profile.h"
+#include "sd_notify.h"
+#include "trace_ring.h"
+#include "uring.h"
 
 #define GPIO_BUTTON_DEVICE "/dev/gpio_button"
-#define GPIO_LED_SYSFS_PATH "/sys/class/gpio_button/gpio_button_sysfs/led_status"
+#define BUTTON_MAX_DEVICES  BUTTON_SHM_MAX_DEVS
+_Static_assert(BUTTON_MAX_DEVICES <= BUTTON_FDSTORE_MAX_DEVS, "fdstore state too small");
+#define REOPEN_SEC          1       // retry period for missing devices
+#define DOUBLE_PRESS_MS     400     // second press within this is a double
+
+// epoll tags besides device indexes
+#define TAG_SIGNAL          0xfffffff0u
+#define TAG_TIMER           0xfffffff1u
+#define TAG_LED             0xfffffff2u     // io_uring LED write
+#define TAG_BUS             0xfffffff3u     // event bus (its own epoll set)
+#define UD_POLL             (1ULL << 32)    // io_uring: poll, not a read
+
+#define URING_ENTRIES       64
+#define URING_BUFS          256     // provided event buffers, all devices
+#define URING_BGID          0
+#define SQPOLL_IDLE_MS      10      // --sqpoll default
+
+#define LOOP_BENCH_DEVS     8
+#define LOOP_BENCH_BURST    32      // records per producer write()
+#define PATH_BENCH_GAP_US   1000    // idle between --path-bench presses
+#define PATH_BENCH_WAIT_MS  1000    // a press not handled by then is lost
+
+#define REPLAY_BURST        32      // due records per player write()
+
+#define TRACE_CAPACITY      1024
+#define TRACE_SUMMARY_SEC   300
+#define TRACE_DUMP_PATH     "/run/button.trace"
+
+// Hot-path trace records (see trace_ring.h)
+enum {
+    TR_PRESS,           // id = device, arg = 1 for a double press
+    TR_LED,             // id = device, arg = new LED state
+};
+static const char *const trace_names[TRACE_MAX_TYPES] = {
+    [TR_PRESS] = "press",
+    [TR_LED]   = "led",
+};
+static struct trace_ring trace;
+
+// Press latency, all devices (single writer: the event loop)
+static const char *stats_path = "/run/button.stats";
+static struct hist irq_read_hist;   // IRQ -> read() returned (incl. debounce)
+static struct hist wake_hist;       // debounce confirmed -> read() returned
+static struct hist led_hist;        // read() returned -> LED applied
+static struct hist e2e_hist;        // IRQ -> LED applied
+static uint64_t untimed_events;     // legacy driver: no kernel timestamps
+static uint64_t total_presses;
 
 static volatile sig_atomic_t keep_running = 1;
 
+struct button_dev {
+    const char *path;
+    int fd;                 // -1 while missing
+    struct button_gpiod *gpiod; // gpiod: devices, fd is its request fd
+    uint64_t presses;
+    uint64_t last_press_ns;
+};
+static struct button_dev devs[BUTTON_MAX_DEVICES];
+static int num_devs;
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static unsigned long gpiod_debounce_us = BUTTON_GPIOD_DEBOUNCE_US;
+static unsigned int gpiod_batch = BUTTON_GPIOD_BATCH;
+static int sig_fd = -1;
+
+enum loop_kind { LOOP_EPOLL, LOOP_URING };
+static enum loop_kind loop_kind = LOOP_EPOLL;
+static unsigned int sqpoll_ms;          // io_uring submission thread, 0 = off
+static struct uring ring = { .fd = -1 };
+static struct uring_bufs ring_bufs;
+static bool ring_mshot;                 // multishot reads, else poll + read()
+static uint64_t stop_after;             // --loop-bench: stop after N presses
+static bool terminated;                 // SIGINT/SIGTERM seen
+static struct button_fdstore_state *fds_state;  // --fdstore: handed to the next run
+
+// LED, shared by both loops
+static const struct gpio_backend *led_be = &gpio_backend_gpiobtn;
+static struct gpio_req *led;
+static unsigned int led_line = 25;
+static int current_led_state;
+
+// io_uring LED writes: one in flight, toggles meanwhile coalesce behind it
+struct led_stamp {
+    bool valid;
+    unsigned int tag;
+    uint64_t t_read;
+    uint64_t irq_ns;        // 0 = untimed
+    int state;
+};
+static struct gpio_write led_w;
+static bool led_inflight;
+static struct led_stamp led_sent, led_next;
+
+// Percentiles to syslog, stdout and (write-then-rename) the stats file.
+static void stats_report(void)
+{
+    char lines[5][256];
+    struct rusage ru;
+
+    hist_format(&irq_read_hist, "irq_to_read_ns", lines[0], sizeof(lines[0]));
+    hist_format(&wake_hist, "wake_to_read_ns", lines[1], sizeof(lines[1]));
+    hist_format(&led_hist, "read_to_led_ns", lines[2], sizeof(lines[2]));
+    hist_format(&e2e_hist, "irq_to_led_ns", lines[3], sizeof(lines[3]));
+
+    // Whole-process CPU (loop + workers), to compare input paths
+    getrusage(RUSAGE_SELF, &ru);
+    uint64_t usr_ns = (uint64_t)ru.ru_utime.tv_sec * 1000000000ULL +
+                      (uint64_t)ru.ru_utime.tv_usec * 1000ULL;
+    uint64_t sys_ns = (uint64_t)ru.ru_stime.tv_sec * 1000000000ULL +
+                      (uint64_t)ru.ru_stime.tv_usec * 1000ULL;
+    snprintf(lines[4], sizeof(lines[4]),
+             "cpu presses=%llu usr_ns=%llu sys_ns=%llu per_press_ns=%llu",
+             (unsigned long long)total_presses, (unsigned long long)usr_ns,
+             (unsigned long long)sys_ns,
+             (unsigned long long)(total_presses ? (usr_ns + sys_ns) / total_presses : 0));
+    for (int i = 0; i < 5; i++) {
+        syslog(LOG_INFO, "stats: %s", lines[i]);
+        printf("%s\n", lines[i]);
+    }
+    if (untimed_events)
+        printf("untimed_events=%llu\n", (unsigned long long)untimed_events);
+
+    if (!stats_path || !*stats_path)
+        return;
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", stats_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return;
+    fprintf(f, "# button press latency, ns (log-linear buckets, ~3%% resolution)\n"
+               "untimed_events=%llu\n%s\n%s\n%s\n%s\n%s\n",
+            (unsigned long long)untimed_events, lines[0], lines[1], lines[2], lines[3],
+            lines[4]);
+    if (fclose(f) == 0)
+        rename(tmp, stats_path);
+}
+
 void sig_handler(int sig)
 {
     (void) sig;
     keep_running = 0;
 }
 
-int main()
+
+// Post a one-shot POLLIN poll on fd (io_uring loop). 0 or -1.
+static int ring_poll(int fd, uint32_t tag)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+
+    if (!sqe)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag | UD_POLL;
+    return 0;
+}
+
+// Start watching an open device: epoll registration, or a multishot read
+// (poll for gpiod lines and kernels without it) posted on the ring.
+static int dev_arm(unsigned int i)
+{
+    struct button_dev *d = &devs[i];
+
+    if (loop_kind == LOOP_EPOLL) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, d->fd, &ev);
+    }
+    if (d->gpiod || !ring_mshot)
+        return ring_poll(d->fd, i);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    if (!sqe)
+        return -1;
+    sqe->opcode = URING_OP_READ_MULTISHOT;
+    sqe->fd = d->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = i;
+    return 0;
+}
+
+static void dev_release(unsigned int i)
+{
+    struct button_dev *d = &devs[i];
+
+    if (d->fd >= 0) {
+        button_shm_present(i, false);
+        bus_publish(BUTTON_BUS_DEVICE, i, trace_now_ns(), 0);
+    }
+    if (d->gpiod)
+        button_gpiod_close(d->gpiod);
+    else if (d->fd >= 0)
+        close(d->fd);
+    d->gpiod = NULL;
+    d->fd = -1;
+}
+
+// Open a device and add it to the loop. 0, or -1 with errno set.
+static int dev_open(unsigned int i)
+{
+    struct button_dev *d = &devs[i];
+
+    if (!strncmp(d->path, BUTTON_GPIOD_PREFIX, strlen(BUTTON_GPIOD_PREFIX))) {
+        d->gpiod = button_gpiod_open(d->path + strlen(BUTTON_GPIOD_PREFIX),
+                                     gpiod_debounce_us, gpiod_batch);
+        if (!d->gpiod)
+            return -1;
+        d->fd = button_gpiod_fd(d->gpiod);
+    } else {
+        // A previous run's fd (still open in the FD store) if there is one
+        d->fd = button_fdstore_take_dev(i, d->path);
+        if (d->fd < 0) {
+            d->fd = open(d->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (d->fd < 0)
+                return -1;
+            button_fdstore_put_dev(i, d->fd);
+        }
+    }
+    if (dev_arm(i) < 0) {
+        int err = errno;
+        if (!d->gpiod)
+            button_fdstore_drop_dev(i);
+        dev_release(i);
+        errno = err;
+        return -1;
+    }
+    button_shm_present(i, true);
+    bus_publish(BUTTON_BUS_DEVICE, i, trace_now_ns(), 1);
+    return 0;
+}
+
+// Arm (or disarm) the retry timer depending on whether a device is missing.
+static void retry_timer_update(void)
 {
-    int button_fd = -1, led_fd = -1;
-    char event_flag;
-    char led_value[2];
-    int current_led_state = 0;
+    struct itimerspec its = { 0 };
+
+    for (int i = 0; i < num_devs; i++) {
+        if (devs[i].fd < 0) {
+            its.it_value.tv_sec = REOPEN_SEC;
+            its.it_interval.tv_sec = REOPEN_SEC;
+            break;
+        }
+    }
+    timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+// Nothing may be posted on the device any more (io_uring: its last CQE).
+static void dev_close(unsigned int i, const char *why)
+{
+    struct button_dev *d = &devs[i];
+
+    syslog(LOG_WARNING, "%s: %s, retrying every %ds", d->path, why, REOPEN_SEC);
+    fprintf(stderr, "%s: %s, retrying every %ds\n", d->path, why, REOPEN_SEC);
+    if (loop_kind == LOOP_EPOLL)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, d->fd, NULL);
+    if (!d->gpiod)
+        button_fdstore_drop_dev(i);
+    dev_release(i);
+    retry_timer_update();
+}
+
+// LED applied: latency and trace for the press that asked for it.
+static void led_done(unsigned int tag, uint64_t t_read, uint64_t irq_ns, int state)
+{
+    uint64_t t_led = trace_now_ns();
+
+    hist_record(&led_hist, t_led - t_read);
+    if (irq_ns)
+        hist_record(&e2e_hist, t_led - irq_ns);
+    trace_emit_at(&trace, t_led, TR_LED, tag, state);
+    if (fds_state)
+        fds_state->led_state = state;
+    button_shm_led(state, t_led);
+    bus_publish(BUTTON_BUS_LED, tag, t_led, state);
+}
+
+// Queue the LED write for led_next as an SQE.
+static int led_submit(void)
+{
+    struct io_uring_sqe *sqe;
+
+    if (led_be->prep_write(led, led_line, led_next.state, &led_w) < 0)
+        return -1;
+    sqe = uring_get_sqe(&ring);
+    if (!sqe)
+        return -1;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = led_w.fd;
+    sqe->off = led_w.off;
+    sqe->addr = (uint64_t)(uintptr_t)led_w.buf;
+    sqe->len = led_w.len;
+    sqe->user_data = TAG_LED;
+    led_sent = led_next;
+    led_next.valid = false;
+    led_inflight = true;
+    return 0;
+}
+
+static int led_toggle(unsigned int tag, uint64_t t_read, uint64_t irq_ns)
+{
+    current_led_state = !current_led_state;
+
+    if (loop_kind == LOOP_URING && led_be->prep_write) {
+        led_next = (struct led_stamp){ true, tag, t_read, irq_ns, current_led_state };
+        return led_inflight ? 0 : led_submit();
+    }
+    if (led_be->set(led, 1, &led_line, current_led_state) < 0)
+        return -1;
+    led_done(tag, t_read, irq_ns, current_led_state);
+    return 0;
+}
+
+// One press: stats, trace, actions and the inline LED toggle. irq_ns and
+// ready_ns are kernel timestamps, 0 when not known. 0, or -1 if the LED
+// write failed.
+static int handle_press(unsigned int tag, uint64_t irq_ns, uint64_t ready_ns,
+                        uint64_t t_read)
+{
+    struct button_dev *d = &devs[tag];
+
+    if (irq_ns && irq_ns <= t_read) {
+        hist_record(&irq_read_hist, t_read - irq_ns);
+        if (ready_ns)
+            hist_record(&wake_hist, t_read - ready_ns);
+    } else {
+        irq_ns = 0;
+        untimed_events++;
+    }
+
+    uint64_t now = irq_ns ? irq_ns : t_read;
+    bool dbl = d->presses && now - d->last_press_ns < DOUBLE_PRESS_MS * 1000000ULL;
+    d->presses++;
+    // --path-bench paces its presses on this from another thread
+    __atomic_store_n(&total_presses, total_presses + 1, __ATOMIC_RELEASE);
+    d->last_press_ns = now;
+    if (fds_state) {
+        fds_state->dev[tag].presses = d->presses;
+        fds_state->dev[tag].last_press_ns = now;
+    }
+    trace_emit_at(&trace, now, TR_PRESS, tag, dbl);
+    button_rec_press(tag, irq_ns, ready_ns, t_read);
+    button_shm_press(tag, now, dbl);
+    bus_publish(BUTTON_BUS_PRESS, tag, now, (int64_t)d->presses);
+    if (dbl)
+        bus_publish(BUTTON_BUS_DOUBLE, tag, now, (int64_t)d->presses);
+    if (stop_after && total_presses >= stop_after)
+        keep_running = 0;
+
+    // Workers get the rest; only the LED toggle happens here
+    int leds = actions_dispatch(BTN_EV_PRESS, tag, now);
+    if (dbl)
+        leds += actions_dispatch(BTN_EV_DOUBLE, tag, now);
+    if (!leds)
+        return 0;
+
+    if (led_toggle(tag, t_read, irq_ns) < 0) {
+        fprintf(stderr, "LED write failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// r bytes read from a driver fd; timed if it is a sane event record.
+static int dev_record(unsigned int tag, const void *buf, ssize_t r, uint64_t t_read)
+{
+    struct gpio_button_event event;
+
+    if (r == (ssize_t)sizeof(event)) {
+        memcpy(&event, buf, sizeof(event));
+        if (event.irq_ns && event.irq_ns <= event.ready_ns && event.ready_ns <= t_read)
+            return handle_press(tag, event.irq_ns, event.ready_ns, t_read);
+        // Replayed gpiod edge: IRQ time only
+        if (event.irq_ns && !event.ready_ns && event.irq_ns <= t_read)
+            return handle_press(tag, event.irq_ns, 0, t_read);
+    }
+    return handle_press(tag, 0, 0, t_read);
+}
+
+// Device readable: consume one record, or a batch of gpiod edges (whose
+// timestamps have no separate debounce stamp). Read errors close the
+// device; -1 only if the LED write failed.
+static int dev_input(unsigned int tag)
+{
+    struct button_dev *d = &devs[tag];
+
+    if (d->gpiod) {
+        uint64_t irq_ts[BUTTON_GPIOD_BATCH_MAX];
+        int np = button_gpiod_read(d->gpiod, irq_ts, BUTTON_GPIOD_BATCH_MAX);
+        if (np < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                dev_close(tag, strerror(errno));
+            return 0;
+        }
+        uint64_t t_read = trace_now_ns();
+        for (int p = 0; p < np; p++) {
+            if (handle_press(tag, irq_ts[p], 0, t_read) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    struct gpio_button_event event;
+    ssize_t r = read(d->fd, &event, sizeof(event));
+    if (r < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            dev_close(tag, strerror(errno));
+        return 0;
+    }
+    if (r == 0) {
+        dev_close(tag, "end of file");
+        return 0;
+    }
+    return dev_record(tag, &event, r, trace_now_ns());
+}
+
+static void handle_signals(void)
+{
+    struct signalfd_siginfo si;
+
+    while (read(sig_fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGUSR1) {
+            trace_request_dump(&trace);
+            actions_report();
+            bus_report();
+            stats_report();
+        } else {
+            keep_running = 0;
+            terminated = true;
+        }
+    }
+}
+
+static void handle_timer(void)
+{
+    uint64_t expirations;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+    for (int i = 0; i < num_devs; i++) {
+        if (devs[i].fd < 0 && dev_open((unsigned int)i) == 0) {
+            syslog(LOG_INFO, "%s: reopened", devs[i].path);
+            printf("%s: reopened\n", devs[i].path);
+        }
+    }
+    retry_timer_update();
+}
+
+static int epoll_run(void)
+{
+    while (keep_running) {
+        struct epoll_event evs[BUTTON_MAX_DEVICES + 2];
+        int n = epoll_wait(epoll_fd, evs, BUTTON_MAX_DEVICES + 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (int k = 0; k < n && keep_running; k++) {
+            uint32_t tag = evs[k].data.u32;
+
+            if (tag == TAG_SIGNAL) {
+                handle_signals();
+                continue;
+            }
+            if (tag == TAG_TIMER) {
+                handle_timer();
+                continue;
+            }
+            if (tag == TAG_BUS) {
+                bus_service();
+                continue;
+            }
+            if (devs[tag].fd < 0)
+                continue;   // closed earlier in this batch
+            if (!(evs[k].events & EPOLLIN)) {
+                dev_close(tag, "device error");
+                continue;
+            }
+            if (dev_input(tag) < 0)
+                return -1;
+        }
+        bus_flush();
+        button_rec_flush();
+    }
+    return 0;
+}
+
+// One completion from the ring. -1 only if the LED write failed.
+static int uring_complete(const struct io_uring_cqe *cqe)
+{
+    uint32_t tag = (uint32_t)cqe->user_data;
+    bool poll = (cqe->user_data & UD_POLL) != 0;
+    int res = cqe->res;
+
+    if (tag == TAG_LED) {
+        led_inflight = false;
+        if (res != (int)led_w.len) {
+            errno = res < 0 ? -res : EIO;
+            fprintf(stderr, "LED write failed: %s\n", strerror(errno));
+            return -1;
+        }
+        led_done(led_sent.tag, led_sent.t_read, led_sent.irq_ns, led_sent.state);
+        return led_next.valid ? led_submit() : 0;
+    }
+    if (tag == TAG_SIGNAL || tag == TAG_TIMER || tag == TAG_BUS) {
+        if (tag == TAG_SIGNAL) {
+            handle_signals();
+            return ring_poll(sig_fd, tag);
+        }
+        if (tag == TAG_TIMER) {
+            handle_timer();
+            return ring_poll(timer_fd, tag);
+        }
+        bus_service();
+        return ring_poll(bus_fd(), tag);
+    }
+
+    struct button_dev *d = &devs[tag];
+    if (poll) {
+        if (d->fd < 0)
+            return 0;
+        if (res < 0 || !(res & POLLIN)) {
+            dev_close(tag, res < 0 ? strerror(-res) : "device error");
+            return 0;
+        }
+        if (dev_input(tag) < 0)
+            return -1;
+        return d->fd >= 0 ? ring_poll(d->fd, tag) : 0;
+    }
+
+    // Multishot read: data in a provided buffer, re-armed once it ends
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        int rc = 0;
+        if (res > 0 && d->fd >= 0)
+            rc = dev_record(tag, uring_buf(&ring_bufs, bid), res, trace_now_ns());
+        uring_bufs_put(&ring_bufs, bid);
+        if (rc < 0)
+            return -1;
+    }
+    if ((cqe->flags & IORING_CQE_F_MORE) || d->fd < 0)
+        return 0;
+    if (res == 0) {
+        dev_close(tag, "end of file");
+        return 0;
+    }
+    if (res == -EINVAL || res == -EOPNOTSUPP || res == -EBADFD) {
+        // Kernel (or device) without multishot reads: poll + read()
+        ring_mshot = false;
+    } else if (res < 0 && res != -ENOBUFS && res != -EAGAIN && res != -EINTR) {
+        dev_close(tag, strerror(-res));
+        return 0;
+    }
+    return dev_arm(tag);
+}
+
+static int uring_run(void)
+{
+    while (keep_running) {
+        if (uring_submit(&ring, 1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(errno));
+            return -1;
+        }
+
+        struct io_uring_cqe *cqe;
+        while (keep_running && (cqe = uring_peek_cqe(&ring))) {
+            struct io_uring_cqe c = *cqe;
+            uring_cqe_seen(&ring);
+            if (uring_complete(&c) < 0)
+                return -1;
+        }
+        bus_flush();
+        button_rec_flush();
+    }
+    return 0;
+}
+
+// Set up the selected loop with the signal and retry timer fds in it.
+static int loop_init(void)
+{
+    if (loop_kind == LOOP_EPOLL) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0)
+            return -1;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = TAG_SIGNAL };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sig_fd, &ev);
+        ev.data.u32 = TAG_TIMER;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        if (bus_fd() >= 0) {
+            ev.data.u32 = TAG_BUS;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bus_fd(), &ev);
+        }
+        return 0;
+    }
+
+    if (uring_init(&ring, URING_ENTRIES, sqpoll_ms) < 0)
+        return -1;
+    ring_mshot = uring_bufs_init(&ring, &ring_bufs, URING_BGID, URING_BUFS,
+                                 sizeof(struct gpio_button_event)) == 0;
+    led_inflight = false;
+    led_next.valid = false;
+    if (ring_poll(sig_fd, TAG_SIGNAL) < 0 || ring_poll(timer_fd, TAG_TIMER) < 0 ||
+        (bus_fd() >= 0 && ring_poll(bus_fd(), TAG_BUS) < 0))
+        return -1;
+    return 0;
+}
+
+static void loop_fini(void)
+{
+    if (loop_kind == LOOP_EPOLL) {
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        epoll_fd = -1;
+        return;
+    }
+    if (ring.fd < 0)
+        return;
+    // Let a queued LED write land before anyone else touches the LED
+    while (led_inflight && uring_submit(&ring, 1) == 0) {
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring))) {
+            if ((uint32_t)cqe->user_data == TAG_LED)
+                led_inflight = false;
+            uring_cqe_seen(&ring);
+        }
+    }
+    uring_bufs_exit(&ring, &ring_bufs);
+    uring_exit(&ring);
+}
+
+static int loop_run(void)
+{
+    return loop_kind == LOOP_EPOLL ? epoll_run() : uring_run();
+}
+
+// --loop-bench: pipes stand in for button devices, a producer thread fills
+// them with timestamped records as fast as they drain
+struct bench_pipe {
+    int rd, wr;
+    char path[32];
+};
+static struct bench_pipe bench_pipes[LOOP_BENCH_DEVS];
+static uint64_t bench_events;
+
+static void *bench_producer(void *arg)
+{
+    struct gpio_button_event burst[LOOP_BENCH_BURST];
+    uint64_t left = bench_events;
+    sigset_t pipe_sig;
+    (void)arg;
+
+    // The loop closes its ends when it stops early: EPIPE, not SIGPIPE
+    sigemptyset(&pipe_sig);
+    sigaddset(&pipe_sig, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_sig, NULL);
+
+    for (unsigned int i = 0; left; i = (i + 1) % LOOP_BENCH_DEVS) {
+        unsigned int n = left < LOOP_BENCH_BURST ? (unsigned int)left : LOOP_BENCH_BURST;
+        uint64_t now = trace_now_ns();
+        for (unsigned int k = 0; k < n; k++)
+            burst[k].irq_ns = burst[k].ready_ns = now;
+        ssize_t len = (ssize_t)(n * sizeof(burst[0]));
+        if (write(bench_pipes[i].wr, burst, (size_t)len) != len)
+            break;
+        left -= n;
+    }
+    return NULL;
+}
+
+static uint64_t tv_ns(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000ULL;
+}
+
+static int loop_bench_one(enum loop_kind kind, unsigned int sq_ms, const char *name,
+                          double max_syscalls)
+{
+    struct rusage ru0, ru1;
+    uint64_t syscalls = 0;
+    pthread_t producer;
+    int rc, opened = 0;
+
+    loop_kind = kind;
+    sqpoll_ms = sq_ms;
+    hist_init(&irq_read_hist);
+    hist_init(&wake_hist);
+    hist_init(&led_hist);
+    hist_init(&e2e_hist);
+    untimed_events = 0;
+    total_presses = 0;
+    stop_after = bench_events;
+    keep_running = 1;
+
+    if (loop_init() < 0) {
+        printf("%-16s unavailable: %s\n", name, strerror(errno));
+        loop_fini();
+        return -1;
+    }
+    num_devs = LOOP_BENCH_DEVS;
+    for (int i = 0; i < LOOP_BENCH_DEVS; i++) {
+        struct bench_pipe *bp = &bench_pipes[i];
+        int fds[2];
+        memset(&devs[i], 0, sizeof(devs[i]));
+        devs[i].fd = -1;
+        bp->rd = bp->wr = -1;
+        if (pipe2(fds, O_CLOEXEC) < 0)
+            continue;
+        bp->rd = fds[0];
+        bp->wr = fds[1];
+        snprintf(bp->path, sizeof(bp->path), "/proc/self/fd/%d", bp->rd);
+        devs[i].path = bp->path;
+        if (dev_open((unsigned int)i) == 0)
+            opened++;
+    }
+
+    rc = -1;
+    if (opened == LOOP_BENCH_DEVS &&
+        pthread_create(&producer, NULL, bench_producer, NULL) == 0) {
+        int sc_fd = gpio_bench_syscalls_open();
+        if (sc_fd >= 0) {
+            ioctl(sc_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(sc_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        getrusage(RUSAGE_THREAD, &ru0);
+        uint64_t start = trace_now_ns();
+        rc = loop_run();
+        uint64_t elapsed = trace_now_ns() - start;
+        getrusage(RUSAGE_THREAD, &ru1);
+        if (sc_fd >= 0 && gpio_bench_syscalls_read(sc_fd, &syscalls) < 0) {
+            close(sc_fd);
+            sc_fd = -1;
+        }
+
+        for (int i = 0; i < LOOP_BENCH_DEVS; i++) {
+            dev_release((unsigned int)i);
+            close(bench_pipes[i].rd);
+            bench_pipes[i].rd = -1;
+        }
+        pthread_join(producer, NULL);
+
+        double n = total_presses ? (double)total_presses : 1.0;
+        char sc[16] = "-";
+        const char *verdict = "";
+        if (sc_fd >= 0) {
+            snprintf(sc, sizeof(sc), "%.3f", (double)syscalls / n);
+            close(sc_fd);
+            if (max_syscalls >= 0 && (double)syscalls / n > max_syscalls) {
+                verdict = "  FAIL: over syscall budget";
+                rc = -1;
+            }
+        } else if (max_syscalls >= 0) {
+            verdict = "  FAIL: syscalls not counted (perf/tracefs unavailable)";
+            rc = -1;
+        }
+        printf("%-16s %10llu %12.0f %9s %10.1f %10llu %10llu%s%s%s\n", name,
+               (unsigned long long)total_presses,
+               elapsed ? (double)total_presses * 1e9 / (double)elapsed : 0.0, sc,
+               (double)(tv_ns(&ru1.ru_utime) - tv_ns(&ru0.ru_utime) +
+                        tv_ns(&ru1.ru_stime) - tv_ns(&ru0.ru_stime)) / n,
+               (unsigned long long)hist_percentile(&e2e_hist, 50.0),
+               (unsigned long long)hist_percentile(&e2e_hist, 99.0),
+               kind == LOOP_EPOLL ? "" : ring_mshot ? "  multishot" : "  poll+read",
+               sq_ms ? ", SQ thread CPU not counted" : "", verdict);
+    } else {
+        printf("%-16s setup failed: %s\n", name, strerror(errno));
+    }
+
+    for (int i = 0; i < LOOP_BENCH_DEVS; i++) {
+        dev_release((unsigned int)i);
+        if (bench_pipes[i].rd >= 0)
+            close(bench_pipes[i].rd);
+        if (bench_pipes[i].wr >= 0)
+            close(bench_pipes[i].wr);
+    }
+    num_devs = 0;
+    loop_fini();
+    stop_after = 0;
+    return rc;
+}
+
+// Same press path (actions, LED, histograms) over each loop. 0 if all ran
+// within max_syscalls per event (GPIO_BENCH_NO_LIMIT: no budget).
+static int loop_bench(double max_syscalls)
+{
+    unsigned int sq_ms = sqpoll_ms;
+    int rc = 0;
+
+    printf("%llu events over %d pipe devices, LED backend %s\n",
+           (unsigned long long)bench_events, LOOP_BENCH_DEVS, led_be->name);
+    printf("%-16s %10s %12s %9s %10s %10s %10s\n", "loop", "events", "events/s",
+           "sys/evt", "cpu_ns/evt", "p50_ns", "p99_ns");
+    rc |= loop_bench_one(LOOP_EPOLL, 0, "epoll", max_syscalls);
+    if (!terminated)
+        rc |= loop_bench_one(LOOP_URING, 0, "io_uring", max_syscalls);
+    if (!terminated && sq_ms)
+        rc |= loop_bench_one(LOOP_URING, sq_ms, "io_uring+sqpoll", max_syscalls);
+    return rc ? -1 : 0;
+}
+
+// --path-bench: the same presses, one at a time, through the driver read
+// path (gpio_button records over a pipe, standing in for the driver) and
+// through a gpiod: line on gpio-sim, pulled low and back up through its
+// sim_gpioN/pull attribute. Each press waits for the previous one to be
+// handled, so the loop is asleep when it arrives, as with a real button.
+static uint64_t path_presses;
+static const char *path_line;           // -d gpiod:CHIP:LINE on gpio-sim
+static const char *sim_pull_path;       // that line's sim_gpioN/pull
+
+struct path_stim {
+    int fd;                 // pipe write end, or the sim pull attribute
+    bool gpiod;
+    bool lost;              // a press was not handled in PATH_BENCH_WAIT_MS
+};
+
+static int path_write(const struct path_stim *st, const char *pull)
+{
+    size_t len = strlen(pull);
+    return pwrite(st->fd, pull, len, 0) == (ssize_t)len ? 0 : -1;
+}
+
+static int path_press(const struct path_stim *st)
+{
+    struct gpio_button_event e = { 0 };
+
+    if (st->gpiod)
+        return path_write(st, "pull-down");
+    e.irq_ns = e.ready_ns = trace_now_ns();
+    return write(st->fd, &e, sizeof(e)) == (ssize_t)sizeof(e) ? 0 : -1;
+}
+
+static void *path_stimulus(void *arg)
+{
+    struct path_stim *st = arg;
+    sigset_t pipe_sig;
+
+    sigemptyset(&pipe_sig);
+    sigaddset(&pipe_sig, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_sig, NULL);
+
+    for (uint64_t i = 1; i <= path_presses && !st->lost; i++) {
+        uint64_t deadline = trace_now_ns() + PATH_BENCH_WAIT_MS * 1000000ULL;
+        if (path_press(st) < 0) {
+            st->lost = true;
+            break;
+        }
+        while (__atomic_load_n(&total_presses, __ATOMIC_ACQUIRE) < i) {
+            if (trace_now_ns() > deadline) {
+                st->lost = true;
+                break;
+            }
+            usleep(100);
+        }
+        if (st->gpiod && path_write(st, "pull-up") < 0)
+            st->lost = true;
+        usleep(PATH_BENCH_GAP_US);
+    }
+    // The loop stops after path_presses presses; without them, stop it here
+    if (st->lost)
+        kill(getpid(), SIGTERM);
+    return NULL;
+}
+
+static int path_bench_one(bool gpiod, const char *name, double max_syscalls)
+{
+    struct path_stim st = { .fd = -1, .gpiod = gpiod };
+    struct bench_pipe *bp = &bench_pipes[0];
+    struct rusage ru0, ru1;
+    uint64_t syscalls = 0;
+    pthread_t stim;
+    int rc = -1;
+
+    hist_init(&irq_read_hist);
+    hist_init(&wake_hist);
+    hist_init(&led_hist);
+    hist_init(&e2e_hist);
+    untimed_events = 0;
+    total_presses = 0;
+    stop_after = path_presses;
+    keep_running = 1;
+
+    if (loop_init() < 0) {
+        printf("%-8s unavailable: %s\n", name, strerror(errno));
+        loop_fini();
+        return -1;
+    }
+    num_devs = 1;
+    memset(&devs[0], 0, sizeof(devs[0]));
+    devs[0].fd = -1;
+    bp->rd = bp->wr = -1;
+    if (gpiod) {
+        devs[0].path = path_line;
+        st.fd = open(sim_pull_path, O_WRONLY | O_CLOEXEC);
+    } else {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == 0) {
+            bp->rd = fds[0];
+            bp->wr = st.fd = fds[1];
+            snprintf(bp->path, sizeof(bp->path), "/proc/self/fd/%d", bp->rd);
+            devs[0].path = bp->path;
+        }
+    }
+
+    // Released before the first press: the edge a gpiod: request sees is ours
+    if (st.fd >= 0 && (!gpiod || path_write(&st, "pull-up") == 0) && dev_open(0) == 0 &&
+        pthread_create(&stim, NULL, path_stimulus, &st) == 0) {
+        int sc_fd = gpio_bench_syscalls_open();
+        if (sc_fd >= 0) {
+            ioctl(sc_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(sc_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        getrusage(RUSAGE_THREAD, &ru0);
+        rc = loop_run();
+        getrusage(RUSAGE_THREAD, &ru1);
+        if (sc_fd >= 0 && gpio_bench_syscalls_read(sc_fd, &syscalls) < 0) {
+            close(sc_fd);
+            sc_fd = -1;
+        }
+        pthread_join(stim, NULL);
+
+        double n = total_presses ? (double)total_presses : 1.0;
+        char sc[16] = "-";
+        const char *verdict = "";
+        if (sc_fd >= 0) {
+            snprintf(sc, sizeof(sc), "%.3f", (double)syscalls / n);
+            close(sc_fd);
+            if (max_syscalls >= 0 && (double)syscalls / n > max_syscalls) {
+                verdict = "  FAIL: over syscall budget";
+                rc = -1;
+            }
+        } else if (max_syscalls >= 0) {
+            verdict = "  FAIL: syscalls not counted (perf/tracefs unavailable)";
+            rc = -1;
+        }
+        if (st.lost) {
+            verdict = "  FAIL: press lost";
+            rc = -1;
+        }
+        printf("%-8s %10llu %10llu %10llu %10llu %12.1f %9s%s\n", name,
+               (unsigned long long)total_presses,
+               (unsigned long long)hist_percentile(&e2e_hist, 50.0),
+               (unsigned long long)hist_percentile(&e2e_hist, 99.0),
+               (unsigned long long)hist_percentile(&e2e_hist, 100.0),
+               (double)(tv_ns(&ru1.ru_utime) - tv_ns(&ru0.ru_utime) +
+                        tv_ns(&ru1.ru_stime) - tv_ns(&ru0.ru_stime)) / n,
+               sc, verdict);
+    } else {
+        printf("%-8s setup failed: %s\n", name, strerror(errno));
+    }
+
+    dev_release(0);
+    if (gpiod && st.fd >= 0)
+        close(st.fd);
+    if (bp->rd >= 0)
+        close(bp->rd);
+    if (bp->wr >= 0)
+        close(bp->wr);
+    num_devs = 0;
+    loop_fini();
+    stop_after = 0;
+    return rc;
+}
+
+// Driver path, then the gpiod: line if one was given. 0 if every press
+// came through within max_syscalls per press.
+static int path_bench(double max_syscalls)
+{
+    int rc = 0;
+
+    printf("%llu presses, %d us apart, %s loop, LED backend %s\n",
+           (unsigned long long)path_presses, PATH_BENCH_GAP_US,
+           loop_kind == LOOP_EPOLL ? "epoll" : "io_uring", led_be->name);
+    printf("driver: gpio_button records over a pipe; gpiod: %s, pulled through %s\n",
+           path_line ? path_line : "-", sim_pull_path ? sim_pull_path : "-");
+    printf("%-8s %10s %10s %10s %10s %12s %9s\n", "path", "presses", "p50_ns",
+           "p99_ns", "max_ns", "cpu_ns/press", "sys/press");
+    rc |= path_bench_one(false, "driver", max_syscalls);
+    if (!terminated && path_line)
+        rc |= path_bench_one(true, "gpiod", max_syscalls);
+    else if (!terminated)
+        printf("%-8s skipped: needs -d gpiod:CHIP:LINE and --sim-pull PATH\n", "gpiod");
+    return rc ? -1 : 0;
+}
+
+// --replay: a pipe per recorded device, fed by a player thread on the
+// recorded schedule (scaled by replay_speed, 0 = back to back). Each
+// record is rebuilt as the driver would have returned it at that moment,
+// so the loop sees the recorded latency at receipt plus its own.
+static struct bench_pipe replay_pipes[BUTTON_MAX_DEVICES];
+static struct button_rec_header replay_hdr;
+static struct button_rec_event *replay_events;
+static size_t replay_count;
+static double replay_speed = 1.0;
+static struct hist replay_late_hist;    // player behind schedule
+static pthread_t replay_thread;
+static bool replay_started;
+static uint64_t replay_start_ns;
+
+static uint64_t replay_due(const struct button_rec_event *e)
+{
+    return replay_start_ns + (uint64_t)((double)e->t_ns / replay_speed);
+}
+
+static void *replay_player(void *arg)
+{
+    struct gpio_button_event burst[REPLAY_BURST];
+    sigset_t pipe_sig;
+    (void)arg;
+
+    sigemptyset(&pipe_sig);
+    sigaddset(&pipe_sig, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_sig, NULL);
+
+    for (size_t i = 0; i < replay_count;) {
+        unsigned int dev = replay_events[i].dev;
+        uint64_t now;
+
+        if (replay_speed > 0) {
+            uint64_t due = replay_due(&replay_events[i]);
+            struct timespec ts = { .tv_sec = (time_t)(due / 1000000000ULL),
+                                   .tv_nsec = (long)(due % 1000000000ULL) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+        }
+
+        // This record and whatever else is already due on the same device
+        now = trace_now_ns();
+        unsigned int n = 0;
+        do {
+            const struct button_rec_event *e = &replay_events[i];
+            if (replay_speed > 0) {
+                uint64_t due = replay_due(e);
+                if (due > now)
+                    break;
+                hist_record(&replay_late_hist, now - due);
+            }
+            burst[n].irq_ns = e->kind != BUTTON_REC_UNTIMED ? now - e->irq_lat_ns : 0;
+            burst[n].ready_ns = e->kind == BUTTON_REC_DRIVER ? now - e->ready_lat_ns : 0;
+            n++;
+            i++;
+        } while (i < replay_count && n < REPLAY_BURST && replay_events[i].dev == dev);
+
+        ssize_t len = (ssize_t)(n * sizeof(burst[0]));
+        if (write(replay_pipes[dev].wr, burst, (size_t)len) != len)
+            break;
+    }
+    return NULL;
+}
+
+// Load the recording and stand in pipes for its devices. 0 or -1.
+static int replay_setup(const char *path)
+{
+    if (button_rec_load(path, &replay_hdr, &replay_events, &replay_count) < 0) {
+        fprintf(stderr, "Cannot load recording %s: %s\n", path,
+                errno == EPROTO ? "not a button recording" : strerror(errno));
+        return -1;
+    }
+    if (!replay_count || !replay_hdr.num_devs || replay_hdr.num_devs > BUTTON_MAX_DEVICES) {
+        fprintf(stderr, "Recording %s: %zu events on %u device(s), nothing to replay\n",
+                path, replay_count, replay_hdr.num_devs);
+        return -1;
+    }
+    num_devs = (int)replay_hdr.num_devs;
+    for (int i = 0; i < num_devs; i++) {
+        struct bench_pipe *rp = &replay_pipes[i];
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            fprintf(stderr, "Replay pipes: %s\n", strerror(errno));
+            return -1;
+        }
+        rp->rd = fds[0];
+        rp->wr = fds[1];
+        snprintf(rp->path, sizeof(rp->path), "/proc/self/fd/%d", rp->rd);
+        devs[i].path = rp->path;
+    }
+    hist_init(&replay_late_hist);
+    stop_after = replay_count;
+    return 0;
+}
+
+static int replay_start(void)
+{
+    replay_start_ns = trace_now_ns();
+    if (pthread_create(&replay_thread, NULL, replay_player, NULL) != 0)
+        return -1;
+    replay_started = true;
+    return 0;
+}
+
+// Stop the player (it may be asleep until the next recorded press),
+// report and drop the pipes.
+static void replay_stop(void)
+{
+    if (replay_started) {
+        uint64_t elapsed = trace_now_ns() - replay_start_ns;
+        char line[256];
+
+        pthread_cancel(replay_thread);
+        pthread_join(replay_thread, NULL);
+        uint64_t span = replay_events[replay_count - 1].t_ns;
+        printf("replay: %llu of %zu events on %u device(s), recorded over %.3fs, "
+               "replayed in %.3fs (%.0f events/s)\n",
+               (unsigned long long)total_presses, replay_count, replay_hdr.num_devs,
+               (double)span / 1e9, (double)elapsed / 1e9,
+               elapsed ? (double)total_presses * 1e9 / (double)elapsed : 0.0);
+        syslog(LOG_INFO, "replay: %llu of %zu events in %.3fs",
+               (unsigned long long)total_presses, replay_count, (double)elapsed / 1e9);
+        if (replay_speed > 0) {
+            hist_format(&replay_late_hist, "replay_late_ns", line, sizeof(line));
+            printf("%s\n", line);
+        }
+        replay_started = false;
+    }
+    for (int i = 0; i < BUTTON_MAX_DEVICES; i++) {
+        if (!replay_pipes[i].path[0])
+            continue;
+        close(replay_pipes[i].rd);
+        close(replay_pipes[i].wr);
+        replay_pipes[i].path[0] = '\0';
+    }
+    free(replay_events);
+    replay_events = NULL;
+}
+
+// "1.234s ago" / "never" into buf.
+static const char *ago(char *buf, size_t len, uint64_t now, uint64_t ts)
+{
+    if (!ts || ts > now)
+        snprintf(buf, len, "never");
+    else
+        snprintf(buf, len, "%.3fs ago", (double)(now - ts) / 1e9);
+    return buf;
+}
+
+// --state: sample the published segment the way any reader would.
+static int show_state(const char *name)
+{
+    struct button_shm *m = button_shm_attach(name);
+    struct button_shm_led_snap l;
+    char when[32];
+    int rc = 0;
+
+    if (!m) {
+        fprintf(stderr, "No button state at %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    uint64_t now = trace_now_ns();
+    if (button_shm_read_led(m, &l) < 0) {
+        fprintf(stderr, "Button state at %s unreadable: %s\n", name, strerror(errno));
+        return -1;
+    }
+    printf("button pid %d %s, started %s\n", m->pid,
+           atomic_load(&m->live) ? "live" : "exited", ago(when, sizeof(when), now, m->start_ns));
+    printf("led state=%d changes=%llu last=%s\n", l.state,
+           (unsigned long long)l.changes, ago(when, sizeof(when), now, l.last_change_ns));
+    for (unsigned int i = 0; i < m->num_devs; i++) {
+        struct button_shm_dev_snap d;
+        if (button_shm_read_dev(m, i, &d) < 0) {
+            printf("%u %-24.*s unreadable: %s\n", i, BUTTON_SHM_PATH_LEN, m->dev[i].path,
+                   strerror(errno));
+            rc = -1;
+            continue;
+        }
+        printf("%u %-24.*s %s presses=%llu doubles=%llu last=%s\n", i,
+               BUTTON_SHM_PATH_LEN, m->dev[i].path, d.present ? "present" : "missing",
+               (unsigned long long)d.presses, (unsigned long long)d.doubles,
+               ago(when, sizeof(when), now, d.last_press_ns));
+    }
+    return rc;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-d DEV]... [-A FILE [-w N] [-q N]] [-R SPEC] [-b BACKEND]\n"
+        "          [-c CHIP] [-l LINE] [-a] [--debounce US] [--batch N]\n"
+        "          [--loop epoll|uring] [--sqpoll MS] [--fdstore]\n"
+        "       %s --bench N[s|ms] [--backends LIST] [--max-syscalls N] [-c CHIP] [-l LINE] [-a]\n"
+        "       %s --loop-bench N [--max-syscalls N] [--sqpoll MS] [-b BACKEND]\n"
+        "       %s --path-bench N [-d gpiod:CHIP:LINE --sim-pull PATH] [--max-syscalls N]\n"
+        "       %s --state [-M NAME]\n"
+        "       %s --listen FILTER [-P PATH]\n"
+        "       %s --replay FILE [--replay-speed X] [options as above, no -d]\n"
+        "  -d DEV    Button device, repeat for several (default: " GPIO_BUTTON_DEVICE ")\n"
+        "            gpiod:CHIP:LINE reads the line directly (libgpiod builds)\n"
+        "  -S FILE   Latency stats file, \"\" to disable (default: /run/button.stats)\n"
+        "  -P PATH   Event bus socket, \"\" to disable (default: " BUTTON_BUS_PATH ")\n"
+        "  -M NAME   Shared-memory state segment, \"\" to disable (default: " BUTTON_SHM_NAME ")\n"
+        "  -A FILE   Event to action mapping (default: \"press led\")\n"
+        "  -w N      Action worker threads (default: %d)\n"
+        "  -q N      Action queue length; full means dropped (default: %d)\n"
+        "  -R SPEC   Realtime profile POLICY[:PRIO][@CPUS], e.g. fifo:80@2\n"
+        "            (default: $" RT_PROFILE_ENV " if set)\n"
+        "  -b NAME   LED backend (default: gpio_button, mock for --loop-bench\n"
+        "            and --replay):",
+        prog, prog, prog, prog, prog, prog, prog, ACTIONS_DEFAULT_WORKERS, ACTIONS_DEFAULT_QUEUE);
+    for (int i = 0; gpio_backends[i]; i++)
+        fprintf(stderr, " %s", gpio_backends[i]->name);
+    fprintf(stderr, "\n"
+        "  -c CHIP   LED gpiochip for chardev backends (default: gpiochip3)\n"
+        "  -l LINE   LED line offset for chardev backends (default: 25)\n"
+        "  -a        LED is active-low\n"
+        "  --bench N     Toggle the LED N times (or for a duration such as 10s)\n"
+        "                on each backend and report throughput, per-call\n"
+        "                latency, syscalls per toggle and CPU time, then exit\n"
+        "  --backends L  Backends to benchmark, comma separated (default: all)\n"
+        "  --max-syscalls N  Fail the benchmark if a backend needs more than N\n"
+        "                syscalls per toggle (--loop-bench: per event, read to\n"
+        "                LED); 0 allows none\n"
+        "  --debounce US Kernel debounce for gpiod: buttons (default: %d)\n"
+        "  --batch N     Edge events per read for gpiod: buttons (default: %d,\n"
+        "                max %d)\n"
+        "  --loop L      Event loop: epoll (default) or uring\n"
+        "  --sqpoll MS   io_uring with a kernel submission thread that sleeps\n"
+        "                after MS idle (implies --loop uring)\n"
+        "  --loop-bench N  Push N synthetic events through each loop and report\n"
+        "                throughput, syscalls and CPU per event, then exit\n"
+        "  --path-bench N  Send N presses one at a time through the driver read\n"
+        "                path (mock driver over a pipe) and a gpiod: line on\n"
+        "                gpio-sim, and report latency, CPU and syscalls per\n"
+        "                press, then exit\n"
+        "  --sim-pull P  gpio-sim sim_gpioN/pull attribute of that line\n"
+        "  --state       Print the published button state and exit\n"
+        "  --bus-policy P  Slow subscribers: disconnect (default) or lossy\n"
+        "  --listen F    Subscribe to the bus and print events; F is\n"
+        "                TYPES[@DEVS] (press,double,led,device; e.g. press@0,1)\n"
+        "                or all\n"
+        "  --fdstore     Under systemd: keep device fds and state in the unit's\n"
+        "                FD store and resume from them on restart\n"
+        "  --record FILE Append every received press to FILE (binary)\n"
+        "  --replay FILE Feed a recording through the app instead of devices,\n"
+        "                then report and exit\n"
+        "  --replay-speed X  Replay X times faster than recorded (default: 1),\n"
+        "                0 or max for back to back\n"
+        "  -h        Show this help\n",
+        BUTTON_GPIOD_DEBOUNCE_US, BUTTON_GPIOD_BATCH, BUTTON_GPIOD_BATCH_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+    sigset_t sigs;
+    int opened = 0;
+    const char *actions_path = NULL;
+    unsigned int workers = ACTIONS_DEFAULT_WORKERS;
+    unsigned int queue_len = ACTIONS_DEFAULT_QUEUE;
     int retval = EXIT_SUCCESS;
+    struct rt_profile rt;
+    int opt;
+    const char *led_chip = "gpiochip3";
+    bool led_active_low = false;
+    bool led_be_given = false;
+    bool bench = false;
+    bool state = false;
+    bool fdstore = false;
+    bool resumed = false;
+    bool handoff = false;
+    const char *shm_name = BUTTON_SHM_NAME;
+    const char *bus_path = BUTTON_BUS_PATH;
+    const char *listen_filter = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    enum button_bus_policy bus_policy = BUS_SLOW_DISCONNECT;
+    struct gpio_bench_opts bo = { .backends = "all", .max_syscalls = GPIO_BENCH_NO_LIMIT };
+    enum { OPT_BENCH = 0x100, OPT_BACKENDS, OPT_MAX_SYSCALLS, OPT_DEBOUNCE, OPT_BATCH,
+           OPT_LOOP, OPT_SQPOLL, OPT_LOOP_BENCH, OPT_STATE,
+           OPT_BUS_POLICY, OPT_LISTEN, OPT_RECORD, OPT_REPLAY, OPT_REPLAY_SPEED,
+           OPT_FDSTORE, OPT_PATH_BENCH, OPT_SIM_PULL };
+    static const struct option long_opts[] = {
+        { "bench",    required_argument, NULL, OPT_BENCH },
+        { "backends", required_argument, NULL, OPT_BACKENDS },
+        { "max-syscalls", required_argument, NULL, OPT_MAX_SYSCALLS },
+        { "debounce", required_argument, NULL, OPT_DEBOUNCE },
+        { "batch",    required_argument, NULL, OPT_BATCH },
+        { "loop",     required_argument, NULL, OPT_LOOP },
+        { "sqpoll",   required_argument, NULL, OPT_SQPOLL },
+        { "loop-bench", required_argument, NULL, OPT_LOOP_BENCH },
+        { "path-bench", required_argument, NULL, OPT_PATH_BENCH },
+        { "sim-pull", required_argument, NULL, OPT_SIM_PULL },
+        { "state",    no_argument,       NULL, OPT_STATE },
+        { "bus-policy", required_argument, NULL, OPT_BUS_POLICY },
+        { "listen",   required_argument, NULL, OPT_LISTEN },
+        { "record",   required_argument, NULL, OPT_RECORD },
+        { "replay",   required_argument, NULL, OPT_REPLAY },
+        { "replay-speed", required_argument, NULL, OPT_REPLAY_SPEED },
+        { "fdstore",  no_argument,       NULL, OPT_FDSTORE },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    rt_profile_init(&rt);
+    if (rt_profile_from_env(&rt) < 0) {
+        fprintf(stderr, "Bad %s: %s\n", RT_PROFILE_ENV, getenv(RT_PROFILE_ENV));
+        return EXIT_FAILURE;
+    }
+
+    while ((opt = getopt_long(argc, argv, "d:S:M:P:A:w:q:R:b:c:l:ah", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            if (num_devs == BUTTON_MAX_DEVICES) {
+                fprintf(stderr, "Too many devices (max %d)\n", BUTTON_MAX_DEVICES);
+                return EXIT_FAILURE;
+            }
+            // Would fail with EOPNOTSUPP on every retry, forever
+            if (!strncmp(optarg, BUTTON_GPIOD_PREFIX, strlen(BUTTON_GPIOD_PREFIX)) &&
+                !button_gpiod_supported()) {
+                fprintf(stderr, "%s needs a libgpiod build (make WITH_LIBGPIOD=1)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            devs[num_devs++].path = optarg;
+            break;
+        case 'S': stats_path = optarg; break;
+        case 'M': shm_name = optarg; break;
+        case 'P': bus_path = optarg; break;
+        case 'A': actions_path = optarg; break;
+        case 'w': workers = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'q': queue_len = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'R':
+            if (rt_profile_parse(&rt, optarg) < 0) {
+                fprintf(stderr, "Bad realtime profile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            led_be = gpio_backend_find(optarg);
+            if (!led_be) {
+                fprintf(stderr, "Unknown backend: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            led_be_given = true;
+            break;
+        case 'c': led_chip = optarg; break;
+        case 'l': {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 0 || v > 1023) {
+                fprintf(stderr, "Bad line: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            led_line = (unsigned int)v;
+            break;
+        }
+        case 'a': led_active_low = true; break;
+        case OPT_BENCH:
+            if (gpio_bench_parse(&bo, optarg) < 0) {
+                fprintf(stderr, "Bad iteration count or duration: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            bench = true;
+            break;
+        case OPT_BACKENDS: bo.backends = optarg; break;
+        case OPT_MAX_SYSCALLS:
+            if (gpio_bench_parse_budget(&bo.max_syscalls, optarg) < 0) {
+                fprintf(stderr, "Bad syscall budget: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_DEBOUNCE: gpiod_debounce_us = strtoul(optarg, NULL, 0); break;
+        case OPT_BATCH: {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1 || v > BUTTON_GPIOD_BATCH_MAX) {
+                fprintf(stderr, "Bad batch size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            gpiod_batch = (unsigned int)v;
+            break;
+        }
+        case OPT_LOOP:
+            if (!strcmp(optarg, "epoll"))
+                loop_kind = LOOP_EPOLL;
+            else if (!strcmp(optarg, "uring") || !strcmp(optarg, "io_uring"))
+                loop_kind = LOOP_URING;
+            else {
+                fprintf(stderr, "Unknown loop: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SQPOLL:
+            sqpoll_ms = (unsigned int)strtoul(optarg, NULL, 0);
+            if (!sqpoll_ms)
+                sqpoll_ms = SQPOLL_IDLE_MS;
+            loop_kind = LOOP_URING;
+            break;
+        case OPT_LOOP_BENCH: {
+            char *end;
+            bench_events = strtoull(optarg, &end, 0);
+            if (end == optarg || *end || !bench_events) {
+                fprintf(stderr, "Bad event count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case OPT_PATH_BENCH: {
+            char *end;
+            path_presses = strtoull(optarg, &end, 0);
+            if (end == optarg || *end || !path_presses) {
+                fprintf(stderr, "Bad press count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case OPT_SIM_PULL: sim_pull_path = optarg; break;
+        case OPT_STATE: state = true; break;
+        case OPT_BUS_POLICY:
+            if (!strcmp(optarg, "disconnect"))
+                bus_policy = BUS_SLOW_DISCONNECT;
+            else if (!strcmp(optarg, "lossy"))
+                bus_policy = BUS_SLOW_LOSSY;
+            else {
+                fprintf(stderr, "Unknown bus policy: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_LISTEN: listen_filter = optarg; break;
+        case OPT_RECORD: record_path = optarg; break;
+        case OPT_FDSTORE: fdstore = true; break;
+        case OPT_REPLAY: replay_path = optarg; break;
+        case OPT_REPLAY_SPEED: {
+            char *end;
+            replay_speed = strcmp(optarg, "max") ? strtod(optarg, &end) : 0.0;
+            if (strcmp(optarg, "max") && (end == optarg || *end || replay_speed < 0)) {
+                fprintf(stderr, "Bad replay speed: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+        default:  print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
 
-    // Register signal handler.
+    if (bench) {
+        bo.chip = led_chip;
+        bo.offsets = &led_line;
+        bo.num_offsets = 1;
+        bo.active_low = led_active_low;
+        rt_profile_apply_process(&rt);
+        rt_profile_apply_thread(&rt);
+        return gpio_bench_run(&bo, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (state)
+        return show_state(*shm_name ? shm_name : BUTTON_SHM_NAME) == 0 ? EXIT_SUCCESS
+                                                                    : EXIT_FAILURE;
+    if (listen_filter) {
+        const char *path = *bus_path ? bus_path : BUTTON_BUS_PATH;
+        if (bus_listen(path, listen_filter) < 0) {
+            fprintf(stderr, "Cannot listen on %s (filter %s): %s\n", path, listen_filter,
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if ((bench_events || path_presses || replay_path) && !led_be_given)
+        led_be = &gpio_backend_mock;
+    if (path_presses && !bench_events) {
+        if (num_devs > 1 || (num_devs == 1 && (!sim_pull_path ||
+            strncmp(devs[0].path, BUTTON_GPIOD_PREFIX, strlen(BUTTON_GPIOD_PREFIX))))) {
+            fprintf(stderr, "--path-bench takes one -d gpiod:CHIP:LINE on gpio-sim, "
+                    "with --sim-pull\n");
+            return EXIT_FAILURE;
+        }
+        path_line = num_devs ? devs[0].path : NULL;
+        num_devs = 0;
+    }
+    if (replay_path && !bench_events) {
+        if (num_devs) {
+            fprintf(stderr, "--replay takes its devices from the recording, drop -d\n");
+            return EXIT_FAILURE;
+        }
+        if (replay_setup(replay_path) < 0) {
+            replay_stop();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (num_devs == 0)
+        devs[num_devs++].path = GPIO_BUTTON_DEVICE;
+    for (int i = 0; i < num_devs; i++)
+        devs[i].fd = -1;
+
+    // SIGSEGV still goes through a handler; the rest arrive on the signalfd.
     struct sigaction sa;
     sa.sa_handler = sig_handler;
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
     sigaction(SIGSEGV, &sa, NULL); 
 
-    // Open LED sysfs in read/write mode.
-    led_fd = open(GPIO_LED_SYSFS_PATH, O_RDWR);
-    if (led_fd < 0) {
-        fprintf(stderr, "Failed to open LED sysfs: %s\n", strerror(errno));
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    openlog("button", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+    if (actions_load(actions_path) < 0)
+        return EXIT_FAILURE;
+    hist_init(&irq_read_hist);
+    hist_init(&wake_hist);
+    hist_init(&led_hist);
+    hist_init(&e2e_hist);
+
+    // Threads started below inherit the blocked mask, so signals stay here.
+    if (trace_ring_init(&trace, TRACE_CAPACITY) < 0 ||
+        trace_flusher_start(&trace, "button", trace_names, TRACE_DUMP_PATH,
+                            TRACE_SUMMARY_SEC) < 0)
+        fprintf(stderr, "Trace ring unavailable: %s\n", strerror(errno));
+    if (actions_start(workers, queue_len) < 0) {
+        fprintf(stderr, "Failed to start action workers: %s\n", strerror(errno));
         retval = EXIT_FAILURE;
         goto cleanup;
     }
 
-    // Read initial LED state
-    if (read(led_fd, led_value, sizeof(led_value)) <= 0) {
-        fprintf(stderr, "Failed to read initial LED state: %s\n", strerror(errno));
+    // Request the LED through the selected backend.
+    led = led_be->request(led_chip, &led_line, 1, NULL, led_active_low, "button");
+    if (!led) {
+        fprintf(stderr, "Failed to open LED (%s): %s\n", led_be->name, strerror(errno));
         retval = EXIT_FAILURE;
         goto cleanup;
     }
-    current_led_state = atoi(led_value);
 
-    // Open button device
-    button_fd = open(GPIO_BUTTON_DEVICE, O_RDONLY);
-    if (button_fd < 0) {
-        fprintf(stderr, "Failed to open GPIO button device: %s\n", strerror(errno));
+    // Resume from the FD store (--fdstore): the last run's LED state and
+    // counters; it also hands back the device fds to dev_open()
+    if (fdstore && !bench_events && !path_presses && !replay_path) {
+        int r = button_fdstore_open((unsigned int)num_devs);
+        if (r < 0) {
+            syslog(LOG_WARNING, "FD store handoff unavailable: %s", strerror(errno));
+            fprintf(stderr, "FD store handoff unavailable: %s\n", strerror(errno));
+        }
+        fds_state = button_fdstore_state();
+        resumed = r > 0;
+    }
+    if (resumed) {
+        current_led_state = fds_state->led_state;
+        for (int i = 0; i < num_devs; i++) {
+            devs[i].presses = fds_state->dev[i].presses;
+            devs[i].last_press_ns = fds_state->dev[i].last_press_ns;
+        }
+        // Cheap, and a backend that re-requested the line may have reset it
+        if (led_be->set(led, 1, &led_line, current_led_state) < 0) {
+            fprintf(stderr, "Failed to restore LED state: %s\n", strerror(errno));
+            retval = EXIT_FAILURE;
+            goto cleanup;
+        }
+        syslog(LOG_INFO, "Resumed from FD store, LED %d", current_led_state);
+    } else {
+        // Read initial LED state
+        current_led_state = led_be->get ? led_be->get(led, led_line) : 0;
+        if (current_led_state < 0) {
+            fprintf(stderr, "Failed to read initial LED state: %s\n", strerror(errno));
+            retval = EXIT_FAILURE;
+            goto cleanup;
+        }
+        if (fds_state)
+            fds_state->led_state = current_led_state;
+    }
+
+    // Event sources besides the buttons: signals and the retry timer
+    sig_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sig_fd < 0 || timer_fd < 0) {
+        fprintf(stderr, "Failed to set up event loop: %s\n", strerror(errno));
         retval = EXIT_FAILURE;
         goto cleanup;
     }
 
-    printf("LED Control App - Initial State: %d\n", current_led_state);
+    if (bench_events) {
+        rt_profile_apply_process(&rt);
+        rt_profile_apply_thread(&rt);
+        retval = loop_bench(bo.max_syscalls) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (path_presses) {
+        rt_profile_apply_process(&rt);
+        rt_profile_apply_thread(&rt);
+        retval = path_bench(bo.max_syscalls) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        goto cleanup;
+    }
 
-    while (keep_running) {
-        // Block until button event
-        if (read(button_fd, &event_flag, sizeof(event_flag)) < 0) {
-            if (errno == EINTR) break; // SIGINT received
-            fprintf(stderr, "Read error: %s\n", strerror(errno));
-            retval = EXIT_FAILURE;
-            goto cleanup;
+    // Published state; readers are optional, so failing here is not fatal
+    if (*shm_name) {
+        const char *paths[BUTTON_MAX_DEVICES];
+        for (int i = 0; i < num_devs; i++)
+            paths[i] = devs[i].path;
+        if (button_shm_open(shm_name, (unsigned int)num_devs, paths, current_led_state) < 0) {
+            syslog(LOG_WARNING, "Shared state %s unavailable: %s", shm_name, strerror(errno));
+            fprintf(stderr, "Shared state %s unavailable: %s\n", shm_name, strerror(errno));
+        } else if (resumed) {
+            // Same counters as the bus and stats, which carry on from the FD store
+            for (int i = 0; i < num_devs; i++)
+                button_shm_resume((unsigned int)i, devs[i].presses, devs[i].last_press_ns);
         }
+    }
 
-        // Toggle LED state
-        current_led_state = !current_led_state;
-        snprintf(led_value, sizeof(led_value), "%d", current_led_state);
+    if (*bus_path && bus_open(bus_path, bus_policy) < 0) {
+        syslog(LOG_WARNING, "Event bus %s unavailable: %s", bus_path, strerror(errno));
+        fprintf(stderr, "Event bus %s unavailable: %s\n", bus_path, strerror(errno));
+    }
 
-        // Reset file offset and write to LED sysfs
-        if (lseek(led_fd, 0, SEEK_SET) < 0) {
-            fprintf(stderr, "lseek failed: %s\n", strerror(errno));
-            retval = EXIT_FAILURE;
-            goto cleanup;
-        }
+    if (record_path && button_rec_open(record_path, (unsigned int)num_devs) < 0) {
+        fprintf(stderr, "Cannot record to %s: %s\n", record_path, strerror(errno));
+        retval = EXIT_FAILURE;
+        goto cleanup;
+    }
 
-        if (write(led_fd, led_value, 1) < 0) {
-            fprintf(stderr, "LED write failed: %s\n", strerror(errno));
-            retval = EXIT_FAILURE;
-            goto cleanup;
+    if (loop_init() < 0) {
+        fprintf(stderr, "Failed to set up %s loop: %s\n",
+                loop_kind == LOOP_EPOLL ? "epoll" : "io_uring", strerror(errno));
+        retval = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    // Open button devices; missing ones are retried, but one must be there
+    for (int i = 0; i < num_devs; i++) {
+        if (dev_open((unsigned int)i) == 0) {
+            opened++;
+            continue;
         }
+        syslog(LOG_WARNING, "Failed to open %s: %s", devs[i].path, strerror(errno));
+        fprintf(stderr, "Failed to open GPIO button device %s: %s\n",
+                devs[i].path, strerror(errno));
+    }
+    if (!opened) {
+        retval = EXIT_FAILURE;
+        goto cleanup;
+    }
+    retry_timer_update();
 
-        printf("LED Toggled → %d\n", current_led_state);
+    // Realtime profile for the reader loop (no-op unless asked for).
+    rt_profile_apply_process(&rt);
+    rt_profile_apply_thread(&rt);
+    if (rt.enabled)
+        printf("Realtime profile: %s\n",
+               rt_profile_report("button") ? "isolated CPU" : "shared CPU");
+
+    printf("LED Control App - Initial State: %d, %d of %d button device(s)\n",
+           current_led_state, opened, num_devs);
+
+    if (replay_events && replay_start() < 0) {
+        fprintf(stderr, "Failed to start replay: %s\n", strerror(errno));
+        retval = EXIT_FAILURE;
+        goto cleanup;
     }
 
+    // Type=notify: started means devices open and presses being read
+    char status[160];
+    snprintf(status, sizeof(status), "READY=1\nSTATUS=%d of %d button device(s), LED %d%s",
+             opened, num_devs, current_led_state, resumed ? ", resumed" : "");
+    sd_notify_send(status, NULL, 0);
+
+    if (loop_run() < 0)
+        retval = EXIT_FAILURE;
+    else if (fds_state && terminated)
+        handoff = true;
+
 cleanup:
     printf("\nCleaning up...\n");
+    sd_notify_send("STOPPING=1", NULL, 0);
 
-    if (led_fd >= 0) {
-        lseek(led_fd, 0, SEEK_SET);
-        write(led_fd, "0", 1);
-        close(led_fd);
+    actions_stop();
+    replay_stop();
+    if (!bench_events) {
+        actions_report();
+        bus_report();
+        stats_report();
     }
+    loop_fini();
 
-    if (button_fd >= 0) {
-        close(button_fd);
+    if (led) {
+        // Handing off to the next run: leave the LED as it is. Any other
+        // exit turns it off, and a restart after a failure resumes with it off
+        if (!handoff) {
+            led_be->set(led, 1, &led_line, 0);
+            if (fds_state)
+                fds_state->led_state = 0;
+        }
+        led_be->release(led);
     }
 
+    for (int i = 0; i < num_devs; i++)
+        dev_release((unsigned int)i);
+    button_fdstore_close();
+    button_shm_close();
+    bus_close();
+    button_rec_close();
+    if (sig_fd >= 0)
+        close(sig_fd);
+    if (timer_fd >= 0)
+        close(timer_fd);
+
+    trace_flusher_stop(&trace);
+    trace_ring_destroy(&trace);
+    closelog();
+
     return retval;
 }
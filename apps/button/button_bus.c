@@ -0,0 +1,366 @@
+//-----------------------------------------------------------------------------
+// File:         button_bus.c
+//
+// Description:  SOCK_SEQPACKET pub/sub broker for button events.
+//
+// Notes:
+// - Runs on the event loop thread. The listening socket and the client
+//   sockets sit in a private epoll set whose fd is what the loop watches,
+//   so accepting and reading subscriptions never touches the press path.
+// - Events are queued per wakeup and sent with one sendmmsg() per matching
+//   subscriber, one message per record; iovecs point into the shared
+//   batch, so nothing is copied per client.
+// - Client sockets are non-blocking. A subscriber whose socket buffer
+//   cannot take the whole batch is disconnected (default) or, with the
+//   lossy policy, loses the rest of that batch.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "button_bus.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define BUS_BATCH       64      // records per flush (flushes early when full)
+#define BUS_BACKLOG     16
+#define TAG_LISTEN      UINT32_MAX
+
+struct bus_client {
+    int fd;                     // -1 = free slot
+    uint32_t types;
+    uint32_t devs;
+    uint64_t sent;
+    uint64_t lost;
+};
+
+static struct bus_client clients[BUTTON_BUS_MAX_CLIENTS];
+static int listen_fd = -1;
+static int set_fd = -1;
+static const char *sock_path;
+static enum button_bus_policy slow_policy;
+
+static struct button_bus_event batch[BUS_BATCH];
+static unsigned int batch_len;
+static uint64_t next_seq;
+static uint64_t total_sent, total_lost, slow_drops, client_count;
+
+static void client_drop(struct bus_client *c, const char *why)
+{
+    syslog(LOG_INFO, "bus: client %d %s after %llu events (%llu lost)", c->fd, why,
+           (unsigned long long)c->sent, (unsigned long long)c->lost);
+    epoll_ctl(set_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+int bus_open(const char *path, enum button_bus_policy policy)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = TAG_LISTEN };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    for (int i = 0; i < BUTTON_BUS_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    slow_policy = policy;
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    set_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (listen_fd < 0 || set_fd < 0)
+        goto fail;
+
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(path, 0660) < 0 ||
+        listen(listen_fd, BUS_BACKLOG) < 0 ||
+        epoll_ctl(set_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+        goto fail;
+
+    sock_path = path;
+    syslog(LOG_INFO, "Event bus listening on %s", path);
+    return set_fd;
+
+fail:
+    {
+        int err = errno;
+        if (listen_fd >= 0)
+            close(listen_fd);
+        if (set_fd >= 0)
+            close(set_fd);
+        listen_fd = set_fd = -1;
+        errno = err;
+    }
+    return -1;
+}
+
+int bus_fd(void)
+{
+    return set_fd;
+}
+
+static void bus_accept(void)
+{
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = -1;
+        for (int i = 0; i < BUTTON_BUS_MAX_CLIENTS && slot < 0; i++) {
+            if (clients[i].fd < 0)
+                slot = i;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)slot };
+        if (slot < 0 || epoll_ctl(set_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            syslog(LOG_WARNING, "bus: refusing client, %s",
+                   slot < 0 ? "too many clients" : strerror(errno));
+            close(fd);
+            continue;
+        }
+        clients[slot] = (struct bus_client){ .fd = fd };
+        client_count++;
+    }
+}
+
+// A client spoke: a subscription, garbage (dropped) or a hangup.
+static void bus_client_input(struct bus_client *c)
+{
+    struct button_bus_sub sub;
+
+    for (;;) {
+        ssize_t n = recv(c->fd, &sub, sizeof(sub), MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                client_drop(c, strerror(errno));
+            return;
+        }
+        if (n == 0) {
+            client_drop(c, "hung up");
+            return;
+        }
+        if (n != (ssize_t)sizeof(sub) || sub.magic != BUTTON_BUS_MAGIC) {
+            client_drop(c, "sent a bad subscription");
+            return;
+        }
+        c->types = sub.types;
+        c->devs = sub.devs;
+    }
+}
+
+void bus_service(void)
+{
+    struct epoll_event evs[16];
+    int n;
+
+    if (set_fd < 0)
+        return;
+    while ((n = epoll_wait(set_fd, evs, 16, 0)) > 0) {
+        for (int k = 0; k < n; k++) {
+            if (evs[k].data.u32 == TAG_LISTEN) {
+                bus_accept();
+                continue;
+            }
+            struct bus_client *c = &clients[evs[k].data.u32];
+            if (c->fd >= 0)
+                bus_client_input(c);
+        }
+        if (n < 16)
+            break;
+    }
+}
+
+static bool client_wants(const struct bus_client *c, const struct button_bus_event *e)
+{
+    return (!c->types || (c->types & (1u << e->type))) &&
+           (!c->devs || (e->dev < 32 && (c->devs & (1u << e->dev))));
+}
+
+void bus_flush(void)
+{
+    struct mmsghdr msgs[BUS_BATCH];
+    struct iovec iov[BUS_BATCH];
+
+    if (!batch_len)
+        return;
+    for (int i = 0; i < BUTTON_BUS_MAX_CLIENTS; i++) {
+        struct bus_client *c = &clients[i];
+        unsigned int m = 0;
+
+        if (c->fd < 0)
+            continue;
+        for (unsigned int k = 0; k < batch_len; k++) {
+            if (!client_wants(c, &batch[k]))
+                continue;
+            iov[m] = (struct iovec){ &batch[k], sizeof(batch[k]) };
+            memset(&msgs[m], 0, sizeof(msgs[m]));
+            msgs[m].msg_hdr.msg_iov = &iov[m];
+            msgs[m].msg_hdr.msg_iovlen = 1;
+            m++;
+        }
+        if (!m)
+            continue;
+
+        int sent = sendmmsg(c->fd, msgs, m, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN) {
+                client_drop(c, strerror(errno));
+                continue;
+            }
+            sent = 0;
+        }
+        c->sent += (unsigned int)sent;
+        total_sent += (unsigned int)sent;
+        if ((unsigned int)sent == m)
+            continue;
+
+        // Socket buffer full: the subscriber is not keeping up
+        c->lost += m - (unsigned int)sent;
+        total_lost += m - (unsigned int)sent;
+        if (slow_policy == BUS_SLOW_DISCONNECT) {
+            slow_drops++;
+            client_drop(c, "too slow, disconnected");
+        }
+    }
+    batch_len = 0;
+}
+
+void bus_publish(enum button_bus_type type, unsigned int dev, uint64_t ts_ns,
+                 int64_t value)
+{
+    if (set_fd < 0)
+        return;
+    if (batch_len == BUS_BATCH)
+        bus_flush();
+    batch[batch_len++] = (struct button_bus_event){
+        .seq = next_seq++, .ts_ns = ts_ns, .type = type, .dev = dev, .value = value,
+    };
+}
+
+void bus_report(void)
+{
+    int connected = 0;
+
+    if (set_fd < 0)
+        return;
+    for (int i = 0; i < BUTTON_BUS_MAX_CLIENTS; i++)
+        connected += clients[i].fd >= 0;
+    syslog(LOG_INFO, "bus: clients=%d (total %llu) published=%llu sent=%llu lost=%llu "
+           "slow_disconnects=%llu", connected, (unsigned long long)client_count,
+           (unsigned long long)next_seq, (unsigned long long)total_sent,
+           (unsigned long long)total_lost, (unsigned long long)slow_drops);
+    fprintf(stderr, "bus: clients=%d (total %llu) published=%llu sent=%llu lost=%llu "
+            "slow_disconnects=%llu\n", connected, (unsigned long long)client_count,
+            (unsigned long long)next_seq, (unsigned long long)total_sent,
+            (unsigned long long)total_lost, (unsigned long long)slow_drops);
+}
+
+void bus_close(void)
+{
+    if (set_fd < 0)
+        return;
+    bus_flush();
+    for (int i = 0; i < BUTTON_BUS_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0)
+            close(clients[i].fd);
+        clients[i].fd = -1;
+    }
+    close(listen_fd);
+    close(set_fd);
+    listen_fd = set_fd = -1;
+    unlink(sock_path);
+}
+
+// "TYPES[@DEVS]": comma lists of type names / device indexes, "all" or
+// empty for everything. 0 or -1.
+static int parse_filter(const char *spec, const char *const *names,
+                        uint32_t *types, uint32_t *devs)
+{
+    char buf[128], *save, *tok;
+    char *at;
+
+    *types = *devs = 0;
+    if (!spec || !*spec || !strcmp(spec, "all"))
+        return 0;
+    if (strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+    at = strchr(buf, '@');
+    if (at) {
+        *at++ = '\0';
+        for (tok = strtok_r(at, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+            char *end;
+            unsigned long v = strtoul(tok, &end, 10);
+            if (end == tok || *end || v >= 32)
+                return -1;
+            *devs |= 1u << v;
+        }
+    }
+    if (!*buf || !strcmp(buf, "all"))
+        return 0;
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int t = -1;
+        for (int i = 0; i < BUTTON_BUS_TYPES && t < 0; i++) {
+            if (!strcmp(tok, names[i]))
+                t = i;
+        }
+        if (t < 0)
+            return -1;
+        *types |= 1u << t;
+    }
+    return 0;
+}
+
+int bus_listen(const char *path, const char *filter)
+{
+    static const char *const names[BUTTON_BUS_TYPES] = {
+        [BUTTON_BUS_PRESS] = "press", [BUTTON_BUS_DOUBLE] = "double",
+        [BUTTON_BUS_LED] = "led", [BUTTON_BUS_DEVICE] = "device",
+    };
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct button_bus_sub sub = { .magic = BUTTON_BUS_MAGIC };
+    struct button_bus_event e;
+    int fd;
+
+    if (parse_filter(filter, names, &sub.types, &sub.devs) < 0 ||
+        strlen(path) >= sizeof(addr.sun_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        send(fd, &sub, sizeof(sub), MSG_NOSIGNAL) != (ssize_t)sizeof(sub)) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    for (;;) {
+        ssize_t n = recv(fd, &e, sizeof(e), 0);
+        if (n <= 0)
+            break;
+        if (n != (ssize_t)sizeof(e) || e.type >= BUTTON_BUS_TYPES)
+            continue;
+        printf("%llu %llu.%09llu %s dev=%u value=%lld\n", (unsigned long long)e.seq,
+               (unsigned long long)(e.ts_ns / 1000000000ULL),
+               (unsigned long long)(e.ts_ns % 1000000000ULL), names[e.type], e.dev,
+               (long long)e.value);
+    }
+    close(fd);
+    return 0;
+}
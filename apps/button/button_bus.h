@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// File:         button_bus.h
+//
+// Description:  Button event broker: app-side interface.
+//
+// Notes:
+// - The records and the subscription message are in button_bus_wire.h
+//   (apps/common), which subscribers include without this header.
+// - Drops under the lossy policy are counted per client by the app
+//   (bus_report()).
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_BUS_H
+#define BUTTON_BUS_H
+
+#include <stdint.h>
+
+#include "button_bus_wire.h"
+
+#define BUTTON_BUS_MAX_CLIENTS  64
+
+enum button_bus_policy {
+    BUS_SLOW_DISCONNECT,    // a subscriber that cannot take a batch is dropped
+    BUS_SLOW_LOSSY,         // it loses what did not fit and stays connected
+};
+
+/*
+ * Listen on path (a stale socket file is replaced). The returned fd is
+ * pollable: when readable, call bus_service(). -1 with errno on failure.
+ */
+int bus_open(const char *path, enum button_bus_policy policy);
+int bus_fd(void);
+
+/* Accept clients, read subscriptions, reap hangups. Never blocks. */
+void bus_service(void);
+
+/*
+ * Queue an event for every matching subscriber; bus_flush() sends what is
+ * queued with one sendmmsg() per subscriber. The loop flushes once per
+ * wakeup; publishing flushes early if the batch is full.
+ */
+void bus_publish(enum button_bus_type type, unsigned int dev, uint64_t ts_ns,
+                 int64_t value);
+void bus_flush(void);
+
+/* Clients, events sent, events lost and slow disconnects to syslog/stderr. */
+void bus_report(void);
+void bus_close(void);
+
+/*
+ * Client side used by `button --listen FILTER`: connect, subscribe with
+ * FILTER ("TYPES[@DEVS]", e.g. "press,double@0,1", or "all") and print
+ * records until the app goes away. 0, or -1 (EINVAL for a bad filter).
+ */
+int bus_listen(const char *path, const char *filter);
+
+#endif /* BUTTON_BUS_H */
@@ -0,0 +1,210 @@
+//-----------------------------------------------------------------------------
+// File:         button_fdstore.c
+//
+// Description:  FD store handoff for the button app (see button_fdstore.h).
+//
+// Notes:
+// - Talks to systemd through sd_notify.c: FDSTORE=1 with FDNAME= to park
+//   an fd, FDSTOREREMOVE=1 to drop one. systemd replaces nothing by name,
+//   so a device is only stored when it was opened by this run.
+// - A stored device fd is only reused if it still names the -d path (same
+//   device number, or the same inode for plain files), so an upgrade that
+//   reorders -d does not swap buttons.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "button_fdstore.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "sd_notify.h"
+
+#define FDNAME_STATE    "state"
+#define FDNAME_DEV      "dev"           /* + -d index */
+
+static bool active;
+static struct button_fdstore_state *state;
+static int stored_dev[BUTTON_FDSTORE_MAX_DEVS];
+
+static void fdname_dev(char *buf, size_t len, unsigned int i)
+{
+    snprintf(buf, len, FDNAME_DEV "%u", i);
+}
+
+static int store(const char *name, int fd)
+{
+    char msg[96];
+
+    snprintf(msg, sizeof(msg), "FDSTORE=1\nFDNAME=%s", name);
+    if (sd_notify_send(msg, &fd, 1) < 0) {
+        syslog(LOG_WARNING, "fdstore: cannot store %s: %s", name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void unstore(const char *name)
+{
+    char msg[96];
+
+    snprintf(msg, sizeof(msg), "FDSTOREREMOVE=1\nFDNAME=%s", name);
+    sd_notify_send(msg, NULL, 0);
+}
+
+// Map a stored state memfd if it is ours; NULL otherwise.
+static struct button_fdstore_state *state_map(int fd)
+{
+    struct button_fdstore_state *s;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(*s))
+        return NULL;
+    s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (s == MAP_FAILED)
+        return NULL;
+    if (s->magic != BUTTON_FDSTORE_MAGIC || s->version != BUTTON_FDSTORE_VERSION) {
+        munmap(s, sizeof(*s));
+        return NULL;
+    }
+    return s;
+}
+
+int button_fdstore_open(unsigned int num_devs)
+{
+    struct sd_notify_fd fds[SD_NOTIFY_MAX_FDS];
+    int n, restored = 0;
+    int fd;
+
+    for (unsigned int i = 0; i < BUTTON_FDSTORE_MAX_DEVS; i++)
+        stored_dev[i] = -1;
+    if (!getenv("NOTIFY_SOCKET"))
+        return 0;
+    if (num_devs > BUTTON_FDSTORE_MAX_DEVS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    n = sd_notify_take_fds(fds, SD_NOTIFY_MAX_FDS);
+    if (n < 0)
+        return -1;
+    for (int k = 0; k < n; k++) {
+        const char *name = fds[k].name;
+        bool dup = false;
+
+        if (!strcmp(name, FDNAME_STATE)) {
+            dup = state != NULL;
+            if (!dup && (state = state_map(fds[k].fd)) != NULL) {
+                restored = 1;
+                close(fds[k].fd);   // the mapping and the store keep it alive
+                continue;
+            }
+        } else if (!strncmp(name, FDNAME_DEV, strlen(FDNAME_DEV))) {
+            char *end;
+            unsigned long i = strtoul(name + strlen(FDNAME_DEV), &end, 10);
+            if (!*end && end != name + strlen(FDNAME_DEV) && i < num_devs) {
+                dup = stored_dev[i] >= 0;
+                if (!dup) {
+                    stored_dev[i] = fds[k].fd;
+                    continue;
+                }
+            }
+        }
+        // Stale or unknown: drop it here and in the store. Removal goes by
+        // name, so a duplicate of one we keep is only closed.
+        syslog(LOG_INFO, "fdstore: dropping stored fd \"%s\"", name);
+        if (name[0] && !dup)
+            unstore(name);
+        close(fds[k].fd);
+    }
+
+    if (!state) {
+        fd = memfd_create("button-state", MFD_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        if (ftruncate(fd, sizeof(*state)) < 0 ||
+            (state = mmap(NULL, sizeof(*state), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                          0)) == MAP_FAILED) {
+            int err = errno;
+            state = NULL;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        state->magic = BUTTON_FDSTORE_MAGIC;
+        state->version = BUTTON_FDSTORE_VERSION;
+        store(FDNAME_STATE, fd);
+        close(fd);
+    }
+    // Counters are per -d index: a different device list starts them over
+    if (restored && state->num_devs != num_devs)
+        memset(state->dev, 0, sizeof(state->dev));
+    state->num_devs = num_devs;
+    active = true;
+    return restored;
+}
+
+struct button_fdstore_state *button_fdstore_state(void)
+{
+    return state;
+}
+
+int button_fdstore_take_dev(unsigned int i, const char *path)
+{
+    struct stat fst, pst;
+    int fd;
+
+    if (!active || i >= BUTTON_FDSTORE_MAX_DEVS || stored_dev[i] < 0)
+        return -1;
+    fd = stored_dev[i];
+    stored_dev[i] = -1;
+    if (fstat(fd, &fst) == 0 && stat(path, &pst) == 0 &&
+        (fst.st_mode & S_IFMT) == (pst.st_mode & S_IFMT) &&
+        (S_ISCHR(fst.st_mode) ? fst.st_rdev == pst.st_rdev
+                              : fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino))
+        return fd;
+
+    syslog(LOG_INFO, "fdstore: stored fd for %s is stale", path);
+    button_fdstore_drop_dev(i);
+    close(fd);
+    return -1;
+}
+
+void button_fdstore_put_dev(unsigned int i, int fd)
+{
+    char name[16];
+
+    if (!active || i >= BUTTON_FDSTORE_MAX_DEVS)
+        return;
+    fdname_dev(name, sizeof(name), i);
+    store(name, fd);
+}
+
+void button_fdstore_drop_dev(unsigned int i)
+{
+    char name[16];
+
+    if (!active || i >= BUTTON_FDSTORE_MAX_DEVS)
+        return;
+    fdname_dev(name, sizeof(name), i);
+    unstore(name);
+}
+
+void button_fdstore_close(void)
+{
+    for (unsigned int i = 0; i < BUTTON_FDSTORE_MAX_DEVS; i++) {
+        if (stored_dev[i] >= 0)
+            close(stored_dev[i]);
+        stored_dev[i] = -1;
+    }
+    if (state)
+        munmap(state, sizeof(*state));
+    state = NULL;
+    active = false;
+}
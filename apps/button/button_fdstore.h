@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// File:         button_fdstore.h
+//
+// Description:  Hand the button app's devices and state to its next run
+//               through systemd's FD store.
+//
+// Notes:
+// - With --fdstore the app parks every open button device fd ("devN" for
+//   -d index N) and a memfd holding its state ("state") in the unit's FD
+//   store (FileDescriptorStoreMax= in the unit). A restarted app gets
+//   them back at startup: devices are never closed across the restart, so
+//   the driver holds presses for the next reader, and the LED state and
+//   per-button counters come from memory instead of sysfs.
+// - The state memfd is mapped shared and kept current on every press and
+//   LED change; the stored fd refers to the same file, so whatever the
+//   last run wrote is what the next one reads, crash or not.
+// - gpiod: lines are not stored: libgpiod cannot adopt a request fd, so
+//   they are requested again.
+// - Without a notify socket (not under systemd) nothing is stored and all
+//   calls are no-ops.
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_FDSTORE_H
+#define BUTTON_FDSTORE_H
+
+#include <stdint.h>
+
+#define BUTTON_FDSTORE_MAGIC    0x53444642u     /* "BFDS" */
+#define BUTTON_FDSTORE_VERSION  1
+#define BUTTON_FDSTORE_MAX_DEVS 16
+
+struct button_fdstore_state {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_devs;
+    int32_t led_state;                  /* logical LED value */
+    struct {
+        uint64_t presses;
+        uint64_t last_press_ns;         /* CLOCK_MONOTONIC */
+    } dev[BUTTON_FDSTORE_MAX_DEVS];
+};
+
+/*
+ * Take what a previous run stored and set up the state memfd. Returns 1
+ * if a previous run's state was restored (the caller reads it through
+ * button_fdstore_state()), 0 for a fresh start or when not under systemd,
+ * -1 with errno if the memfd could not be set up.
+ */
+int button_fdstore_open(unsigned int num_devs);
+
+/* The live, shared state; NULL unless button_fdstore_open() set it up. */
+struct button_fdstore_state *button_fdstore_state(void);
+
+/*
+ * A stored fd for device i that still refers to path, or -1: the caller
+ * opens it and stores the new fd with button_fdstore_put_dev().
+ */
+int button_fdstore_take_dev(unsigned int i, const char *path);
+void button_fdstore_put_dev(unsigned int i, int fd);
+
+/* Device i went away: forget the stored fd. */
+void button_fdstore_drop_dev(unsigned int i);
+
+/* Close stored fds nobody claimed and unmap the state (the store keeps it). */
+void button_fdstore_close(void);
+
+#endif /* BUTTON_FDSTORE_H */
@@ -0,0 +1,187 @@
+//-----------------------------------------------------------------------------
+// File:         button_gpiod.c
+//
+// Description:  Button input via libgpiod v2 edge events.
+//
+// Notes:
+// - Only does real work with HAVE_LIBGPIOD (make WITH_LIBGPIOD=1); without
+//   it button_gpiod_supported() is false and the app rejects gpiod: devices
+//   when parsing options (button_gpiod_open() would fail with EOPNOTSUPP).
+// - Debouncing is left to the kernel (gpiod_line_settings_set_debounce_
+//   period_us), so every falling edge read here is a press. Events come
+//   out of the request fd batch at a time into one edge event buffer that
+//   is allocated once per line.
+//-----------------------------------------------------------------------------
+#include "button_gpiod.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBGPIOD
+
+#include <gpiod.h>
+
+struct button_gpiod {
+    struct gpiod_chip *chip;
+    struct gpiod_line_request *req;
+    struct gpiod_edge_event_buffer *events;
+    size_t batch;
+};
+
+struct button_gpiod *button_gpiod_open(const char *spec, unsigned long debounce_us,
+                                       size_t batch)
+{
+    char chip[128], path[160];
+    const char *colon = strrchr(spec, ':');
+    struct gpiod_line_settings *settings = NULL;
+    struct gpiod_line_config *lcfg = NULL;
+    struct gpiod_request_config *rcfg = NULL;
+    struct button_gpiod *b;
+    unsigned int offset;
+    char *end;
+    int err;
+
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(chip)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    offset = (unsigned int)strtoul(colon + 1, &end, 0);
+    if (end == colon + 1 || *end) {
+        errno = EINVAL;
+        return NULL;
+    }
+    memcpy(chip, spec, (size_t)(colon - spec));
+    chip[colon - spec] = '\0';
+    if (strchr(chip, '/'))
+        snprintf(path, sizeof(path), "%s", chip);
+    else
+        snprintf(path, sizeof(path), "/dev/%s", chip);
+
+    b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+    b->batch = batch ? batch : BUTTON_GPIOD_BATCH;
+
+    b->chip = gpiod_chip_open(path);
+    if (!b->chip)
+        goto fail;
+
+    // Pressed pulls the line low: physical falling edge = press. Not
+    // active-low, which would flip the edge the kernel reports.
+    settings = gpiod_line_settings_new();
+    lcfg = gpiod_line_config_new();
+    rcfg = gpiod_request_config_new();
+    b->events = gpiod_edge_event_buffer_new(b->batch);
+    if (!settings || !lcfg || !rcfg || !b->events)
+        goto fail;
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_INPUT);
+    gpiod_line_settings_set_bias(settings, GPIOD_LINE_BIAS_PULL_UP);
+    gpiod_line_settings_set_edge_detection(settings, GPIOD_LINE_EDGE_FALLING);
+    gpiod_line_settings_set_debounce_period_us(settings, debounce_us);
+    gpiod_line_settings_set_event_clock(settings, GPIOD_LINE_CLOCK_MONOTONIC);
+    if (gpiod_line_config_add_line_settings(lcfg, &offset, 1, settings) < 0)
+        goto fail;
+    gpiod_request_config_set_consumer(rcfg, "button");
+    gpiod_request_config_set_event_buffer_size(rcfg, b->batch * 4);
+
+    b->req = gpiod_chip_request_lines(b->chip, rcfg, lcfg);
+    if (!b->req)
+        goto fail;
+
+    gpiod_request_config_free(rcfg);
+    gpiod_line_config_free(lcfg);
+    gpiod_line_settings_free(settings);
+    return b;
+
+fail:
+    err = errno;
+    if (rcfg)
+        gpiod_request_config_free(rcfg);
+    if (lcfg)
+        gpiod_line_config_free(lcfg);
+    if (settings)
+        gpiod_line_settings_free(settings);
+    button_gpiod_close(b);
+    errno = err;
+    return NULL;
+}
+
+int button_gpiod_fd(const struct button_gpiod *b)
+{
+    return gpiod_line_request_get_fd(b->req);
+}
+
+int button_gpiod_read(struct button_gpiod *b, uint64_t *ts_ns, int max)
+{
+    size_t want = b->batch < (size_t)max ? b->batch : (size_t)max;
+    int n = gpiod_line_request_read_edge_events(b->req, b->events, want);
+    int presses = 0;
+
+    if (n < 0)
+        return -1;
+    for (int i = 0; i < n; i++) {
+        struct gpiod_edge_event *ev = gpiod_edge_event_buffer_get_event(b->events,
+                                                                         (unsigned long)i);
+        if (ev && gpiod_edge_event_get_event_type(ev) == GPIOD_EDGE_EVENT_FALLING_EDGE)
+            ts_ns[presses++] = gpiod_edge_event_get_timestamp_ns(ev);
+    }
+    return presses;
+}
+
+void button_gpiod_close(struct button_gpiod *b)
+{
+    if (!b)
+        return;
+    if (b->req)
+        gpiod_line_request_release(b->req);
+    if (b->events)
+        gpiod_edge_event_buffer_free(b->events);
+    if (b->chip)
+        gpiod_chip_close(b->chip);
+    free(b);
+}
+
+#else /* !HAVE_LIBGPIOD */
+
+struct button_gpiod *button_gpiod_open(const char *spec, unsigned long debounce_us,
+                                       size_t batch)
+{
+    (void)spec;
+    (void)debounce_us;
+    (void)batch;
+    errno = EOPNOTSUPP;
+    return NULL;
+}
+
+int button_gpiod_fd(const struct button_gpiod *b)
+{
+    (void)b;
+    return -1;
+}
+
+int button_gpiod_read(struct button_gpiod *b, uint64_t *ts_ns, int max)
+{
+    (void)b;
+    (void)ts_ns;
+    (void)max;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+void button_gpiod_close(struct button_gpiod *b)
+{
+    (void)b;
+}
+
+#endif /* HAVE_LIBGPIOD */
+
+bool button_gpiod_supported(void)
+{
+#ifdef HAVE_LIBGPIOD
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// File:         button_gpiod.h
+//
+// Description:  Button input straight from a GPIO line via libgpiod v2 edge
+//               events, for boards without the gpio_button driver.
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_GPIOD_H
+#define BUTTON_GPIOD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUTTON_GPIOD_PREFIX         "gpiod:"    /* -d gpiod:CHIP:LINE */
+#define BUTTON_GPIOD_DEBOUNCE_US    50000       /* same as the driver */
+#define BUTTON_GPIOD_BATCH          16
+#define BUTTON_GPIOD_BATCH_MAX      64
+
+struct button_gpiod;
+
+/* False unless built with libgpiod: gpiod: devices can never open. */
+bool button_gpiod_supported(void);
+
+/*
+ * Request "CHIP:LINE" (after the gpiod: prefix) as an input with pull-up
+ * and falling-edge detection (the button pulls the line low), kernel debounce of debounce_us
+ * and CLOCK_MONOTONIC event timestamps. Events are drained batch at a
+ * time into a reusable buffer. NULL + errno on failure (EOPNOTSUPP when
+ * built without libgpiod).
+ */
+struct button_gpiod *button_gpiod_open(const char *spec, unsigned long debounce_us,
+                                       size_t batch);
+
+/* Pollable fd of the line request. */
+int button_gpiod_fd(const struct button_gpiod *b);
+
+/*
+ * Read pending edge events without blocking; presses (falling edges) go
+ * to ts_ns[], at most max. Returns the number of presses, 0 if only other
+ * edges were pending, or -1.
+ */
+int button_gpiod_read(struct button_gpiod *b, uint64_t *ts_ns, int max);
+
+void button_gpiod_close(struct button_gpiod *b);
+
+#endif /* BUTTON_GPIOD_H */
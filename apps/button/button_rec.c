@@ -0,0 +1,252 @@
+//-----------------------------------------------------------------------------
+// File:         button_rec.c
+//
+// Description:  Writer and loader for button event recordings.
+//
+// Notes:
+// - Only the loop thread writes. Records collect in a small buffer that
+//   is appended (O_APPEND) once per loop wakeup or when it fills up, so a
+//   burst of presses costs one write() and a crash loses at most the
+//   wakeup in progress.
+// - A write error stops recording (logged once); it never stops the app.
+//-----------------------------------------------------------------------------
+#include "button_rec.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REC_BUF_SIZE    4096
+#define REC_MAX_LEN     (1 + 3 * 10)    // tag byte + three 64-bit varints
+
+static int rec_fd = -1;
+static const char *rec_path;
+static unsigned char rec_buf[REC_BUF_SIZE];
+static size_t rec_len;
+static uint64_t rec_prev_ns;
+
+static uint64_t clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// -1 if the varint runs past end or over 64 bits.
+static int get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v)
+{
+    *v = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (*p == end)
+            return -1;
+        unsigned char b = *(*p)++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int button_rec_open(const char *path, unsigned int num_devs)
+{
+    struct button_rec_header hdr = {
+        .magic = BUTTON_REC_MAGIC,
+        .version = BUTTON_REC_VERSION,
+        .header_size = sizeof(hdr),
+        .num_devs = num_devs,
+    };
+
+    if (num_devs > BUTTON_REC_MAX_DEVS) {
+        errno = EINVAL;
+        return -1;
+    }
+    rec_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (rec_fd < 0)
+        return -1;
+    hdr.start_ns = clock_ns(CLOCK_MONOTONIC);
+    hdr.start_real_ns = clock_ns(CLOCK_REALTIME);
+    if (write_all(rec_fd, &hdr, sizeof(hdr)) < 0) {
+        int err = errno;
+        close(rec_fd);
+        rec_fd = -1;
+        errno = err;
+        return -1;
+    }
+    rec_path = path;
+    rec_prev_ns = hdr.start_ns;
+    rec_len = 0;
+    return 0;
+}
+
+void button_rec_flush(void)
+{
+    if (rec_fd < 0 || !rec_len)
+        return;
+    if (write_all(rec_fd, rec_buf, rec_len) < 0) {
+        syslog(LOG_ERR, "Recording to %s stopped: %s", rec_path, strerror(errno));
+        fprintf(stderr, "Recording to %s stopped: %s\n", rec_path, strerror(errno));
+        close(rec_fd);
+        rec_fd = -1;
+    }
+    rec_len = 0;
+}
+
+void button_rec_press(unsigned int dev, uint64_t irq_ns, uint64_t ready_ns,
+                      uint64_t t_read)
+{
+    unsigned char kind = BUTTON_REC_UNTIMED;
+
+    if (rec_fd < 0 || dev >= BUTTON_REC_MAX_DEVS)
+        return;
+    if (rec_len > REC_BUF_SIZE - REC_MAX_LEN)
+        button_rec_flush();
+    if (irq_ns && irq_ns <= t_read)
+        kind = ready_ns && irq_ns <= ready_ns && ready_ns <= t_read ? BUTTON_REC_DRIVER
+                                                                    : BUTTON_REC_EDGE;
+    // The loop reads in order, but stay encodable if a source's clock lags
+    if (t_read < rec_prev_ns)
+        t_read = rec_prev_ns;
+
+    unsigned char *p = rec_buf + rec_len;
+    *p++ = (unsigned char)(dev << 2 | kind);
+    p += put_varint(p, t_read - rec_prev_ns);
+    if (kind != BUTTON_REC_UNTIMED)
+        p += put_varint(p, t_read - irq_ns);
+    if (kind == BUTTON_REC_DRIVER)
+        p += put_varint(p, t_read - ready_ns);
+    rec_len = (size_t)(p - rec_buf);
+    rec_prev_ns = t_read;
+}
+
+void button_rec_close(void)
+{
+    if (rec_fd < 0)
+        return;
+    button_rec_flush();
+    if (rec_fd >= 0)
+        close(rec_fd);
+    rec_fd = -1;
+}
+
+int button_rec_load(const char *path, struct button_rec_header *hdr,
+                    struct button_rec_event **events, size_t *count)
+{
+    struct button_rec_event *ev = NULL;
+    unsigned char *data = NULL;
+    struct stat st;
+    size_t len = 0, n = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    if ((size_t)st.st_size < sizeof(*hdr)) {
+        errno = EPROTO;
+        goto fail;
+    }
+    data = malloc((size_t)st.st_size);
+    if (!data)
+        goto fail;
+    while (len < (size_t)st.st_size) {
+        ssize_t r = read(fd, data + len, (size_t)st.st_size - len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            goto fail;
+        if (r == 0)
+            break;
+        len += (size_t)r;
+    }
+    close(fd);
+    fd = -1;
+
+    memcpy(hdr, data, sizeof(*hdr));
+    if (len < sizeof(*hdr) || hdr->magic != BUTTON_REC_MAGIC ||
+        hdr->version != BUTTON_REC_VERSION || hdr->header_size < sizeof(*hdr) ||
+        hdr->header_size > len || hdr->num_devs > BUTTON_REC_MAX_DEVS) {
+        errno = EPROTO;
+        goto fail;
+    }
+
+    // Shortest record is two bytes
+    ev = malloc(((len - hdr->header_size) / 2 + 1) * sizeof(*ev));
+    if (!ev)
+        goto fail;
+
+    const unsigned char *p = data + hdr->header_size, *end = data + len;
+    uint64_t t = 0;
+    while (p < end) {
+        struct button_rec_event *e = &ev[n];
+        uint64_t dt;
+        unsigned char tag = *p++;
+
+        memset(e, 0, sizeof(*e));
+        e->dev = tag >> 2;
+        e->kind = tag & 3;
+        if (e->kind > BUTTON_REC_DRIVER || e->dev >= hdr->num_devs) {
+            errno = EPROTO;
+            goto fail;
+        }
+        if (get_varint(&p, end, &dt) < 0 ||
+            (e->kind != BUTTON_REC_UNTIMED && get_varint(&p, end, &e->irq_lat_ns) < 0) ||
+            (e->kind == BUTTON_REC_DRIVER && get_varint(&p, end, &e->ready_lat_ns) < 0))
+            break;  // cut short: keep what came before
+        t += dt;
+        e->t_ns = t;
+        n++;
+    }
+
+    free(data);
+    *events = ev;
+    *count = n;
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        if (fd >= 0)
+            close(fd);
+        free(data);
+        free(ev);
+        errno = err;
+    }
+    return -1;
+}
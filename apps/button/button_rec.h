@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------------------
+// File:         button_rec.h
+//
+// Description:  Compact binary recording of received button events.
+//
+// Notes:
+// - `button --record FILE` appends every press as the app received it;
+//   `button --replay FILE` pushes a recording back through the loop,
+//   actions, LED and latency histograms, in real time or faster.
+// - File: struct button_rec_header, then variable-length records:
+//     u8      dev << 2 | kind
+//     varint  t_read - previous t_read (the first one: - header start_ns)
+//     varint  t_read - irq_ns          (kind EDGE or DRIVER)
+//     varint  t_read - ready_ns        (kind DRIVER)
+//   Varints are LEB128 (7 bits per byte, low first). A press costs about
+//   10 bytes; a record cut short by a crash is ignored on load.
+// - Timestamps are CLOCK_MONOTONIC ns of the recording host; replay keeps
+//   the gaps and the latencies at receipt, not the absolute times.
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_REC_H
+#define BUTTON_REC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUTTON_REC_MAGIC    0x43455242u     /* "BREC" */
+#define BUTTON_REC_VERSION  1
+#define BUTTON_REC_MAX_DEVS 64              /* dev field is 6 bits */
+
+enum button_rec_kind {
+    BUTTON_REC_UNTIMED,     // no kernel timestamps (legacy driver)
+    BUTTON_REC_EDGE,        // IRQ time only (gpiod edge events)
+    BUTTON_REC_DRIVER,      // IRQ and debounce-confirmed times
+};
+
+struct button_rec_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;   // sizeof(struct button_rec_header)
+    uint32_t num_devs;
+    uint32_t reserved;
+    uint64_t start_ns;      // CLOCK_MONOTONIC base of the first delta
+    uint64_t start_real_ns; // CLOCK_REALTIME at the same moment, for logs
+};
+
+/* One decoded record; times relative to the header's start_ns. */
+struct button_rec_event {
+    uint64_t t_ns;          // read() returned
+    uint64_t irq_lat_ns;    // t_read - irq_ns, 0 unless EDGE/DRIVER
+    uint64_t ready_lat_ns;  // t_read - ready_ns, 0 unless DRIVER
+    uint8_t dev;
+    uint8_t kind;           // enum button_rec_kind
+};
+
+/*
+ * Writer (the app's loop thread). button_rec_press() only encodes into a
+ * buffer; button_rec_flush() appends it with one write(), so the loop
+ * calls it once per wakeup. All calls are no-ops until open succeeded.
+ */
+int button_rec_open(const char *path, unsigned int num_devs);
+void button_rec_press(unsigned int dev, uint64_t irq_ns, uint64_t ready_ns,
+                      uint64_t t_read);
+void button_rec_flush(void);
+void button_rec_close(void);
+
+/*
+ * Load and decode a whole recording. On success *events is malloc()ed
+ * (free() it) and 0 is returned; -1 with errno otherwise (EPROTO for a
+ * file that is not a recording).
+ */
+int button_rec_load(const char *path, struct button_rec_header *hdr,
+                    struct button_rec_event **events, size_t *count);
+
+#endif /* BUTTON_REC_H */
@@ -0,0 +1,183 @@
+//-----------------------------------------------------------------------------
+// File:         button_shm.c
+//
+// Description:  Publisher side of the shared-memory button state.
+//
+// Notes:
+// - Only the event loop thread writes, so the seqlock needs no RMW: make
+//   seq odd, release fence, relaxed field stores, release store of the
+//   next even seq.
+// - The segment is created 0644 and left in place at exit with live = 0,
+//   so readers keep the last state instead of losing the mapping.
+//-----------------------------------------------------------------------------
+#include "button_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STORE(field, val) atomic_store_explicit(&(field), (val), memory_order_relaxed)
+
+_Static_assert(sizeof(struct button_shm_dev) == 64, "button_shm_dev: one cache line");
+
+static struct button_shm *shm;
+
+static void seq_write_begin(_Atomic uint32_t *seq)
+{
+    // | 1 rather than + 1: a writer killed mid-update leaves seq odd, and
+    // the segment is reused, so parity must not depend on the previous run
+    STORE(*seq, BUTTON_SHM_LOAD(*seq) | 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void seq_write_end(_Atomic uint32_t *seq)
+{
+    atomic_store_explicit(seq, BUTTON_SHM_LOAD(*seq) + 1, memory_order_release);
+}
+
+int button_shm_open(const char *name, unsigned int num_devs, const char *const *paths,
+                    int led_state)
+{
+    struct timespec ts;
+    struct button_shm *m;
+    int fd;
+
+    if (num_devs > BUTTON_SHM_MAX_DEVS) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    // shm_open() applies the umask; readers need 0644 regardless
+    fchmod(fd, 0644);
+    if (ftruncate(fd, sizeof(*m)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    m = mmap(NULL, sizeof(*m), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return -1;
+
+    // A restart keeps counters meaningful only for the new run: start over,
+    // but through the seqlocks, since old readers may be sampling already
+    STORE(m->live, 0);
+    for (unsigned int i = 0; i < BUTTON_SHM_MAX_DEVS; i++) {
+        struct button_shm_dev *d = &m->dev[i];
+        seq_write_begin(&d->seq);
+        STORE(d->present, 0);
+        STORE(d->presses, 0);
+        STORE(d->doubles, 0);
+        STORE(d->last_press_ns, 0);
+        memset(d->path, 0, sizeof(d->path));
+        if (i < num_devs)
+            snprintf(d->path, sizeof(d->path), "%s", paths[i]);
+        seq_write_end(&d->seq);
+    }
+    seq_write_begin(&m->led.seq);
+    STORE(m->led.state, led_state);
+    STORE(m->led.changes, 0);
+    STORE(m->led.last_change_ns, 0);
+    seq_write_end(&m->led.seq);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    m->magic = BUTTON_SHM_MAGIC;
+    m->version = BUTTON_SHM_VERSION;
+    m->dev_size = sizeof(struct button_shm_dev);
+    m->num_devs = num_devs;
+    m->pid = (int32_t)getpid();
+    m->start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    atomic_store_explicit(&m->live, 1, memory_order_release);
+    shm = m;
+    return 0;
+}
+
+void button_shm_present(unsigned int i, bool present)
+{
+    if (!shm || i >= BUTTON_SHM_MAX_DEVS)
+        return;
+    seq_write_begin(&shm->dev[i].seq);
+    STORE(shm->dev[i].present, present);
+    seq_write_end(&shm->dev[i].seq);
+}
+
+void button_shm_press(unsigned int i, uint64_t ts_ns, bool dbl)
+{
+    struct button_shm_dev *d;
+
+    if (!shm || i >= BUTTON_SHM_MAX_DEVS)
+        return;
+    d = &shm->dev[i];
+    seq_write_begin(&d->seq);
+    STORE(d->presses, BUTTON_SHM_LOAD(d->presses) + 1);
+    if (dbl)
+        STORE(d->doubles, BUTTON_SHM_LOAD(d->doubles) + 1);
+    STORE(d->last_press_ns, ts_ns);
+    seq_write_end(&d->seq);
+}
+
+void button_shm_resume(unsigned int i, uint64_t presses, uint64_t last_press_ns)
+{
+    if (!shm || i >= BUTTON_SHM_MAX_DEVS)
+        return;
+    seq_write_begin(&shm->dev[i].seq);
+    STORE(shm->dev[i].presses, presses);
+    STORE(shm->dev[i].last_press_ns, last_press_ns);
+    seq_write_end(&shm->dev[i].seq);
+}
+
+void button_shm_led(int state, uint64_t ts_ns)
+{
+    if (!shm)
+        return;
+    seq_write_begin(&shm->led.seq);
+    STORE(shm->led.state, state);
+    STORE(shm->led.changes, BUTTON_SHM_LOAD(shm->led.changes) + 1);
+    STORE(shm->led.last_change_ns, ts_ns);
+    seq_write_end(&shm->led.seq);
+}
+
+void button_shm_close(void)
+{
+    if (!shm)
+        return;
+    for (unsigned int i = 0; i < shm->num_devs; i++)
+        button_shm_present(i, false);
+    atomic_store_explicit(&shm->live, 0, memory_order_release);
+    munmap(shm, sizeof(*shm));
+    shm = NULL;
+}
+
+struct button_shm *button_shm_attach(const char *name)
+{
+    struct button_shm *m;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*m)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    m = mmap(NULL, sizeof(*m), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return NULL;
+    if (m->magic != BUTTON_SHM_MAGIC || m->version != BUTTON_SHM_VERSION ||
+        m->dev_size != sizeof(struct button_shm_dev) || m->num_devs > BUTTON_SHM_MAX_DEVS) {
+        munmap(m, sizeof(*m));
+        errno = EPROTO;
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,149 @@
+//-----------------------------------------------------------------------------
+// File:         button_shm.h
+//
+// Description:  Shared-memory button state published by the button app.
+//
+// Notes:
+// - The app keeps /dev/shm/button (shm_open name "/button" by default, -M)
+//   up to date; any number of local processes mmap it read-only and sample
+//   it with the inline readers below: no syscalls, no locks, and nothing
+//   they do can stall the event loop.
+// - Each button slot and the LED block is a seqlock: the single writer
+//   makes seq odd, updates the fields and makes it even again; a reader
+//   retries if seq was odd or moved under it. Slots are cache-line sized
+//   so a busy button does not make readers of another retry. A seq that
+//   stays odd (app killed mid-update) makes readers give up with EBUSY
+//   after BUTTON_SHM_SPIN_MAX loads instead of spinning forever.
+// - All timestamps are CLOCK_MONOTONIC ns; a press is stamped with the
+//   kernel IRQ time when the input path provides one. The sources only
+//   report presses (not releases), so "pressed now" is not published.
+// - Layout changes bump BUTTON_SHM_VERSION; readers check magic, version
+//   and dev_size before trusting anything else.
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_SHM_H
+#define BUTTON_SHM_H
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BUTTON_SHM_NAME     "/button"
+#define BUTTON_SHM_MAGIC    0x314e5442u     /* "BTN1" */
+#define BUTTON_SHM_VERSION  1
+#define BUTTON_SHM_MAX_DEVS 16
+#define BUTTON_SHM_PATH_LEN 32
+#define BUTTON_SHM_SPIN_MAX 100000      /* odd seq loads before EBUSY */
+
+struct button_shm_dev {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t present;           /* device open right now */
+    _Atomic uint64_t presses;
+    _Atomic uint64_t doubles;
+    _Atomic uint64_t last_press_ns;
+    char path[BUTTON_SHM_PATH_LEN];     /* -d argument, set at start */
+} __attribute__((aligned(64)));
+
+struct button_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dev_size;                  /* sizeof(struct button_shm_dev) */
+    uint32_t num_devs;
+    _Atomic uint32_t live;              /* 0 once the app has exited */
+    int32_t pid;
+    uint64_t start_ns;
+
+    struct {
+        _Atomic uint32_t seq;
+        _Atomic int32_t state;          /* logical LED value */
+        _Atomic uint64_t changes;
+        _Atomic uint64_t last_change_ns;
+    } led __attribute__((aligned(64)));
+
+    struct button_shm_dev dev[BUTTON_SHM_MAX_DEVS];
+};
+
+/* Plain copies the readers fill in. */
+struct button_shm_dev_snap {
+    bool present;
+    uint64_t presses;
+    uint64_t doubles;
+    uint64_t last_press_ns;
+};
+
+struct button_shm_led_snap {
+    int state;
+    uint64_t changes;
+    uint64_t last_change_ns;
+};
+
+#define BUTTON_SHM_LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+
+/* false (errno EBUSY) if seq stayed odd: the writer died mid-update. */
+static inline bool button_shm_seq_begin(_Atomic uint32_t *seq, uint32_t *s)
+{
+    for (unsigned int i = 0; i < BUTTON_SHM_SPIN_MAX; i++) {
+        *s = atomic_load_explicit(seq, memory_order_acquire);
+        if (!(*s & 1))
+            return true;
+    }
+    errno = EBUSY;
+    return false;
+}
+
+static inline bool button_shm_seq_retry(_Atomic uint32_t *seq, uint32_t s)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(seq, memory_order_relaxed) != s;
+}
+
+/* Consistent snapshot of button i (i < m->num_devs). 0, or -1 with errno EBUSY. */
+static inline int button_shm_read_dev(struct button_shm *m, unsigned int i,
+                                       struct button_shm_dev_snap *out)
+{
+    struct button_shm_dev *d = &m->dev[i];
+    uint32_t s;
+
+    do {
+        if (!button_shm_seq_begin(&d->seq, &s))
+            return -1;
+        out->present = BUTTON_SHM_LOAD(d->present) != 0;
+        out->presses = BUTTON_SHM_LOAD(d->presses);
+        out->doubles = BUTTON_SHM_LOAD(d->doubles);
+        out->last_press_ns = BUTTON_SHM_LOAD(d->last_press_ns);
+    } while (button_shm_seq_retry(&d->seq, s));
+    return 0;
+}
+
+static inline int button_shm_read_led(struct button_shm *m,
+                                       struct button_shm_led_snap *out)
+{
+    uint32_t s;
+
+    do {
+        if (!button_shm_seq_begin(&m->led.seq, &s))
+            return -1;
+        out->state = BUTTON_SHM_LOAD(m->led.state);
+        out->changes = BUTTON_SHM_LOAD(m->led.changes);
+        out->last_change_ns = BUTTON_SHM_LOAD(m->led.last_change_ns);
+    } while (button_shm_seq_retry(&m->led.seq, s));
+    return 0;
+}
+
+/*
+ * Publisher side (button_shm.c, used by the app only). All calls are
+ * no-ops until button_shm_open() has succeeded.
+ */
+int button_shm_open(const char *name, unsigned int num_devs, const char *const *paths,
+                    int led_state);
+void button_shm_present(unsigned int i, bool present);
+void button_shm_press(unsigned int i, uint64_t ts_ns, bool dbl);
+/* Counters carried over from a previous run (FD store resume). */
+void button_shm_resume(unsigned int i, uint64_t presses, uint64_t last_press_ns);
+void button_shm_led(int state, uint64_t ts_ns);
+void button_shm_close(void);
+
+/* Map an existing segment read-only for sampling; NULL + errno. */
+struct button_shm *button_shm_attach(const char *name);
+
+#endif /* BUTTON_SHM_H */
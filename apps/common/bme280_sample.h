@@ -0,0 +1,29 @@
+//-----------------------------------------------------------------------------
+// File:         bme280_sample.h
+//
+// Description:  BME280 sample as decoded by bme280d and read_bme280.
+//
+// Notes:
+// - Integer fixed-point units, converted once from IIO's (milli °C,
+//   milli %RH, kPa) so consumers never touch scale attributes.
+// - ts_ns is the kernel's scan timestamp on CLOCK_MONOTONIC (the daemon
+//   sets current_timestamp_clock), comparable with clock_gettime().
+//-----------------------------------------------------------------------------
+#ifndef BME280_SAMPLE_H
+#define BME280_SAMPLE_H
+
+#include <stdint.h>
+
+#define BME280_HAVE_TEMP        (1u << 0)
+#define BME280_HAVE_HUMIDITY    (1u << 1)
+#define BME280_HAVE_PRESSURE    (1u << 2)
+
+struct bme280_sample {
+    uint64_t ts_ns;         // CLOCK_MONOTONIC, 0 if the scan had no timestamp
+    int32_t temp_mdegc;     // 0.001 °C
+    uint32_t humidity_mpct; // 0.001 %RH
+    uint32_t pressure_mpa;  // 0.001 Pa
+    uint32_t have;          // BME280_HAVE_*
+};
+
+#endif /* BME280_SAMPLE_H */
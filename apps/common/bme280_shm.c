@@ -0,0 +1,276 @@
+//-----------------------------------------------------------------------------
+// File:         bme280_shm.c
+//
+// Description:  Publisher side of the bme280d latest-sample cache.
+//
+// Notes:
+// - Only the daemon's loop writes, so the seqlocks need no RMW (same
+//   scheme as button_shm.c).
+// - Rolling stats come from a private ring of the samples inside the
+//   window: sums make the mean O(1); min/max are only rescanned when the
+//   sample falling out of the window was the min or the max.
+// - The segment is created 0644 and left in place at exit with live = 0.
+//-----------------------------------------------------------------------------
+#include "bme280_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE(field, val) atomic_store_explicit(&(field), (val), memory_order_relaxed)
+
+#define WINDOW_MAX      65536       /* samples kept for the rolling stats */
+
+enum { Q_TEMP, Q_HUMIDITY, Q_PRESSURE, Q_COUNT };
+
+struct window {
+    int64_t (*val)[Q_COUNT];
+    uint64_t *ts;
+    unsigned int cap, head, count;  // oldest at head
+    int64_t sum[Q_COUNT];
+    int64_t min[Q_COUNT], max[Q_COUNT];
+    bool rescan;
+};
+
+static struct bme280_shm *shm;
+static struct window win;
+static struct bme280_sample latest;
+static uint64_t samples, missed;
+static bool dirty;
+
+static void seq_write_begin(_Atomic uint32_t *seq)
+{
+    // | 1 rather than + 1: a daemon killed mid-update leaves seq odd in the
+    // reused segment, and the next run must not invert the parity
+    STORE(*seq, BME280_SHM_LOAD(*seq) | 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void seq_write_end(_Atomic uint32_t *seq)
+{
+    atomic_store_explicit(seq, BME280_SHM_LOAD(*seq) + 1, memory_order_release);
+}
+
+int bme280_shm_open(const char *name, uint64_t period_ns, uint64_t stale_ns,
+                    uint64_t window_ns)
+{
+    struct timespec ts;
+    struct bme280_shm *m;
+    uint64_t cap = period_ns ? window_ns / period_ns + 1 : WINDOW_MAX;
+    int fd;
+
+    win.cap = cap > WINDOW_MAX ? WINDOW_MAX : (unsigned int)cap;
+    win.val = calloc(win.cap, sizeof(*win.val));
+    win.ts = calloc(win.cap, sizeof(*win.ts));
+    if (!win.val || !win.ts)
+        goto fail;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        goto fail;
+    // shm_open() applies the umask; readers need 0644 regardless
+    fchmod(fd, 0644);
+    if (ftruncate(fd, sizeof(*m)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        goto fail;
+    }
+    m = mmap(NULL, sizeof(*m), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        goto fail;
+
+    // Old readers may still be sampling: reset through the seqlocks
+    STORE(m->live, 0);
+    seq_write_begin(&m->latest.seq);
+    STORE(m->latest.have, 0);
+    STORE(m->latest.ts_ns, 0);
+    STORE(m->latest.samples, 0);
+    seq_write_end(&m->latest.seq);
+    seq_write_begin(&m->stats.seq);
+    STORE(m->stats.count, 0);
+    STORE(m->stats.missed, 0);
+    seq_write_end(&m->stats.seq);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    m->magic = BME280_SHM_MAGIC;
+    m->version = BME280_SHM_VERSION;
+    m->size = sizeof(*m);
+    m->pid = (int32_t)getpid();
+    m->start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    m->period_ns = period_ns;
+    m->stale_ns = stale_ns;
+    m->window_ns = window_ns;
+    atomic_store_explicit(&m->live, 1, memory_order_release);
+    shm = m;
+    return 0;
+
+fail: {
+        int err = errno;
+        free(win.val);
+        free(win.ts);
+        memset(&win, 0, sizeof(win));
+        errno = err;
+        return -1;
+    }
+}
+
+static void window_values(const struct bme280_sample *s, int64_t v[Q_COUNT])
+{
+    v[Q_TEMP] = s->temp_mdegc;
+    v[Q_HUMIDITY] = s->humidity_mpct;
+    v[Q_PRESSURE] = s->pressure_mpa;
+}
+
+static void window_drop_oldest(void)
+{
+    const int64_t *v = win.val[win.head];
+
+    for (int q = 0; q < Q_COUNT; q++) {
+        win.sum[q] -= v[q];
+        if (v[q] == win.min[q] || v[q] == win.max[q])
+            win.rescan = true;
+    }
+    win.head = (win.head + 1) % win.cap;
+    win.count--;
+}
+
+static void window_rescan(void)
+{
+    for (int q = 0; q < Q_COUNT; q++) {
+        win.min[q] = INT64_MAX;
+        win.max[q] = INT64_MIN;
+    }
+    for (unsigned int i = 0, k = win.head; i < win.count; i++, k = (k + 1) % win.cap) {
+        for (int q = 0; q < Q_COUNT; q++) {
+            if (win.val[k][q] < win.min[q])
+                win.min[q] = win.val[k][q];
+            if (win.val[k][q] > win.max[q])
+                win.max[q] = win.val[k][q];
+        }
+    }
+    win.rescan = false;
+}
+
+void bme280_shm_sample(const struct bme280_sample *s)
+{
+    int64_t v[Q_COUNT];
+    unsigned int tail;
+
+    if (!shm)
+        return;
+    latest = *s;
+    samples++;
+    dirty = true;
+
+    // Drop what fell out of the window (by time when scans are stamped)
+    while (win.count == win.cap ||
+           (win.count && s->ts_ns && win.ts[win.head] + shm->window_ns < s->ts_ns))
+        window_drop_oldest();
+    if (!win.count) {
+        for (int q = 0; q < Q_COUNT; q++) {
+            win.min[q] = INT64_MAX;
+            win.max[q] = INT64_MIN;
+        }
+        win.rescan = false;
+    }
+
+    window_values(s, v);
+    tail = (win.head + win.count) % win.cap;
+    memcpy(win.val[tail], v, sizeof(v));
+    win.ts[tail] = s->ts_ns;
+    win.count++;
+    for (int q = 0; q < Q_COUNT; q++) {
+        win.sum[q] += v[q];
+        if (v[q] < win.min[q])
+            win.min[q] = v[q];
+        if (v[q] > win.max[q])
+            win.max[q] = v[q];
+    }
+}
+
+void bme280_shm_missed(uint64_t n)
+{
+    missed += n;
+    dirty = true;
+}
+
+static void store_stat(struct bme280_shm_stat *st, int q)
+{
+    int64_t n = win.count;
+
+    STORE(st->min, win.min[q]);
+    STORE(st->max, win.max[q]);
+    STORE(st->mean, win.sum[q] >= 0 ? (win.sum[q] + n / 2) / n : -((-win.sum[q] + n / 2) / n));
+}
+
+void bme280_shm_flush(void)
+{
+    if (!shm || !dirty)
+        return;
+    dirty = false;
+
+    seq_write_begin(&shm->latest.seq);
+    STORE(shm->latest.have, latest.have);
+    STORE(shm->latest.ts_ns, latest.ts_ns);
+    STORE(shm->latest.temp_mdegc, latest.temp_mdegc);
+    STORE(shm->latest.humidity_mpct, latest.humidity_mpct);
+    STORE(shm->latest.pressure_mpa, latest.pressure_mpa);
+    STORE(shm->latest.samples, samples);
+    seq_write_end(&shm->latest.seq);
+
+    if (win.rescan)
+        window_rescan();
+    seq_write_begin(&shm->stats.seq);
+    STORE(shm->stats.count, win.count);
+    STORE(shm->stats.missed, missed);
+    if (win.count) {
+        store_stat(&shm->stats.temp, Q_TEMP);
+        store_stat(&shm->stats.humidity, Q_HUMIDITY);
+        store_stat(&shm->stats.pressure, Q_PRESSURE);
+    }
+    seq_write_end(&shm->stats.seq);
+}
+
+void bme280_shm_close(void)
+{
+    if (!shm)
+        return;
+    atomic_store_explicit(&shm->live, 0, memory_order_release);
+    munmap(shm, sizeof(*shm));
+    shm = NULL;
+    free(win.val);
+    free(win.ts);
+    memset(&win, 0, sizeof(win));
+}
+
+struct bme280_shm *bme280_shm_attach(const char *name)
+{
+    struct bme280_shm *m;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*m)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    m = mmap(NULL, sizeof(*m), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return NULL;
+    if (m->magic != BME280_SHM_MAGIC || m->version != BME280_SHM_VERSION ||
+        m->size != sizeof(*m)) {
+        munmap(m, sizeof(*m));
+        errno = EPROTO;
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,205 @@
+//-----------------------------------------------------------------------------
+// File:         bme280_shm.h
+//
+// Description:  Shared-memory latest-sample cache published by bme280d.
+//
+// Notes:
+// - bme280d keeps /dev/shm/bme280 (shm_open name "/bme280" by default, -M)
+//   up to date with the newest sample and rolling statistics over the last
+//   window_ns. Readers mmap it read-only and sample it with the inline
+//   readers below: no syscalls and no I2C traffic, however many there are.
+// - While bme280d has the buffer enabled the driver refuses sysfs reads
+//   (EBUSY), so this segment is the way to get a value at all.
+// - The latest sample and the stats are separate seqlocks (single writer:
+//   seq odd while updating; readers retry if it was odd or moved). Both
+//   are updated once per buffer read, not per scan. A seq that stays odd
+//   (daemon killed mid-update) makes readers give up with EBUSY after
+//   BME280_SHM_SPIN_MAX loads instead of spinning forever.
+// - stale_ns is how old the latest sample may get in normal operation
+//   (watermark + 1 periods plus slack); bme280_shm_get() treats anything
+//   older, or a segment whose daemon has exited, as ESTALE.
+// - Layout changes bump BME280_SHM_VERSION; readers check magic, version
+//   and size before trusting anything else.
+//-----------------------------------------------------------------------------
+#ifndef BME280_SHM_H
+#define BME280_SHM_H
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bme280_sample.h"
+
+#define BME280_SHM_NAME     "/bme280"
+#define BME280_SHM_MAGIC    0x31454d42u     /* "BME1" */
+#define BME280_SHM_VERSION  1
+#define BME280_SHM_SPIN_MAX 100000      /* odd seq loads before EBUSY */
+
+/* Rolling min/mean/max of one quantity, in bme280_sample units. */
+struct bme280_shm_stat {
+    _Atomic int64_t min;
+    _Atomic int64_t mean;
+    _Atomic int64_t max;
+};
+
+struct bme280_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      /* sizeof(struct bme280_shm) */
+    _Atomic uint32_t live;              /* 0 once the daemon has exited */
+    int32_t pid;
+    uint32_t pad;
+    uint64_t start_ns;
+    uint64_t period_ns;                 /* sampling period */
+    uint64_t stale_ns;                  /* see Notes */
+    uint64_t window_ns;                 /* span of the rolling stats */
+
+    struct {
+        _Atomic uint32_t seq;
+        _Atomic uint32_t have;          /* BME280_HAVE_* */
+        _Atomic uint64_t ts_ns;         /* CLOCK_MONOTONIC */
+        _Atomic int32_t temp_mdegc;
+        _Atomic uint32_t humidity_mpct;
+        _Atomic uint32_t pressure_mpa;
+        _Atomic uint64_t samples;       /* total since start */
+    } latest __attribute__((aligned(64)));
+
+    struct {
+        _Atomic uint32_t seq;
+        _Atomic uint32_t count;         /* samples in the window */
+        _Atomic uint64_t missed;        /* scans lost since start */
+        struct bme280_shm_stat temp;
+        struct bme280_shm_stat humidity;
+        struct bme280_shm_stat pressure;
+    } stats __attribute__((aligned(64)));
+};
+
+/* Plain copy of the stats block. */
+struct bme280_shm_stats {
+    uint32_t count;
+    uint64_t missed;
+    int64_t temp[3];                    /* min, mean, max */
+    int64_t humidity[3];
+    int64_t pressure[3];
+};
+
+#define BME280_SHM_LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+
+/* false (errno EBUSY) if seq stayed odd: the writer died mid-update. */
+static inline bool bme280_shm_seq_begin(_Atomic uint32_t *seq, uint32_t *s)
+{
+    for (unsigned int i = 0; i < BME280_SHM_SPIN_MAX; i++) {
+        *s = atomic_load_explicit(seq, memory_order_acquire);
+        if (!(*s & 1))
+            return true;
+    }
+    errno = EBUSY;
+    return false;
+}
+
+static inline bool bme280_shm_seq_retry(_Atomic uint32_t *seq, uint32_t s)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(seq, memory_order_relaxed) != s;
+}
+
+/*
+ * Consistent copy of the latest sample and the sample count (0: none yet)
+ * into *samples. 0, or -1 with errno EBUSY.
+ */
+static inline int bme280_shm_read_latest(struct bme280_shm *m, struct bme280_sample *out,
+                                         uint64_t *samples)
+{
+    uint64_t n;
+    uint32_t s;
+
+    do {
+        if (!bme280_shm_seq_begin(&m->latest.seq, &s))
+            return -1;
+        out->have = BME280_SHM_LOAD(m->latest.have);
+        out->ts_ns = BME280_SHM_LOAD(m->latest.ts_ns);
+        out->temp_mdegc = BME280_SHM_LOAD(m->latest.temp_mdegc);
+        out->humidity_mpct = BME280_SHM_LOAD(m->latest.humidity_mpct);
+        out->pressure_mpa = BME280_SHM_LOAD(m->latest.pressure_mpa);
+        n = BME280_SHM_LOAD(m->latest.samples);
+    } while (bme280_shm_seq_retry(&m->latest.seq, s));
+    *samples = n;
+    return 0;
+}
+
+static inline void bme280_shm_stat_load(struct bme280_shm_stat *st, int64_t out[3])
+{
+    out[0] = BME280_SHM_LOAD(st->min);
+    out[1] = BME280_SHM_LOAD(st->mean);
+    out[2] = BME280_SHM_LOAD(st->max);
+}
+
+/* 0, or -1 with errno EBUSY. */
+static inline int bme280_shm_read_stats(struct bme280_shm *m, struct bme280_shm_stats *out)
+{
+    uint32_t s;
+
+    do {
+        if (!bme280_shm_seq_begin(&m->stats.seq, &s))
+            return -1;
+        out->count = BME280_SHM_LOAD(m->stats.count);
+        out->missed = BME280_SHM_LOAD(m->stats.missed);
+        bme280_shm_stat_load(&m->stats.temp, out->temp);
+        bme280_shm_stat_load(&m->stats.humidity, out->humidity);
+        bme280_shm_stat_load(&m->stats.pressure, out->pressure);
+    } while (bme280_shm_seq_retry(&m->stats.seq, s));
+    return 0;
+}
+
+/*
+ * The latest sample if the daemon is running and it is no older than
+ * max_age_ns (0: the segment's stale_ns). 0, or -1 with errno ESTALE
+ * (old, or daemon gone), ENODATA (nothing published yet) or EBUSY (stuck
+ * seqlock).
+ */
+static inline int bme280_shm_get(struct bme280_shm *m, uint64_t max_age_ns,
+                                 struct bme280_sample *out)
+{
+    struct timespec ts;
+    uint64_t now, samples;
+
+    if (!atomic_load_explicit(&m->live, memory_order_acquire)) {
+        errno = ESTALE;
+        return -1;
+    }
+    if (bme280_shm_read_latest(m, out, &samples) < 0)
+        return -1;
+    if (!samples) {
+        errno = ENODATA;
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    if (!max_age_ns)
+        max_age_ns = m->stale_ns;
+    if (out->ts_ns && now > out->ts_ns && now - out->ts_ns > max_age_ns) {
+        errno = ESTALE;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Publisher side (bme280_shm.c, used by bme280d only). All calls are
+ * no-ops until bme280_shm_open() has succeeded. bme280_shm_sample() only
+ * accumulates; bme280_shm_flush() publishes the newest sample and the
+ * stats.
+ */
+int bme280_shm_open(const char *name, uint64_t period_ns, uint64_t stale_ns,
+                    uint64_t window_ns);
+void bme280_shm_sample(const struct bme280_sample *s);
+void bme280_shm_missed(uint64_t n);
+void bme280_shm_flush(void);
+void bme280_shm_close(void);
+
+/* Map an existing segment read-only for sampling; NULL + errno. */
+struct bme280_shm *bme280_shm_attach(const char *name);
+
+#endif /* BME280_SHM_H */
@@ -0,0 +1,47 @@
+//-----------------------------------------------------------------------------
+// File:         button_bus_wire.h
+//
+// Description:  Button event broker wire format, shared by the button app
+//               and its subscribers (tsq, bme280d).
+//
+// Notes:
+// - Clients connect to a SOCK_SEQPACKET Unix socket (/run/button.bus by
+//   default, button -P). Each message from the app is one struct
+//   button_bus_event; a client may send a struct button_bus_sub at any
+//   time to change its filter (the default is everything).
+// - seq numbers every event the app publishes, so a filtered subscriber
+//   sees gaps by design.
+// - Records use host byte order: the bus is local by construction.
+//-----------------------------------------------------------------------------
+#ifndef BUTTON_BUS_WIRE_H
+#define BUTTON_BUS_WIRE_H
+
+#include <stdint.h>
+
+#define BUTTON_BUS_PATH         "/run/button.bus"
+#define BUTTON_BUS_MAGIC        0x53554242u     /* "BBUS" */
+
+enum button_bus_type {
+    BUTTON_BUS_PRESS,       // value = press count on that device
+    BUTTON_BUS_DOUBLE,      // value = press count on that device
+    BUTTON_BUS_LED,         // value = new LED state, dev = pressing device
+    BUTTON_BUS_DEVICE,      // value = 1 opened, 0 gone
+    BUTTON_BUS_TYPES,
+};
+
+struct button_bus_event {
+    uint64_t seq;
+    uint64_t ts_ns;         // CLOCK_MONOTONIC, kernel IRQ time if known
+    uint32_t type;          // enum button_bus_type
+    uint32_t dev;           // -d index
+    int64_t value;
+};
+
+struct button_bus_sub {
+    uint32_t magic;         // BUTTON_BUS_MAGIC
+    uint32_t types;         // bit per enum button_bus_type, 0 = all
+    uint32_t devs;          // bit per device index, 0 = all
+    uint32_t reserved;
+};
+
+#endif /* BUTTON_BUS_WIRE_H */
@@ -0,0 +1,69 @@
+//-----------------------------------------------------------------------------
+// File:         clock_src.c
+//
+// Description:  Real (CLOCK_MONOTONIC) and virtual time sources.
+//-----------------------------------------------------------------------------
+#include "clock_src.h"
+
+#include <errno.h>
+#include <time.h>
+
+#define NSEC_PER_SEC    1000000000LL
+
+static int64_t mono_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * The kernel sleep is aimed CLOCK_SPIN_NS early and the remainder is burnt
+ * in a busy-wait, which hides most of the hrtimer wakeup latency.
+ */
+static void mono_sleep_until(int64_t deadline)
+{
+    int64_t wake = deadline - CLOCK_SPIN_NS;
+
+    if (wake > mono_now()) {
+        struct timespec ts;
+        ts.tv_sec = wake / NSEC_PER_SEC;
+        ts.tv_nsec = wake % NSEC_PER_SEC;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+            /* resume */
+        }
+    }
+    while (mono_now() < deadline) {
+        /* spin */
+    }
+}
+
+const struct clock_src clock_src_mono = {
+    .name        = "monotonic",
+    .now         = mono_now,
+    .sleep_until = mono_sleep_until,
+};
+
+static int64_t virtual_ns;
+
+static int64_t virtual_now(void)
+{
+    return virtual_ns;
+}
+
+static void virtual_sleep_until(int64_t deadline)
+{
+    if (deadline > virtual_ns)
+        virtual_ns = deadline;
+}
+
+void clock_virtual_set(int64_t ns)
+{
+    virtual_ns = ns;
+}
+
+const struct clock_src clock_src_virtual = {
+    .name        = "virtual",
+    .now         = virtual_now,
+    .sleep_until = virtual_sleep_until,
+};
@@ -0,0 +1,33 @@
+//-----------------------------------------------------------------------------
+// File:         clock_src.h
+//
+// Description:  Injectable time source: "now" and "sleep until" for the
+//               timing loops.
+//
+// Notes:
+// - clock_src_mono is the real thing: CLOCK_MONOTONIC, absolute-deadline
+//   clock_nanosleep() aimed CLOCK_SPIN_NS early, then a busy-wait tail.
+// - clock_src_virtual never sleeps: sleep_until() just moves virtual time
+//   to the deadline, so hours of schedule run in milliseconds and every
+//   edge lands exactly on time. Single-threaded use only.
+//-----------------------------------------------------------------------------
+#ifndef CLOCK_SRC_H
+#define CLOCK_SRC_H
+
+#include <stdint.h>
+
+#define CLOCK_SPIN_NS   50000LL     /* busy-wait the last 50us before a deadline */
+
+struct clock_src {
+    const char *name;
+    int64_t (*now)(void);                   /* ns */
+    void (*sleep_until)(int64_t deadline);  /* absolute, same scale as now() */
+};
+
+extern const struct clock_src clock_src_mono;
+extern const struct clock_src clock_src_virtual;
+
+/* Set virtual time (ns). It only moves forward on sleep_until() or here. */
+void clock_virtual_set(int64_t ns);
+
+#endif /* CLOCK_SRC_H */
@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_backend.c
+//
+// Description:  Backend registry and helpers, plus the mock backend.
+//-----------------------------------------------------------------------------
+#include "gpio_backend.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const struct gpio_backend *const gpio_backends[] = {
+#ifdef HAVE_LIBGPIOD
+    &gpio_backend_gpiod,
+#endif
+    &gpio_backend_cdev,
+    &gpio_backend_gpiobtn,
+    &gpio_backend_mock,
+    NULL,
+};
+
+const struct gpio_backend *gpio_backend_find(const char *name)
+{
+    for (int i = 0; gpio_backends[i]; i++)
+        if (!strcmp(gpio_backends[i]->name, name))
+            return gpio_backends[i];
+    return NULL;
+}
+
+int gpio_req_index(const struct gpio_req *r, unsigned int offset)
+{
+    for (int i = 0; i < r->n; i++)
+        if (r->offsets[i] == offset)
+            return i;
+    return -1;
+}
+
+const char *gpio_chip_path(const char *chip, char *buf, unsigned long len)
+{
+    if (strchr(chip, '/'))
+        return chip;
+    snprintf(buf, len, "/dev/%s", chip);
+    return buf;
+}
+
+/* ---- mock ---- */
+
+static gpio_mock_hook mock_hook;
+static void *mock_hook_ctx;
+
+struct mock_req {
+    struct gpio_req base;
+    int val[GPIO_REQ_MAX_LINES];
+    bool output;
+    bool active_low;
+    uint64_t writes;
+};
+
+static struct gpio_req *mock_request(const char *chip, const unsigned int *offsets,
+                                     int n, const int *values, bool active_low,
+                                     const char *consumer)
+{
+    (void)chip;
+    (void)consumer;
+
+    if (n < 1 || n > GPIO_REQ_MAX_LINES) {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct mock_req *m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+    m->base.be = &gpio_backend_mock;
+    m->base.n = n;
+    memcpy(m->base.offsets, offsets, sizeof(*offsets) * (size_t)n);
+    for (int i = 0; i < n; i++)
+        m->val[i] = values ? values[i] : 0;
+    m->output = true;
+    m->active_low = active_low;
+    return &m->base;
+}
+
+static int mock_set(struct gpio_req *r, int n, const unsigned int *offsets, int val)
+{
+    struct mock_req *m = (struct mock_req *)r;
+
+    for (int k = 0; k < n; k++) {
+        int i = gpio_req_index(r, offsets[k]);
+        if (i < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (mock_hook && m->val[i] != val)
+            mock_hook(mock_hook_ctx, r, offsets[k], val ^ m->active_low);
+        m->val[i] = val;
+    }
+    m->writes++;
+    return 0;
+}
+
+static int mock_reconfigure(struct gpio_req *r, bool output, bool active_low,
+                            const int *values)
+{
+    struct mock_req *m = (struct mock_req *)r;
+
+    for (int i = 0; i < r->n && output; i++) {
+        // The hook sees levels: a polarity change alone moves the line too
+        int was = m->val[i] ^ m->active_low;
+        int now = values[i] ^ active_low;
+        if (mock_hook && was != now)
+            mock_hook(mock_hook_ctx, r, r->offsets[i], now);
+        m->val[i] = values[i];
+    }
+    m->output = output;
+    m->active_low = active_low;
+    return 0;
+}
+
+static int mock_get(struct gpio_req *r, unsigned int offset)
+{
+    int i = gpio_req_index(r, offset);
+    return i < 0 ? -1 : ((struct mock_req *)r)->val[i];
+}
+
+static void mock_release(struct gpio_req *r)
+{
+    free(r);
+}
+
+uint64_t gpio_mock_writes(const struct gpio_req *r)
+{
+    return ((const struct mock_req *)r)->writes;
+}
+
+int gpio_mock_value(const struct gpio_req *r, unsigned int offset)
+{
+    return mock_get((struct gpio_req *)r, offset);
+}
+
+void gpio_mock_set_hook(gpio_mock_hook fn, void *ctx)
+{
+    mock_hook = fn;
+    mock_hook_ctx = ctx;
+}
+
+const struct gpio_backend gpio_backend_mock = {
+    .name        = "mock",
+    .desc        = "in-process mock, no hardware",
+    .request     = mock_request,
+    .set         = mock_set,
+    .reconfigure = mock_reconfigure,
+    .get         = mock_get,
+    .release     = mock_release,
+};
@@ -0,0 +1,110 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_backend.h
+//
+// Description:  Small output-GPIO backend interface shared by the apps.
+//
+// Notes:
+// - A backend turns "these offsets on this chip" into a request handle and
+//   drives/reconfigures the lines of that request. Values are logical
+//   (active-low is applied by the backend, the kernel or the driver).
+// - Backends:
+//     gpiod       libgpiod v2 (only when built with HAVE_LIBGPIOD)
+//     cdev        raw GPIO chardev v2 ioctls, no allocation per call
+//     gpio_button LED of the gpio_button driver (one line; chardev write,
+//                 sysfs pwrite fallback; can hand the write to the caller)
+//     mock        in-process, no hardware; counts writes and can report
+//                 every transition to a hook (simulation / self-checks)
+// - Each backend's request struct starts with struct gpio_req.
+//-----------------------------------------------------------------------------
+#ifndef GPIO_BACKEND_H
+#define GPIO_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GPIO_REQ_MAX_LINES  64
+
+struct gpio_backend;
+
+struct gpio_req {
+    const struct gpio_backend *be;
+    int n;
+    unsigned int offsets[GPIO_REQ_MAX_LINES];
+};
+
+/* A one-line set() as a single write(2), for callers that issue it. */
+struct gpio_write {
+    int fd;
+    uint64_t off;               /* UINT64_MAX: current file position */
+    unsigned int len;
+    unsigned char buf[8];
+};
+
+struct gpio_backend {
+    const char *name;
+    const char *desc;
+
+    /*
+     * Request n output lines on chip (path or gpiochipN name), initial
+     * logical values in values[] (NULL = all low). NULL + errno on failure.
+     */
+    struct gpio_req *(*request)(const char *chip, const unsigned int *offsets,
+                                int n, const int *values, bool active_low,
+                                const char *consumer);
+
+    /* Drive the listed lines (a subset of the request) to val. 0 or -1. */
+    int (*set)(struct gpio_req *r, int n, const unsigned int *offsets, int val);
+
+    /*
+     * Change direction/polarity of every line in place, outputs starting at
+     * values[] (one per requested line). 0 or -1 (EOPNOTSUPP if the backend
+     * cannot).
+     */
+    int (*reconfigure)(struct gpio_req *r, bool output, bool active_low,
+                       const int *values);
+
+    /* Current logical value of one line, or -1. May be NULL. */
+    int (*get)(struct gpio_req *r, unsigned int offset);
+
+    void (*release)(struct gpio_req *r);
+
+    /*
+     * Describe set(r, 1, &offset, val) as one write for the caller to
+     * queue (io_uring) instead of doing it. Tracked state is updated as if
+     * the write succeeded. 0, or -1 if the backend cannot. May be NULL.
+     */
+    int (*prep_write)(struct gpio_req *r, unsigned int offset, int val,
+                      struct gpio_write *w);
+};
+
+/* Look a backend up by name; NULL if unknown or not compiled in. */
+const struct gpio_backend *gpio_backend_find(const char *name);
+
+/* NULL-terminated list of the compiled-in backends. */
+extern const struct gpio_backend *const gpio_backends[];
+
+/* Index of offset within the request, or -1. */
+int gpio_req_index(const struct gpio_req *r, unsigned int offset);
+
+/* "gpiochip4" -> "/dev/gpiochip4"; paths pass through. */
+const char *gpio_chip_path(const char *chip, char *buf, unsigned long len);
+
+extern const struct gpio_backend gpio_backend_gpiod;
+extern const struct gpio_backend gpio_backend_cdev;
+extern const struct gpio_backend gpio_backend_gpiobtn;
+extern const struct gpio_backend gpio_backend_mock;
+
+/* Mock introspection: total set() calls and last value of a line. */
+uint64_t gpio_mock_writes(const struct gpio_req *r);
+int gpio_mock_value(const struct gpio_req *r, unsigned int offset);
+
+/*
+ * Mock transition recorder: fn is called from inside set()/reconfigure()
+ * for every line whose electrical level actually changes, with that level
+ * (the value with active-low applied). NULL turns it off.
+ */
+typedef void (*gpio_mock_hook)(void *ctx, const struct gpio_req *r,
+                               unsigned int offset, int val);
+void gpio_mock_set_hook(gpio_mock_hook fn, void *ctx);
+
+#endif /* GPIO_BACKEND_H */
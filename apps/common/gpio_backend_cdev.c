@@ -0,0 +1,151 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_backend_cdev.c
+//
+// Description:  GPIO backend on the raw chardev v2 uAPI (linux/gpio.h).
+//
+// Notes:
+// - One GPIO_V2_GET_LINE_IOCTL per request; after that every write is a
+//   single GPIO_V2_LINE_SET_VALUES_IOCTL on the line fd with a stack
+//   struct, no library allocation or bookkeeping in between.
+//-----------------------------------------------------------------------------
+#include "gpio_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+struct cdev_req {
+    struct gpio_req base;
+    int fd;             /* line request fd */
+    uint64_t all;       /* mask of every requested line */
+};
+
+static void cdev_fill_config(struct gpio_v2_line_config *cfg, int n, bool output,
+                             bool active_low, const int *values)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->flags = output ? GPIO_V2_LINE_FLAG_OUTPUT : GPIO_V2_LINE_FLAG_INPUT;
+    if (active_low)
+        cfg->flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+
+    if (output) {
+        uint64_t bits = 0;
+        for (int i = 0; i < n; i++)
+            if (values && values[i])
+                bits |= 1ULL << i;
+        cfg->num_attrs = 1;
+        cfg->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        cfg->attrs[0].attr.values = bits;
+        cfg->attrs[0].mask = n == 64 ? ~0ULL : (1ULL << n) - 1;
+    }
+}
+
+static struct gpio_req *cdev_request(const char *chip, const unsigned int *offsets,
+                                     int n, const int *values, bool active_low,
+                                     const char *consumer)
+{
+    char buf[128];
+    struct gpio_v2_line_request lr;
+    int chip_fd, err;
+
+    if (n < 1 || n > GPIO_REQ_MAX_LINES || n > GPIO_V2_LINES_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    chip_fd = open(gpio_chip_path(chip, buf, sizeof(buf)), O_RDWR | O_CLOEXEC);
+    if (chip_fd < 0)
+        return NULL;
+
+    memset(&lr, 0, sizeof(lr));
+    memcpy(lr.offsets, offsets, sizeof(*offsets) * (size_t)n);
+    lr.num_lines = (uint32_t)n;
+    strncpy(lr.consumer, consumer, sizeof(lr.consumer) - 1);
+    cdev_fill_config(&lr.config, n, true, active_low, values);
+
+    int rc = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &lr);
+    err = errno;
+    close(chip_fd);
+    if (rc < 0) {
+        errno = err;
+        return NULL;
+    }
+
+    struct cdev_req *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(lr.fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    c->base.be = &gpio_backend_cdev;
+    c->base.n = n;
+    memcpy(c->base.offsets, offsets, sizeof(*offsets) * (size_t)n);
+    c->fd = lr.fd;
+    c->all = n == 64 ? ~0ULL : (1ULL << n) - 1;
+    return &c->base;
+}
+
+static int cdev_set(struct gpio_req *r, int n, const unsigned int *offsets, int val)
+{
+    struct cdev_req *c = (struct cdev_req *)r;
+    struct gpio_v2_line_values lv = { 0, 0 };
+
+    if (n == r->n) {
+        lv.mask = c->all;
+    } else {
+        for (int k = 0; k < n; k++) {
+            int i = gpio_req_index(r, offsets[k]);
+            if (i < 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            lv.mask |= 1ULL << i;
+        }
+    }
+    lv.bits = val ? lv.mask : 0;
+    return ioctl(c->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv) < 0 ? -1 : 0;
+}
+
+static int cdev_reconfigure(struct gpio_req *r, bool output, bool active_low,
+                            const int *values)
+{
+    struct cdev_req *c = (struct cdev_req *)r;
+    struct gpio_v2_line_config cfg;
+
+    cdev_fill_config(&cfg, r->n, output, active_low, values);
+    return ioctl(c->fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) < 0 ? -1 : 0;
+}
+
+static int cdev_get(struct gpio_req *r, unsigned int offset)
+{
+    struct cdev_req *c = (struct cdev_req *)r;
+    int i = gpio_req_index(r, offset);
+    struct gpio_v2_line_values lv = { 0, 0 };
+
+    if (i < 0)
+        return -1;
+    lv.mask = 1ULL << i;
+    if (ioctl(c->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0)
+        return -1;
+    return (lv.bits >> i) & 1;
+}
+
+static void cdev_release(struct gpio_req *r)
+{
+    close(((struct cdev_req *)r)->fd);
+    free(r);
+}
+
+const struct gpio_backend gpio_backend_cdev = {
+    .name        = "cdev",
+    .desc        = "raw GPIO chardev v2 ioctls",
+    .request     = cdev_request,
+    .set         = cdev_set,
+    .reconfigure = cdev_reconfigure,
+    .get         = cdev_get,
+    .release     = cdev_release,
+};
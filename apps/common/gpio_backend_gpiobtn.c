@@ -0,0 +1,189 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_backend_gpiobtn.c
+//
+// Description:  GPIO backend driving the gpio_button driver's LED.
+//
+// Notes:
+// - The driver owns exactly one LED line; the requested offset is only a
+//   label. Each set() is one syscall: a one-byte write() to the driver's
+//   chardev when it supports it, else a pwrite() of '0'/'1' at offset 0 on
+//   a persistent led_status fd (no lseek, no string formatting).
+// - 'chip' may name a different led_status file (anything starting with
+//   /sys/), which forces the sysfs path, or a chardev (/dev/...).
+// - prep_write() yields the same one-byte write for callers that queue it
+//   themselves (button's io_uring loop).
+// - led_status is read once at request time; after that the state is
+//   tracked here and get() makes no syscall.
+// - Polarity is applied here; the driver has no input mode, so
+//   reconfiguring to input fails with EOPNOTSUPP.
+//-----------------------------------------------------------------------------
+#include "gpio_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GPIOBTN_LED_SYSFS "/sys/class/gpio_button/gpio_button_sysfs/led_status"
+#define GPIOBTN_DEVICE    "/dev/gpio_button"
+
+struct gpiobtn_req {
+    struct gpio_req base;
+    int fd;
+    bool chardev;           /* fd is the driver chardev, else led_status */
+    bool active_low;
+    int level;              /* last electrical level written or read */
+};
+
+static int gpiobtn_write_level(struct gpiobtn_req *b, int level)
+{
+    char c = b->chardev ? (char)level : (char)('0' + level);
+    ssize_t n = b->chardev ? write(b->fd, &c, 1) : pwrite(b->fd, &c, 1, 0);
+
+    if (n != 1)
+        return -1;
+    b->level = level;
+    return 0;
+}
+
+static int gpiobtn_write(struct gpiobtn_req *b, int val)
+{
+    return gpiobtn_write_level(b, (val != 0) ^ b->active_low);
+}
+
+/* Current level from led_status, "0\n" or "1\n". -1 on error. */
+static int gpiobtn_read_level(const char *path)
+{
+    char buf[4];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+    if (n < 1 || (buf[0] != '0' && buf[0] != '1')) {
+        errno = EIO;
+        return -1;
+    }
+    return buf[0] - '0';
+}
+
+static struct gpio_req *gpiobtn_request(const char *chip, const unsigned int *offsets,
+                                        int n, const int *values, bool active_low,
+                                        const char *consumer)
+{
+    bool sysfs_only = chip && !strncmp(chip, "/sys/", 5);
+    const char *path = sysfs_only ? chip : GPIOBTN_LED_SYSFS;
+    const char *dev = chip && !strncmp(chip, "/dev/", 5) ? chip : GPIOBTN_DEVICE;
+    (void)consumer;
+
+    if (n != 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct gpiobtn_req *b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+    b->base.be = &gpio_backend_gpiobtn;
+    b->base.n = 1;
+    b->base.offsets[0] = offsets[0];
+    b->active_low = active_low;
+
+    b->level = gpiobtn_read_level(path);
+    if (b->level < 0) {
+        free(b);
+        return NULL;
+    }
+
+    /*
+     * Prefer the chardev. Drivers without a write handler reject the probe
+     * (rewriting the current level, so nothing changes) and we fall back.
+     */
+    b->fd = sysfs_only ? -1 : open(dev, O_WRONLY | O_CLOEXEC);
+    if (b->fd >= 0) {
+        b->chardev = true;
+        if (gpiobtn_write_level(b, b->level) < 0) {
+            close(b->fd);
+            b->fd = -1;
+            b->chardev = false;
+        }
+    }
+    if (b->fd < 0)
+        b->fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (b->fd < 0) {
+        free(b);
+        return NULL;
+    }
+    if (values && gpiobtn_write(b, values[0]) < 0) {
+        int err = errno;
+        close(b->fd);
+        free(b);
+        errno = err;
+        return NULL;
+    }
+    return &b->base;
+}
+
+static int gpiobtn_set(struct gpio_req *r, int n, const unsigned int *offsets, int val)
+{
+    (void)offsets;
+    if (n != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    return gpiobtn_write((struct gpiobtn_req *)r, val);
+}
+
+static int gpiobtn_reconfigure(struct gpio_req *r, bool output, bool active_low,
+                               const int *values)
+{
+    struct gpiobtn_req *b = (struct gpiobtn_req *)r;
+
+    if (!output) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    b->active_low = active_low;
+    return gpiobtn_write(b, values[0]);
+}
+
+static int gpiobtn_get(struct gpio_req *r, unsigned int offset)
+{
+    struct gpiobtn_req *b = (struct gpiobtn_req *)r;
+    (void)offset;
+
+    return b->level ^ b->active_low;
+}
+
+static int gpiobtn_prep_write(struct gpio_req *r, unsigned int offset, int val,
+                              struct gpio_write *w)
+{
+    struct gpiobtn_req *b = (struct gpiobtn_req *)r;
+    int level = (val != 0) ^ b->active_low;
+    (void)offset;
+
+    w->fd = b->fd;
+    w->off = b->chardev ? UINT64_MAX : 0;
+    w->len = 1;
+    w->buf[0] = (unsigned char)(b->chardev ? level : '0' + level);
+    b->level = level;
+    return 0;
+}
+
+static void gpiobtn_release(struct gpio_req *r)
+{
+    close(((struct gpiobtn_req *)r)->fd);
+    free(r);
+}
+
+const struct gpio_backend gpio_backend_gpiobtn = {
+    .name        = "gpio_button",
+    .desc        = "gpio_button driver LED (chardev write or sysfs pwrite)",
+    .request     = gpiobtn_request,
+    .set         = gpiobtn_set,
+    .reconfigure = gpiobtn_reconfigure,
+    .get         = gpiobtn_get,
+    .release     = gpiobtn_release,
+    .prep_write  = gpiobtn_prep_write,
+};
@@ -0,0 +1,173 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_backend_gpiod.c
+//
+// Description:  GPIO backend on libgpiod v2.
+//
+// Notes:
+// - Built only with HAVE_LIBGPIOD (the apps' Makefiles set it when linking
+//   libgpiod). The chip stays open for the lifetime of the request.
+//-----------------------------------------------------------------------------
+#ifdef HAVE_LIBGPIOD
+
+#include "gpio_backend.h"
+
+#include <errno.h>
+#include <gpiod.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct gpiod_req {
+    struct gpio_req base;
+    struct gpiod_chip *chip;
+    struct gpiod_line_request *req;
+};
+
+static const enum gpiod_line_value values_lo[GPIO_REQ_MAX_LINES];
+static const enum gpiod_line_value values_hi[GPIO_REQ_MAX_LINES] = {
+    [0 ... GPIO_REQ_MAX_LINES - 1] = GPIOD_LINE_VALUE_ACTIVE,
+};
+
+/*
+ * Line config for every line of the request. Outputs get their value from
+ * values[], so applying it to a live request does not move the pins.
+ */
+static struct gpiod_line_config *build_line_config(const unsigned int *offsets, int n,
+                                                   bool output, bool active_low,
+                                                   const int *values)
+{
+    struct gpiod_line_config *lcfg = gpiod_line_config_new();
+    if (!lcfg)
+        return NULL;
+
+    for (int i = 0; i < n; i++) {
+        struct gpiod_line_settings *settings = gpiod_line_settings_new();
+        if (!settings) {
+            gpiod_line_config_free(lcfg);
+            return NULL;
+        }
+        gpiod_line_settings_set_direction(settings, output ?
+                                          GPIOD_LINE_DIRECTION_OUTPUT :
+                                          GPIOD_LINE_DIRECTION_INPUT);
+        gpiod_line_settings_set_active_low(settings, active_low);
+        if (output)
+            gpiod_line_settings_set_output_value(settings, values && values[i] ?
+                                                 GPIOD_LINE_VALUE_ACTIVE :
+                                                 GPIOD_LINE_VALUE_INACTIVE);
+
+        int rc = gpiod_line_config_add_line_settings(lcfg, &offsets[i], 1, settings);
+        gpiod_line_settings_free(settings);
+        if (rc < 0) {
+            int err = errno;
+            gpiod_line_config_free(lcfg);
+            errno = err;
+            return NULL;
+        }
+    }
+    return lcfg;
+}
+
+static struct gpio_req *gpiod_be_request(const char *chip, const unsigned int *offsets,
+                                         int n, const int *values, bool active_low,
+                                         const char *consumer)
+{
+    char buf[128];
+    struct gpiod_req *g;
+    int err;
+
+    if (n < 1 || n > GPIO_REQ_MAX_LINES) {
+        errno = EINVAL;
+        return NULL;
+    }
+    g = calloc(1, sizeof(*g));
+    if (!g)
+        return NULL;
+    g->base.be = &gpio_backend_gpiod;
+    g->base.n = n;
+    memcpy(g->base.offsets, offsets, sizeof(*offsets) * (size_t)n);
+
+    g->chip = gpiod_chip_open(gpio_chip_path(chip, buf, sizeof(buf)));
+    if (!g->chip)
+        goto fail;
+
+    struct gpiod_line_config *lcfg = build_line_config(offsets, n, true, active_low, values);
+    if (!lcfg)
+        goto fail;
+    struct gpiod_request_config *rcfg = gpiod_request_config_new();
+    if (!rcfg) {
+        gpiod_line_config_free(lcfg);
+        goto fail;
+    }
+    gpiod_request_config_set_consumer(rcfg, consumer);
+
+    g->req = gpiod_chip_request_lines(g->chip, rcfg, lcfg);
+    err = errno;
+    gpiod_request_config_free(rcfg);
+    gpiod_line_config_free(lcfg);
+    errno = err;
+    if (!g->req)
+        goto fail;
+    return &g->base;
+
+fail:
+    err = errno;
+    if (g->chip)
+        gpiod_chip_close(g->chip);
+    free(g);
+    errno = err;
+    return NULL;
+}
+
+static int gpiod_be_set(struct gpio_req *r, int n, const unsigned int *offsets, int val)
+{
+    struct gpiod_req *g = (struct gpiod_req *)r;
+
+    if (n == 1)
+        return gpiod_line_request_set_value(g->req, offsets[0], val ?
+                                            GPIOD_LINE_VALUE_ACTIVE :
+                                            GPIOD_LINE_VALUE_INACTIVE);
+    return gpiod_line_request_set_values_subset(g->req, (size_t)n, offsets,
+                                                val ? values_hi : values_lo);
+}
+
+static int gpiod_be_reconfigure(struct gpio_req *r, bool output, bool active_low,
+                                const int *values)
+{
+    struct gpiod_req *g = (struct gpiod_req *)r;
+    struct gpiod_line_config *lcfg = build_line_config(r->offsets, r->n, output,
+                                                       active_low, values);
+    if (!lcfg)
+        return -1;
+    int rc = gpiod_line_request_reconfigure_lines(g->req, lcfg);
+    int err = errno;
+    gpiod_line_config_free(lcfg);
+    errno = err;
+    return rc < 0 ? -1 : 0;
+}
+
+static int gpiod_be_get(struct gpio_req *r, unsigned int offset)
+{
+    struct gpiod_req *g = (struct gpiod_req *)r;
+    enum gpiod_line_value v = gpiod_line_request_get_value(g->req, offset);
+    return v == GPIOD_LINE_VALUE_ERROR ? -1 : v == GPIOD_LINE_VALUE_ACTIVE;
+}
+
+static void gpiod_be_release(struct gpio_req *r)
+{
+    struct gpiod_req *g = (struct gpiod_req *)r;
+
+    gpiod_line_request_release(g->req);
+    gpiod_chip_close(g->chip);
+    free(g);
+}
+
+const struct gpio_backend gpio_backend_gpiod = {
+    .name        = "gpiod",
+    .desc        = "libgpiod v2",
+    .request     = gpiod_be_request,
+    .set         = gpiod_be_set,
+    .reconfigure = gpiod_be_reconfigure,
+    .get         = gpiod_be_get,
+    .release     = gpiod_be_release,
+};
+
+#endif /* HAVE_LIBGPIOD */
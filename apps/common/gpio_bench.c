@@ -0,0 +1,264 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_bench.c
+//
+// Description:  Toggle-throughput / call-latency benchmark across backends.
+//
+// Notes:
+// - Every set() call is timed individually into a histogram, and the whole
+//   loop is timed for throughput, so timer overhead shows in the latency
+//   columns but not in toggles/s.
+// - Syscalls are counted with a perf counter on the raw_syscalls:sys_enter
+//   tracepoint for this thread. It needs tracefs and perf_event_paranoid
+//   (or CAP_PERFMON) to allow it; without, the column shows "-".
+// - User/system CPU per toggle comes from getrusage(RUSAGE_THREAD), so it
+//   is only meaningful for runs long enough to cover several ticks.
+// - With max_syscalls set (>= 0; GPIO_BENCH_NO_LIMIT when not), a backend that needs more syscalls per toggle
+//   fails the run (or is flagged "uncounted" when perf is unavailable), so
+//   the syscall budget of a path can be asserted on the target.
+// - All lines are written with one set() per toggle; the lines are left
+//   low when a backend is done.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "gpio_bench.h"
+#include "gpio_backend.h"
+#include "hist.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_WARMUP    1000
+
+static const char *const sys_enter_id_paths[] = {
+    "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+    "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    NULL,
+};
+
+static struct hist bench_hist;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t tv_ns(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000ULL;
+}
+
+int gpio_bench_syscalls_open(void)
+{
+    char buf[32];
+    long id = -1;
+
+    for (int i = 0; sys_enter_id_paths[i] && id < 0; i++) {
+        int fd = open(sys_enter_id_paths[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n > 0) {
+            buf[n] = '\0';
+            id = strtol(buf, NULL, 10);
+        }
+    }
+    if (id < 0)
+        return -1;
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = (uint64_t)id;
+    attr.disabled = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+int gpio_bench_syscalls_read(int fd, uint64_t *count)
+{
+    uint64_t n;
+
+    // sys_enter of this ioctl fires while the counter is still on
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &n, sizeof(n)) != sizeof(n))
+        return -1;
+    *count = n ? n - 1 : 0;
+    return 0;
+}
+
+/* 0 if it ran, 1 if it ran over the syscall budget, -1 if it could not run */
+static int bench_one(const struct gpio_backend *be, const struct gpio_bench_opts *o,
+                     FILE *out)
+{
+    struct gpio_req *r = be->request(o->chip, o->offsets, (int)o->num_offsets, NULL,
+                                     o->active_low, "gpio-bench");
+    if (!r) {
+        fprintf(out, "%-12s unavailable: %s\n", be->name, strerror(errno));
+        return -1;
+    }
+
+    int val = 0;
+    for (int i = 0; i < BENCH_WARMUP; i++) {
+        val = !val;
+        if (be->set(r, (int)o->num_offsets, o->offsets, val) < 0) {
+            fprintf(out, "%-12s set failed: %s\n", be->name, strerror(errno));
+            be->release(r);
+            return -1;
+        }
+    }
+
+    int sc_fd = gpio_bench_syscalls_open();
+    uint64_t syscalls = 0;
+    uint64_t limit_ns = (uint64_t)(o->seconds * 1e9);
+    unsigned long toggles = 0;
+    struct rusage ru0, ru1;
+
+    hist_init(&bench_hist);
+    getrusage(RUSAGE_THREAD, &ru0);
+    if (sc_fd >= 0) {
+        ioctl(sc_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(sc_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t start = bench_now_ns();
+    uint64_t t1 = start;
+    for (;;) {
+        if (limit_ns ? t1 - start >= limit_ns : toggles >= o->iterations)
+            break;
+        val = !val;
+        uint64_t t0 = bench_now_ns();
+        if (be->set(r, (int)o->num_offsets, o->offsets, val) < 0) {
+            // A failing call returns fast: do not report it as a toggle
+            fprintf(out, "%-12s set failed after %lu: %s\n", be->name, toggles,
+                    strerror(errno));
+            if (sc_fd >= 0)
+                close(sc_fd);
+            be->release(r);
+            return -1;
+        }
+        t1 = bench_now_ns();
+        hist_record(&bench_hist, t1 - t0);
+        toggles++;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    if (sc_fd >= 0 && gpio_bench_syscalls_read(sc_fd, &syscalls) < 0) {
+        close(sc_fd);
+        sc_fd = -1;
+    }
+    getrusage(RUSAGE_THREAD, &ru1);
+
+    (void)be->set(r, (int)o->num_offsets, o->offsets, 0);
+    be->release(r);
+
+    double secs = (double)elapsed / 1e9;
+    double n = toggles ? (double)toggles : 1.0;
+    char sc[16] = "-";
+    const char *verdict = "";
+    int rc = 0;
+    if (sc_fd >= 0) {
+        snprintf(sc, sizeof(sc), "%.2f", (double)syscalls / n);
+        close(sc_fd);
+        if (o->max_syscalls >= 0 && (double)syscalls / n > o->max_syscalls) {
+            verdict = "  FAIL: over syscall budget";
+            rc = 1;
+        }
+    } else if (o->max_syscalls >= 0) {
+        // A budget that cannot be checked must not pass
+        verdict = "  FAIL: syscalls not counted (perf/tracefs unavailable)";
+        rc = 1;
+    }
+    fprintf(out, "%-12s %10lu %12.0f %10.1f %8llu %8llu %10llu %9s %8.1f %8.1f%s\n",
+            be->name, toggles,
+            secs > 0 ? (double)toggles / secs : 0.0,
+            (double)elapsed / n,
+            (unsigned long long)hist_percentile(&bench_hist, 50.0),
+            (unsigned long long)hist_percentile(&bench_hist, 99.0),
+            (unsigned long long)HIST_PEEK(bench_hist.max),
+            sc,
+            (double)(tv_ns(&ru1.ru_utime) - tv_ns(&ru0.ru_utime)) / n,
+            (double)(tv_ns(&ru1.ru_stime) - tv_ns(&ru0.ru_stime)) / n,
+            verdict);
+    return rc;
+}
+
+int gpio_bench_parse(struct gpio_bench_opts *o, const char *arg)
+{
+    char *end;
+    double v = strtod(arg, &end);
+
+    if (end == arg || !(v > 0))
+        return -1;
+    if (!strcmp(end, "s") || !strcmp(end, "ms")) {
+        o->seconds = *end == 'm' ? v / 1000.0 : v;
+        o->iterations = 0;
+        return 0;
+    }
+    if (*end || v != (double)(unsigned long)v)
+        return -1;
+    o->iterations = (unsigned long)v;
+    o->seconds = 0;
+    return 0;
+}
+
+int gpio_bench_parse_budget(double *max, const char *arg)
+{
+    char *end;
+    double v = strtod(arg, &end);
+
+    if (end == arg || *end || !(v >= 0))
+        return -1;
+    *max = v;
+    return 0;
+}
+
+int gpio_bench_run(const struct gpio_bench_opts *o, FILE *out)
+{
+    char list[256];
+    int ran = 0, over = 0, rc;
+
+    if ((!o->iterations && o->seconds <= 0) || !o->num_offsets)
+        return -1;
+
+    if (o->seconds > 0)
+        fprintf(out, "# %.3fs of toggles on %s, %u line(s), per backend\n",
+                o->seconds, o->chip, o->num_offsets);
+    else
+        fprintf(out, "# %lu toggles on %s, %u line(s), per backend\n",
+                o->iterations, o->chip, o->num_offsets);
+    fprintf(out, "%-12s %10s %12s %10s %8s %8s %10s %9s %8s %8s\n",
+            "backend", "toggles", "toggles/s", "ns/toggle", "p50_ns", "p99_ns",
+            "max_ns", "sys/tgl", "usr_ns", "sys_ns");
+
+    if (!strcmp(o->backends, "all")) {
+        for (int i = 0; gpio_backends[i]; i++) {
+            rc = bench_one(gpio_backends[i], o, out);
+            ran += rc >= 0;
+            over += rc > 0;
+        }
+        return ran && !over ? 0 : -1;
+    }
+
+    snprintf(list, sizeof(list), "%s", o->backends);
+    for (char *save = NULL, *name = strtok_r(list, ",", &save); name;
+         name = strtok_r(NULL, ",", &save)) {
+        const struct gpio_backend *be = gpio_backend_find(name);
+        if (!be) {
+            fprintf(out, "%-12s unknown backend\n", name);
+            continue;
+        }
+        rc = bench_one(be, o, out);
+        ran += rc >= 0;
+        over += rc > 0;
+    }
+    return ran && !over ? 0 : -1;
+}
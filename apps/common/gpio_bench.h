@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+// File:         gpio_bench.h
+//
+// Description:  Toggle-throughput / call-latency benchmark across backends.
+//-----------------------------------------------------------------------------
+#ifndef GPIO_BENCH_H
+#define GPIO_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define GPIO_BENCH_NO_LIMIT (-1.0)  /* max_syscalls unset */
+
+struct gpio_bench_opts {
+    const char *backends;       /* comma list or "all" */
+    const char *chip;
+    const unsigned int *offsets;
+    unsigned int num_offsets;
+    bool active_low;
+    unsigned long iterations;   /* used when seconds == 0 */
+    double seconds;             /* run for a duration instead */
+    double max_syscalls;        /* per toggle; GPIO_BENCH_NO_LIMIT or >= 0 */
+};
+
+/*
+ * Parse a --bench argument into o: "N" for N toggles, or "Ns" / "Nms" for
+ * a duration. Returns 0, or -1 if arg is not a positive count or time.
+ */
+int gpio_bench_parse(struct gpio_bench_opts *o, const char *arg);
+
+/*
+ * Parse a --max-syscalls budget into *max: a number >= 0 (0 is a real
+ * budget: no syscalls at all). Returns 0, or -1 if arg is not one.
+ */
+int gpio_bench_parse_budget(double *max, const char *arg);
+
+/*
+ * Toggle the lines as fast as possible on each backend and print a table
+ * to out. Backends that cannot request the lines, or whose set() fails
+ * during the run, are reported and skipped.
+ * Returns 0 if at least one backend ran and none went over max_syscalls,
+ * -1 otherwise. With max_syscalls set, a run whose syscalls could not be
+ * counted fails too.
+ */
+int gpio_bench_run(const struct gpio_bench_opts *o, FILE *out);
+
+/*
+ * Syscall counter for the calling thread (perf, raw_syscalls:sys_enter),
+ * created disabled: PERF_EVENT_IOC_RESET/ENABLE it, then stop it with
+ * gpio_bench_syscalls_read(). -1 if perf or tracefs is not available.
+ */
+int gpio_bench_syscalls_open(void);
+
+/*
+ * Disable the counter and store what it counted in *count, not including
+ * the disabling ioctl itself, so a path with no syscalls reads 0.
+ * 0, or -1 if the counter could not be read.
+ */
+int gpio_bench_syscalls_read(int fd, uint64_t *count);
+
+#endif /* GPIO_BENCH_H */
@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// File:         hist.c
+//
+// Description:  Reader side of the log-linear histogram.
+//-----------------------------------------------------------------------------
+#include "hist.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+void hist_init(struct hist *h)
+{
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+        atomic_init(&h->counts[i], 0);
+    atomic_init(&h->total, 0);
+    atomic_init(&h->min, UINT64_MAX);
+    atomic_init(&h->max, 0);
+}
+
+/* Largest value that maps to bucket b. */
+static uint64_t bucket_upper(unsigned b)
+{
+    if (b < HIST_SUB)
+        return b;
+    unsigned shift = b / HIST_SUB - 1;
+    uint64_t base = (uint64_t)(b % HIST_SUB + HIST_SUB) << shift;
+    return base + ((1ULL << shift) - 1);
+}
+
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+    uint64_t total = HIST_PEEK(h->total);
+    uint64_t want, seen = 0;
+
+    if (!total)
+        return 0;
+    want = (uint64_t)((double)total * p / 100.0 + 0.5);
+    if (want < 1)
+        want = 1;
+
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        seen += HIST_PEEK(h->counts[b]);
+        if (seen >= want) {
+            uint64_t v = bucket_upper(b), max = HIST_PEEK(h->max);
+            return v < max ? v : max;
+        }
+    }
+    return HIST_PEEK(h->max);
+}
+
+int hist_format(const struct hist *h, const char *name, char *buf, size_t len)
+{
+    uint64_t total = HIST_PEEK(h->total);
+
+    if (!total)
+        return snprintf(buf, len, "%s n=0", name);
+    return snprintf(buf, len,
+                    "%s n=%" PRIu64 " min=%" PRIu64 " p50=%" PRIu64
+                    " p90=%" PRIu64 " p99=%" PRIu64 " p99.9=%" PRIu64
+                    " max=%" PRIu64,
+                    name, total, HIST_PEEK(h->min),
+                    hist_percentile(h, 50.0), hist_percentile(h, 90.0),
+                    hist_percentile(h, 99.0), hist_percentile(h, 99.9),
+                    HIST_PEEK(h->max));
+}
@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// File:         hist.h
+//
+// Description:  Small HDR-style (log-linear) latency histogram.
+//
+// Notes:
+// - Each power of two is split into HIST_SUB linear buckets, so any
+//   recorded value is reported within ~3% (1/HIST_SUB). Values are
+//   typically nanoseconds; anything above 2^HIST_MAX_EXP lands in the top
+//   bucket.
+// - hist_record() is meant for a single writer and costs a handful of
+//   relaxed loads/stores, no RMW. Readers on other threads may sample at
+//   any time and see a consistent-enough snapshot for percentiles.
+//-----------------------------------------------------------------------------
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS   5
+#define HIST_SUB        (1U << HIST_SUB_BITS)
+#define HIST_MAX_EXP    40          /* ~18 minutes in ns */
+#define HIST_BUCKETS    ((HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB + HIST_SUB)
+
+struct hist {
+    _Atomic uint64_t counts[HIST_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t min;
+    _Atomic uint64_t max;
+};
+
+void hist_init(struct hist *h);
+
+static inline unsigned hist_bucket(uint64_t v)
+{
+    if (v < HIST_SUB)
+        return (unsigned)v;
+    unsigned exp = 63U - (unsigned)__builtin_clzll(v);
+    if (exp > HIST_MAX_EXP)
+        return HIST_BUCKETS - 1;
+    unsigned shift = exp - HIST_SUB_BITS;
+    return shift * HIST_SUB + (unsigned)(v >> shift);
+}
+
+#define HIST_BUMP(field, val) \
+    atomic_store_explicit(&(field), (val), memory_order_relaxed)
+#define HIST_PEEK(field) \
+    atomic_load_explicit(&(field), memory_order_relaxed)
+
+/* Single-writer record. */
+static inline void hist_record(struct hist *h, uint64_t v)
+{
+    unsigned b = hist_bucket(v);
+
+    HIST_BUMP(h->counts[b], HIST_PEEK(h->counts[b]) + 1);
+    HIST_BUMP(h->total, HIST_PEEK(h->total) + 1);
+    if (v < HIST_PEEK(h->min))
+        HIST_BUMP(h->min, v);
+    if (v > HIST_PEEK(h->max))
+        HIST_BUMP(h->max, v);
+}
+
+/* Value at percentile p (0-100): upper edge of the bucket it falls in. */
+uint64_t hist_percentile(const struct hist *h, double p);
+
+/* "name n=.. min=.. p50=.. p90=.. p99=.. p99.9=.. max=.." into buf. */
+int hist_format(const struct hist *h, const char *name, char *buf, size_t len);
+
+#endif /* HIST_H */
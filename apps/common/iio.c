@@ -0,0 +1,279 @@
+//-----------------------------------------------------------------------------
+// File:         iio.c
+//
+// Description:  IIO sysfs and buffer helpers (see iio.h).
+//
+// Notes:
+// - Scan layout follows the kernel's rule (and libiio's): elements in
+//   index order, each aligned to its own storage size, the scan padded to
+//   the largest one. The timestamp is an s64 and usually comes last.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "iio.h"
+
+#include <dirent.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int iio_find(const char *prefix, const char *name, char *dir, size_t len)
+{
+    DIR *d = opendir(IIO_DEVICES);
+    struct dirent *de;
+    size_t plen = strlen(prefix);
+    int num = -1;
+
+    if (!d)
+        return -1;
+    while ((de = readdir(d)) != NULL) {
+        char path[320], buf[64];
+
+        if (strncmp(de->d_name, prefix, plen) || !de->d_name[plen])
+            continue;
+        snprintf(path, sizeof(path), IIO_DEVICES "/%s", de->d_name);
+        if (iio_attr_read(path, "name", buf, sizeof(buf)) < 0 || strcmp(buf, name))
+            continue;
+        snprintf(dir, len, "%s", path);
+        num = atoi(de->d_name + plen);
+        break;
+    }
+    closedir(d);
+    if (num < 0)
+        errno = ENODEV;
+    return num;
+}
+
+int iio_parse_fixed(const char *s, int64_t *nano)
+{
+    int64_t ip = 0, frac = 0, scale = IIO_NANO / 10;
+    bool neg = false, digits = false;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (*s == '-' || *s == '+')
+        neg = *s++ == '-';
+    for (; *s >= '0' && *s <= '9'; s++, digits = true) {
+        if (ip > (INT64_MAX / IIO_NANO) / 10)
+            return -1;
+        ip = ip * 10 + (*s - '0');
+    }
+    if (*s == '.') {
+        for (s++; *s >= '0' && *s <= '9'; s++, digits = true) {
+            frac += (*s - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (!digits || (*s && *s != '\n'))
+        return -1;
+    *nano = (ip * IIO_NANO + frac) * (neg ? -1 : 1);
+    return 0;
+}
+
+int iio_read_fixed(int fd, int64_t *nano)
+{
+    char buf[64];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if (n <= 0) {
+        if (n == 0)
+            errno = ENODATA;
+        return -1;
+    }
+    buf[n] = '\0';
+    if (iio_parse_fixed(buf, nano) < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+int iio_attr_read(const char *dir, const char *attr, char *buf, size_t len)
+{
+    char path[512];
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+int iio_attr_read_fixed(const char *dir, const char *attr, int64_t *nano)
+{
+    char buf[64];
+
+    if (iio_attr_read(dir, attr, buf, sizeof(buf)) < 0)
+        return -1;
+    if (iio_parse_fixed(buf, nano) < 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+int iio_attr_write(const char *dir, const char *attr, const char *val)
+{
+    char path[512];
+    size_t len = strlen(val);
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    n = write(fd, val, len);
+    if (n < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// "le:s32/32>>0", "be:u16/16>>4" (repeat counts are not supported). 0 or -1.
+static int parse_type(const char *s, struct iio_scan_chan *c)
+{
+    char endian[3], sign;
+    unsigned int bits, storage, shift;
+
+    if (sscanf(s, "%2[bl]e:%c%u/%u>>%u", endian, &sign, &bits, &storage, &shift) != 5 ||
+        (sign != 's' && sign != 'u') || bits > storage ||
+        (storage != 8 && storage != 16 && storage != 32 && storage != 64))
+        return -1;
+    c->big_endian = endian[0] == 'b';
+    c->is_signed = sign == 's';
+    c->bits = bits;
+    c->bytes = storage / 8;
+    c->shift = shift;
+    return 0;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+    const struct iio_scan_chan *x = a, *y = b;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+int iio_scan_setup(const char *dir, const char *const *names, unsigned int n,
+                   struct iio_scan *scan)
+{
+    char sdir[384], attr[96], buf[64];
+    struct dirent *de;
+    unsigned int align = 1;
+    DIR *d;
+
+    snprintf(sdir, sizeof(sdir), "%s/scan_elements", dir);
+    d = opendir(sdir);
+    if (!d)
+        return -1;
+    // Everything off first, so only what we ask for is in the scan
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len > 3 && !strcmp(de->d_name + len - 3, "_en"))
+            iio_attr_write(sdir, de->d_name, "0");
+    }
+    closedir(d);
+
+    memset(scan, 0, sizeof(*scan));
+    for (unsigned int i = 0; i < n && scan->count < IIO_SCAN_MAX; i++) {
+        struct iio_scan_chan *c = &scan->chan[scan->count];
+        int64_t idx;
+
+        snprintf(attr, sizeof(attr), "in_%s_en", names[i]);
+        if (iio_attr_write(sdir, attr, "1") < 0)
+            continue;
+        snprintf(attr, sizeof(attr), "in_%s_index", names[i]);
+        if (iio_attr_read_fixed(sdir, attr, &idx) < 0)
+            return -1;
+        snprintf(attr, sizeof(attr), "in_%s_type", names[i]);
+        if (iio_attr_read(sdir, attr, buf, sizeof(buf)) < 0)
+            return -1;
+        if (parse_type(buf, c) < 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        snprintf(c->name, sizeof(c->name), "%s", names[i]);
+        c->index = (unsigned int)(idx / IIO_NANO);
+        c->scale_nano = IIO_NANO;
+        snprintf(attr, sizeof(attr), "in_%s_scale", names[i]);
+        iio_attr_read_fixed(dir, attr, &c->scale_nano);
+        snprintf(attr, sizeof(attr), "in_%s_offset", names[i]);
+        iio_attr_read_fixed(dir, attr, &c->offset_nano);
+        scan->count++;
+    }
+    if (!scan->count) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    qsort(scan->chan, scan->count, sizeof(scan->chan[0]), cmp_index);
+    for (unsigned int i = 0; i < scan->count; i++) {
+        struct iio_scan_chan *c = &scan->chan[i];
+        scan->size = (scan->size + c->bytes - 1) / c->bytes * c->bytes;
+        c->offset = scan->size;
+        scan->size += c->bytes;
+        if (c->bytes > align)
+            align = c->bytes;
+    }
+    scan->size = (scan->size + align - 1) / align * align;
+    return 0;
+}
+
+const struct iio_scan_chan *iio_scan_find(const struct iio_scan *scan, const char *name)
+{
+    for (unsigned int i = 0; i < scan->count; i++) {
+        if (!strcmp(scan->chan[i].name, name))
+            return &scan->chan[i];
+    }
+    return NULL;
+}
+
+int64_t iio_scan_raw(const struct iio_scan_chan *c, const void *p)
+{
+    const unsigned char *b = (const unsigned char *)p + c->offset;
+    uint64_t v;
+
+    switch (c->bytes) {
+    case 1: v = b[0]; break;
+    case 2: {
+        uint16_t x;
+        memcpy(&x, b, 2);
+        v = c->big_endian ? be16toh(x) : le16toh(x);
+        break;
+    }
+    case 4: {
+        uint32_t x;
+        memcpy(&x, b, 4);
+        v = c->big_endian ? be32toh(x) : le32toh(x);
+        break;
+    }
+    default: {
+        uint64_t x;
+        memcpy(&x, b, 8);
+        v = c->big_endian ? be64toh(x) : le64toh(x);
+        break;
+    }
+    }
+    v >>= c->shift;
+    if (c->bits < 64) {
+        v &= (1ULL << c->bits) - 1;
+        if (c->is_signed && (v & (1ULL << (c->bits - 1))))
+            v |= ~((1ULL << c->bits) - 1);
+    }
+    return (int64_t)v;
+}
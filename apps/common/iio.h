@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------------------
+// File:         iio.h
+//
+// Description:  Small helpers for the kernel IIO sysfs and buffer interfaces.
+//
+// Notes:
+// - Devices are looked up by their `name` attribute; iio:deviceN numbers
+//   follow probe order and are not stable.
+// - Values are handled in fixed point with nine decimals (IIO's
+//   INT_PLUS_NANO), so scale/offset are applied with integer math.
+// - The scan helpers describe a triggered-buffer layout from
+//   scan_elements/ (in_<chan>_index, _type) and decode raw scans as read
+//   from /dev/iio:deviceN.
+//-----------------------------------------------------------------------------
+#ifndef IIO_H
+#define IIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IIO_DEVICES         "/sys/bus/iio/devices"
+#define IIO_HRTIMER_CONFIGFS "/sys/kernel/config/iio/triggers/hrtimer"
+#define IIO_NANO            1000000000LL
+#define IIO_SCAN_MAX        8       /* enabled channels per scan */
+
+/*
+ * Directory of the first device (or trigger, with prefix "trigger") whose
+ * name attribute is `name`. Returns its number N, or -1 with errno
+ * (ENODEV if none matched).
+ */
+int iio_find(const char *prefix, const char *name, char *dir, size_t len);
+
+static inline int iio_find_device(const char *name, char *dir, size_t len)
+{
+    return iio_find("iio:device", name, dir, len);
+}
+
+/* "-12.345" -> -12345000000. 0, or -1 if s is not a number. */
+int iio_parse_fixed(const char *s, int64_t *nano);
+
+/* Re-read an open attribute from offset 0 (sysfs regenerates it). 0 or -1. */
+int iio_read_fixed(int fd, int64_t *nano);
+
+/* One-off attribute access relative to dir. 0 or -1 with errno. */
+int iio_attr_read(const char *dir, const char *attr, char *buf, size_t len);
+int iio_attr_read_fixed(const char *dir, const char *attr, int64_t *nano);
+int iio_attr_write(const char *dir, const char *attr, const char *val);
+
+/* (raw + offset) * scale, all nano-scaled. */
+static inline int64_t iio_apply_scale(int64_t raw_nano, int64_t offset_nano,
+                                      int64_t scale_nano)
+{
+    return (int64_t)(((__int128)raw_nano + offset_nano) * scale_nano / IIO_NANO);
+}
+
+/* One enabled scan element. */
+struct iio_scan_chan {
+    char name[48];          /* "temp", "timestamp", ... (in_<name>_en) */
+    unsigned int index;     /* position in the scan */
+    unsigned int offset;    /* byte offset in a scan */
+    unsigned int bytes;     /* storage bytes: 1, 2, 4 or 8 */
+    unsigned int bits;      /* real bits */
+    unsigned int shift;
+    bool is_signed;
+    bool big_endian;
+    int64_t scale_nano;     /* in_<name>_scale, 1.0 if absent */
+    int64_t offset_nano;    /* in_<name>_offset, 0 if absent */
+};
+
+struct iio_scan {
+    struct iio_scan_chan chan[IIO_SCAN_MAX];
+    unsigned int count;
+    unsigned int size;      /* bytes per scan, padded like the kernel does */
+};
+
+/*
+ * Enable exactly the listed scan elements of device dir (names as in
+ * in_<name>_en; ones the device lacks are skipped), disable the rest, and
+ * describe the resulting layout in scan. The buffer must be disabled.
+ * 0, or -1 with errno (ENOENT if none of the names exist).
+ */
+int iio_scan_setup(const char *dir, const char *const *names, unsigned int n,
+                   struct iio_scan *scan);
+
+/* Element by name, or NULL. */
+const struct iio_scan_chan *iio_scan_find(const struct iio_scan *scan, const char *name);
+
+/* Raw integer value of element c in the scan at p (sign-extended, shifted). */
+int64_t iio_scan_raw(const struct iio_scan_chan *c, const void *p);
+
+#endif /* IIO_H */
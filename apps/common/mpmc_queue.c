@@ -0,0 +1,33 @@
+//-----------------------------------------------------------------------------
+// File:         mpmc_queue.c
+//
+// Description:  Setup and teardown of the bounded MPMC queue.
+//-----------------------------------------------------------------------------
+#include "mpmc_queue.h"
+
+#include <stdlib.h>
+
+int mpmc_queue_init(struct mpmc_queue *q, size_t capacity, size_t elem_size)
+{
+    size_t cap = 2;
+
+    memset(q, 0, sizeof(*q));
+    while (cap < capacity)
+        cap <<= 1;
+
+    q->elem_size = elem_size;
+    q->stride = (sizeof(uint64_t) + elem_size + 7) & ~(size_t)7;
+    q->slots = calloc(cap, q->stride);
+    if (!q->slots)
+        return -1;
+    q->mask = cap - 1;
+    for (size_t i = 0; i < cap; i++)
+        atomic_init(mpmc_queue_seq(q, i), i);
+    return 0;
+}
+
+void mpmc_queue_destroy(struct mpmc_queue *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
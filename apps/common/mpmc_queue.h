@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+// File:         mpmc_queue.h
+//
+// Description:  Bounded lock-free multi-producer / multi-consumer queue of
+//               fixed-size elements.
+//
+// Notes:
+// - Vyukov's design: a sequence number per slot tells producers and
+//   consumers whether it is free or filled for their lap, so push and pop
+//   are one CAS on head/tail and a copy. Neither side ever waits: a full
+//   queue fails the push, an empty one the pop.
+// - Elements are copied in and out (elem_size bytes); slots are padded to
+//   8 bytes. Push and pop are inline for the hot paths that use them.
+// - Waking consumers is up to the user (semaphore, polling thread, ...).
+//-----------------------------------------------------------------------------
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct mpmc_queue {
+    unsigned char *slots;       /* seq, then the element, per slot */
+    size_t stride;
+    size_t elem_size;
+    uint64_t mask;
+    _Atomic uint64_t head;      /* producers */
+    _Atomic uint64_t tail;      /* consumers */
+};
+
+/* Capacity is rounded up to a power of two (at least 2). Returns 0 or -1. */
+int mpmc_queue_init(struct mpmc_queue *q, size_t capacity, size_t elem_size);
+void mpmc_queue_destroy(struct mpmc_queue *q);
+
+static inline _Atomic uint64_t *mpmc_queue_seq(const struct mpmc_queue *q, uint64_t pos)
+{
+    return (_Atomic uint64_t *)(q->slots + (pos & q->mask) * q->stride);
+}
+
+/* Copy elem in. false if the queue is full (or was never set up). */
+static inline bool mpmc_queue_push(struct mpmc_queue *q, const void *elem)
+{
+    uint64_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    _Atomic uint64_t *seq;
+
+    if (!q->slots)
+        return false;
+    for (;;) {
+        seq = mpmc_queue_seq(q, pos);
+        int64_t dif = (int64_t)(atomic_load_explicit(seq, memory_order_acquire) - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return false;   // full
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    memcpy(seq + 1, elem, q->elem_size);
+    atomic_store_explicit(seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/* Copy the oldest element out. false if the queue is empty. */
+static inline bool mpmc_queue_pop(struct mpmc_queue *q, void *elem)
+{
+    uint64_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    _Atomic uint64_t *seq;
+
+    if (!q->slots)
+        return false;
+    for (;;) {
+        seq = mpmc_queue_seq(q, pos);
+        int64_t dif = (int64_t)(atomic_load_explicit(seq, memory_order_acquire) - (pos + 1));
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return false;   // empty
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    memcpy(elem, seq + 1, q->elem_size);
+    atomic_store_explicit(seq, pos + q->mask + 1, memory_order_release);
+    return true;
+}
+
+#endif /* MPMC_QUEUE_H */
@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------------
+// File:         rt_profile.c
+//
+// Description:  Opt-in realtime execution profile shared by the apps.
+//
+// Notes:
+// - Every step is best effort: an unprivileged run logs a warning per step
+//   and carries on with whatever it was allowed to change.
+// - PR_SET_TIMERSLACK treats 0 as "reset to default", so 1ns is the
+//   smallest slack that can actually be requested.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "rt_profile.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#define RT_WARN(fmt, ...) do { \
+    syslog(LOG_WARNING, fmt, ##__VA_ARGS__); \
+    fprintf(stderr, "%s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+} while (0)
+
+void rt_profile_init(struct rt_profile *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->policy = SCHED_FIFO;
+    p->priority = RT_PROFILE_DEFAULT_PRIO;
+    p->lock_memory = true;
+    p->stack_prefault = RT_PROFILE_STACK_PREFAULT;
+    CPU_ZERO(&p->cpus);
+}
+
+/* "0-2,5" -> set. Returns 0 or -1. */
+static int parse_cpulist(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s)
+            return -1;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s)
+                return -1;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+            return -1;
+        for (long c = lo; c <= hi; c++)
+            CPU_SET(c, set);
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s && *s != '\n')
+            return -1;
+    }
+    return 0;
+}
+
+int rt_profile_parse(struct rt_profile *p, const char *spec)
+{
+    char buf[128];
+    char *cpus, *prio;
+
+    if (!spec || strlen(spec) >= sizeof(buf)) {
+        errno = EINVAL;
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    cpus = strchr(buf, '@');
+    if (cpus)
+        *cpus++ = '\0';
+    prio = strchr(buf, ':');
+    if (prio)
+        *prio++ = '\0';
+
+    if (!strcasecmp(buf, "fifo"))
+        p->policy = SCHED_FIFO;
+    else if (!strcasecmp(buf, "rr"))
+        p->policy = SCHED_RR;
+    else if (!strcasecmp(buf, "other") || buf[0] == '\0')
+        p->policy = SCHED_OTHER;
+    else
+        goto bad;
+
+    if (prio) {
+        char *end;
+        long v = strtol(prio, &end, 10);
+        if (*end || v < 1 || v > 99)
+            goto bad;
+        p->priority = (int)v;
+    }
+
+    if (cpus) {
+        if (parse_cpulist(cpus, &p->cpus) < 0 || CPU_COUNT(&p->cpus) == 0)
+            goto bad;
+        p->pin = true;
+    }
+
+    p->enabled = true;
+    return 0;
+
+bad:
+    errno = EINVAL;
+    return -1;
+}
+
+int rt_profile_from_env(struct rt_profile *p)
+{
+    const char *spec = getenv(RT_PROFILE_ENV);
+
+    if (!spec || !*spec)
+        return 0;
+    return rt_profile_parse(p, spec);
+}
+
+int rt_profile_apply_process(const struct rt_profile *p)
+{
+    if (!p->enabled || !p->lock_memory)
+        return 0;
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        RT_WARN("mlockall failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Touch the stack now so the hot path never takes a fault growing it. */
+static void __attribute__((noinline)) prefault_stack(size_t bytes)
+{
+    volatile unsigned char *buf = alloca(bytes);
+    for (size_t i = 0; i < bytes; i += 4096)
+        buf[i] = 0;
+}
+
+int rt_profile_apply_thread(const struct rt_profile *p)
+{
+    int ret = 0, rc;
+
+    if (!p->enabled)
+        return 0;
+
+    if (p->pin) {
+        rc = pthread_setaffinity_np(pthread_self(), sizeof(p->cpus), &p->cpus);
+        if (rc != 0) {
+            RT_WARN("pthread_setaffinity_np failed: %s", strerror(rc));
+            ret = -1;
+        }
+    }
+
+    struct sched_param sp = {
+        .sched_priority = p->policy == SCHED_OTHER ? 0 : p->priority,
+    };
+    rc = pthread_setschedparam(pthread_self(), p->policy, &sp);
+    if (rc != 0) {
+        RT_WARN("pthread_setschedparam(policy=%d prio=%d) failed: %s",
+                p->policy, sp.sched_priority, strerror(rc));
+        ret = -1;
+    }
+
+    if (prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL) < 0) {
+        RT_WARN("PR_SET_TIMERSLACK failed: %s", strerror(errno));
+        ret = -1;
+    }
+
+    if (p->stack_prefault)
+        prefault_stack(p->stack_prefault);
+
+    return ret;
+}
+
+bool rt_profile_report(const char *who)
+{
+    cpu_set_t mine, isolated;
+    char line[256] = "";
+    struct sched_param sp;
+    int policy = SCHED_OTHER;
+    bool iso = false;
+
+    CPU_ZERO(&mine);
+    CPU_ZERO(&isolated);
+    pthread_getaffinity_np(pthread_self(), sizeof(mine), &mine);
+    pthread_getschedparam(pthread_self(), &policy, &sp);
+
+    FILE *f = fopen("/sys/devices/system/cpu/isolated", "r");
+    if (f) {
+        if (fgets(line, sizeof(line), f))
+            parse_cpulist(line, &isolated);
+        fclose(f);
+    }
+
+    if (CPU_COUNT(&isolated) > 0) {
+        cpu_set_t both;
+        CPU_AND(&both, &mine, &isolated);
+        iso = CPU_EQUAL(&both, &mine);
+    }
+
+    syslog(LOG_INFO, "%s: policy=%s prio=%d cpus=%d isolated=%s",
+           who,
+           policy == SCHED_FIFO ? "fifo" : policy == SCHED_RR ? "rr" : "other",
+           policy == SCHED_OTHER ? 0 : sp.sched_priority,
+           CPU_COUNT(&mine), iso ? "yes" : "no");
+    if (!iso)
+        syslog(LOG_INFO, "%s: not confined to isolated CPUs (isolcpus=%s)",
+               who, line[0] && line[0] != '\n' ? strtok(line, "\n") : "none");
+    return iso;
+}
@@ -0,0 +1,57 @@
+//-----------------------------------------------------------------------------
+// File:         rt_profile.h
+//
+// Description:  Opt-in realtime execution profile shared by the apps.
+//
+// Notes:
+// - A profile is parsed from a compact spec, either a command-line argument
+//   or the RT_PROFILE environment variable (handy from a systemd unit):
+//       POLICY[:PRIO][@CPULIST]     e.g. "fifo:80@3", "rr:40@2-3", "other@1"
+// - Process-wide parts (mlockall) and per-thread parts (scheduling, affinity,
+//   stack prefault, timer slack) are applied separately, so the profile can
+//   be put on just the thread that does the timing-critical work.
+//-----------------------------------------------------------------------------
+#ifndef RT_PROFILE_H
+#define RT_PROFILE_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RT_PROFILE_ENV              "RT_PROFILE"
+#define RT_PROFILE_DEFAULT_PRIO     50
+#define RT_PROFILE_STACK_PREFAULT   (256 * 1024)
+
+struct rt_profile {
+    bool enabled;
+    int policy;             /* SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+    int priority;           /* 1-99 for FIFO/RR, ignored for OTHER */
+    bool pin;               /* restrict affinity to 'cpus' */
+    cpu_set_t cpus;
+    bool lock_memory;       /* mlockall(MCL_CURRENT | MCL_FUTURE) */
+    size_t stack_prefault;  /* bytes of stack to touch per thread */
+};
+
+/* Defaults: disabled; when enabled SCHED_FIFO/50, locked, no pinning. */
+void rt_profile_init(struct rt_profile *p);
+
+/* Parse a spec (see above) into p and enable it. Returns 0 or -1 (EINVAL). */
+int rt_profile_parse(struct rt_profile *p, const char *spec);
+
+/* Parse RT_PROFILE from the environment if set. Returns 0 if unset. */
+int rt_profile_from_env(struct rt_profile *p);
+
+/* Process-wide: lock memory. Call once, after daemonizing. */
+int rt_profile_apply_process(const struct rt_profile *p);
+
+/* Calling thread: policy/priority, affinity, stack prefault, timer slack. */
+int rt_profile_apply_thread(const struct rt_profile *p);
+
+/*
+ * Log the effective policy/affinity of the calling thread and whether every
+ * CPU it may run on is listed in /sys/devices/system/cpu/isolated.
+ * Returns true when running on isolated CPUs only.
+ */
+bool rt_profile_report(const char *who);
+
+#endif /* RT_PROFILE_H */
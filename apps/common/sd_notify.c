@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// File:         sd_notify.c
+//
+// Description:  systemd notify protocol and fd passing without libsystemd.
+//
+// Notes:
+// - $NOTIFY_SOCKET is a datagram socket path, or an abstract name when it
+//   starts with '@'. vsock addresses are not supported (we run on the
+//   host's own manager).
+//-----------------------------------------------------------------------------
+#include "sd_notify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int sd_notify_send(const char *state, const int *fds, unsigned int nfds)
+{
+    const char *sock = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * SD_NOTIFY_MAX_FDS)];
+    } ctl;
+    struct iovec iov = { .iov_base = (void *)state, .iov_len = strlen(state) };
+    struct msghdr msg = {
+        .msg_name = &addr,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+    size_t len;
+    int fd, rc;
+
+    if (!sock || !*sock)
+        return 0;
+    len = strlen(sock);
+    if ((sock[0] != '/' && sock[0] != '@') || len >= sizeof(addr.sun_path) ||
+        nfds > SD_NOTIFY_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(addr.sun_path, sock, len);
+    if (sock[0] == '@')
+        addr.sun_path[0] = '\0';
+    msg.msg_namelen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len +
+                                  (sock[0] == '/'));
+
+    if (nfds) {
+        struct cmsghdr *c;
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    rc = sendmsg(fd, &msg, MSG_NOSIGNAL) < 0 ? -1 : 1;
+    if (rc < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    return 1;
+}
+
+int sd_notify_take_fds(struct sd_notify_fd *out, int max)
+{
+    const char *pid = getenv("LISTEN_PID");
+    const char *nfds = getenv("LISTEN_FDS");
+    const char *names = getenv("LISTEN_FDNAMES");
+    char *end;
+    long n;
+    int taken = 0;
+
+    if (!pid || !nfds)
+        return 0;
+    if (strtol(pid, &end, 10) != (long)getpid() || *end) {
+        // Meant for someone else (e.g. a parent that did not clear them)
+        return 0;
+    }
+    n = strtol(nfds, &end, 10);
+    if (*end || n < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (long i = 0; i < n; i++) {
+        int fd = SD_NOTIFY_FDS_START + (int)i;
+        char name[SD_NOTIFY_NAME_LEN] = "";
+
+        if (names) {
+            size_t len = strcspn(names, ":");
+            if (len < sizeof(name)) {
+                memcpy(name, names, len);
+                name[len] = '\0';
+            }
+            names += len;
+            if (*names == ':')
+                names++;
+        }
+        if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+            continue;
+        if (taken == max) {
+            close(fd);      // nobody would ever own it
+            continue;
+        }
+        out[taken].fd = fd;
+        memcpy(out[taken].name, name, sizeof(name));
+        taken++;
+    }
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return taken;
+}
@@ -0,0 +1,41 @@
+//-----------------------------------------------------------------------------
+// File:         sd_notify.h
+//
+// Description:  systemd notify protocol and fd passing without libsystemd.
+//
+// Notes:
+// - sd_notify_send() is sd_pid_notify_with_fds() for our own pid: one
+//   datagram of "KEY=VALUE\n" assignments to $NOTIFY_SOCKET, fds attached
+//   with SCM_RIGHTS (FDSTORE=1 parks them in the unit's FD store).
+// - sd_notify_take_fds() is sd_listen_fds_with_names(): fds handed back by
+//   the FD store (or socket activation) start at 3 and are named by
+//   $LISTEN_FDNAMES. The LISTEN_* variables are cleared so children do
+//   not inherit them.
+// - Outside systemd (no $NOTIFY_SOCKET / $LISTEN_PID) both are no-ops.
+//-----------------------------------------------------------------------------
+#ifndef SD_NOTIFY_H
+#define SD_NOTIFY_H
+
+#define SD_NOTIFY_FDS_START     3
+#define SD_NOTIFY_MAX_FDS       32      /* per message and per take */
+#define SD_NOTIFY_NAME_LEN      64
+
+struct sd_notify_fd {
+    int fd;
+    char name[SD_NOTIFY_NAME_LEN];      /* "" if systemd gave none */
+};
+
+/*
+ * Send state (e.g. "READY=1\nSTATUS=ok") with nfds fds attached.
+ * Returns 1 if sent, 0 if not running under a notify-aware manager,
+ * -1 with errno on failure.
+ */
+int sd_notify_send(const char *state, const int *fds, unsigned int nfds);
+
+/*
+ * Collect the fds passed to this process, at most max, marked close-on-
+ * exec. Returns the number taken (0 if none) or -1 with errno.
+ */
+int sd_notify_take_fds(struct sd_notify_fd *out, int max);
+
+#endif /* SD_NOTIFY_H */
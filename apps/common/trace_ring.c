@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------------------
+// File:         trace_ring.c
+//
+// Description:  Consumer side of the trace ring: drain, summarize, dump.
+//
+// Notes:
+// - All formatting and I/O happen here, on the flusher thread, which polls
+//   the ring every TRACE_FLUSH_MS. Producers only ever touch the ring.
+//-----------------------------------------------------------------------------
+#include "trace_ring.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+
+#define TRACE_FLUSH_MS  100
+#define TRACE_BATCH     256
+
+int trace_ring_init(struct trace_ring *r, size_t capacity)
+{
+    memset(r, 0, sizeof(*r));
+    return mpmc_queue_init(&r->q, capacity, sizeof(struct trace_rec));
+}
+
+void trace_ring_destroy(struct trace_ring *r)
+{
+    mpmc_queue_destroy(&r->q);
+}
+
+size_t trace_drain(struct trace_ring *r, struct trace_rec *out, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max && mpmc_queue_pop(&r->q, &out[n]))
+        n++;
+    return n;
+}
+
+static const char *type_name(const struct trace_ring *r, uint32_t type)
+{
+    if (r->type_names && type < TRACE_MAX_TYPES && r->type_names[type])
+        return r->type_names[type];
+    return "?";
+}
+
+static void log_summary(struct trace_ring *r, const char *when)
+{
+    char buf[512];
+    size_t off = 0;
+    uint64_t dropped = atomic_exchange(&r->dropped, 0);
+
+    buf[0] = '\0';
+    for (uint32_t t = 0; t < TRACE_MAX_TYPES && off < sizeof(buf); t++) {
+        if (!r->counts[t])
+            continue;
+        off += (size_t)snprintf(buf + off, sizeof(buf) - off, " %s=%" PRIu64,
+                                type_name(r, t), r->counts[t]);
+    }
+    if (off || dropped)
+        syslog(LOG_INFO, "%s trace %s:%s dropped=%" PRIu64,
+               r->name, when, off ? buf : " idle", dropped);
+    memset(r->counts, 0, sizeof(r->counts));
+}
+
+static void write_dump(struct trace_ring *r)
+{
+    uint64_t n = r->history_count < TRACE_HISTORY ? r->history_count : TRACE_HISTORY;
+    uint64_t first = r->history_count - n;
+    FILE *f = fopen(r->dump_path, "w");
+
+    if (!f) {
+        syslog(LOG_WARNING, "%s trace dump to %s failed: %s",
+               r->name, r->dump_path, strerror(errno));
+        return;
+    }
+    fprintf(f, "# %s trace: last %" PRIu64 " of %" PRIu64 " records\n",
+            r->name, n, r->history_count);
+    fprintf(f, "# ts_ns type id arg\n");
+    for (uint64_t i = first; i < r->history_count; i++) {
+        const struct trace_rec *t = &r->history[i % TRACE_HISTORY];
+        fprintf(f, "%" PRIu64 " %s %" PRIu32 " %" PRId64 "\n",
+                t->ts_ns, type_name(r, t->type), t->id, t->arg);
+    }
+    fclose(f);
+    syslog(LOG_INFO, "%s trace: %" PRIu64 " records dumped to %s",
+           r->name, n, r->dump_path);
+}
+
+static void drain_all(struct trace_ring *r)
+{
+    struct trace_rec batch[TRACE_BATCH];
+    size_t n;
+
+    while ((n = trace_drain(r, batch, TRACE_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i].type < TRACE_MAX_TYPES)
+                r->counts[batch[i].type]++;
+            r->history[r->history_count++ % TRACE_HISTORY] = batch[i];
+        }
+    }
+}
+
+static void *flusher_thread(void *arg)
+{
+    struct trace_ring *r = arg;
+    const struct timespec tick = {
+        .tv_sec = 0, .tv_nsec = TRACE_FLUSH_MS * 1000000L
+    };
+    uint64_t next_summary = trace_now_ns() + (uint64_t)r->summary_sec * 1000000000ULL;
+
+    while (!atomic_load(&r->stop)) {
+        nanosleep(&tick, NULL);
+        drain_all(r);
+
+        if (atomic_exchange(&r->dump_requested, 0))
+            write_dump(r);
+
+        if (r->summary_sec && trace_now_ns() >= next_summary) {
+            log_summary(r, "summary");
+            next_summary += (uint64_t)r->summary_sec * 1000000000ULL;
+        }
+    }
+
+    drain_all(r);
+    if (atomic_exchange(&r->dump_requested, 0))
+        write_dump(r);
+    log_summary(r, "final");
+    return NULL;
+}
+
+int trace_flusher_start(struct trace_ring *r, const char *name,
+                        const char *const *type_names, const char *dump_path,
+                        unsigned summary_sec)
+{
+    r->name = name;
+    r->type_names = type_names;
+    r->dump_path = dump_path;
+    r->summary_sec = summary_sec;
+    atomic_store(&r->stop, 0);
+
+    int rc = pthread_create(&r->flusher, NULL, flusher_thread, r);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    r->flusher_running = true;
+    return 0;
+}
+
+void trace_flusher_stop(struct trace_ring *r)
+{
+    if (!r->flusher_running)
+        return;
+    atomic_store(&r->stop, 1);
+    pthread_join(r->flusher, NULL);
+    r->flusher_running = false;
+}
@@ -0,0 +1,109 @@
+//-----------------------------------------------------------------------------
+// File:         trace_ring.h
+//
+// Description:  Lock-free in-process ring of fixed-size binary trace records.
+//
+// Notes:
+// - Hot paths call trace_emit(): one clock read, one CAS and a 24-byte
+//   store. No formatting, no locks, no syscalls. A full ring drops the
+//   record and counts it; producers never wait.
+// - Multi-producer / single-consumer on the bounded lock-free queue of
+//   mpmc_queue.h.
+// - The consumer is a flusher thread that keeps the most recent records,
+//   logs a per-type summary to syslog periodically, and writes the recent
+//   history to a text file when trace_request_dump() is called (from a
+//   SIGUSR1 handler, say; it is async-signal-safe).
+//-----------------------------------------------------------------------------
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mpmc_queue.h"
+
+#define TRACE_MAX_TYPES     16
+#define TRACE_HISTORY       1024    /* records kept for on-demand dumps */
+
+struct trace_rec {
+    uint64_t ts_ns;     /* CLOCK_MONOTONIC */
+    uint32_t type;      /* app-defined, < TRACE_MAX_TYPES */
+    uint32_t id;        /* line offset, device index, ... */
+    int64_t  arg;       /* value, latency, error code, ... */
+};
+
+struct trace_ring {
+    struct mpmc_queue q;
+    _Atomic uint64_t dropped;
+
+    /* flusher state */
+    const char *name;
+    const char *const *type_names;  /* TRACE_MAX_TYPES entries, may be NULL */
+    const char *dump_path;
+    unsigned summary_sec;
+    pthread_t flusher;
+    bool flusher_running;
+    _Atomic int stop;
+    _Atomic int dump_requested;
+    struct trace_rec history[TRACE_HISTORY];
+    uint64_t history_count;
+    uint64_t counts[TRACE_MAX_TYPES];
+};
+
+/* Capacity is rounded up to a power of two. Returns 0 or -1. */
+int trace_ring_init(struct trace_ring *r, size_t capacity);
+void trace_ring_destroy(struct trace_ring *r);
+
+static inline uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Append a record stamped with ts_ns. Returns false if it was dropped. */
+static inline bool trace_emit_at(struct trace_ring *r, uint64_t ts_ns,
+                                 uint32_t type, uint32_t id, int64_t arg)
+{
+    const struct trace_rec rec = { .ts_ns = ts_ns, .type = type, .id = id, .arg = arg };
+
+    if (!r->q.slots)
+        return false;
+    if (!mpmc_queue_push(&r->q, &rec)) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+static inline bool trace_emit(struct trace_ring *r, uint32_t type,
+                              uint32_t id, int64_t arg)
+{
+    return trace_emit_at(r, trace_now_ns(), type, id, arg);
+}
+
+/* Consumer side: copy out up to max records. Returns the number copied. */
+size_t trace_drain(struct trace_ring *r, struct trace_rec *out, size_t max);
+
+/*
+ * Start the flusher thread. 'type_names' maps record types to short names
+ * for summaries and dumps; 'dump_path' is where trace_request_dump() writes.
+ */
+int trace_flusher_start(struct trace_ring *r, const char *name,
+                        const char *const *type_names, const char *dump_path,
+                        unsigned summary_sec);
+
+/* Stop the flusher; it drains and logs a final summary first. */
+void trace_flusher_stop(struct trace_ring *r);
+
+/* Async-signal-safe: ask the flusher to write the recent history out. */
+static inline void trace_request_dump(struct trace_ring *r)
+{
+    atomic_store_explicit(&r->dump_requested, 1, memory_order_relaxed);
+}
+
+#endif /* TRACE_RING_H */
@@ -0,0 +1,626 @@
+//-----------------------------------------------------------------------------
+// File:         tsring.c
+//
+// Description:  mmap'ed time-series ring (see tsring.h).
+//
+// Notes:
+// - Bit stream, MSB first. Per record after the first:
+//     dod = delta - previous delta (µs):
+//       '0'                      dod == 0
+//       '10'    + 7 bits         -64 .. 63
+//       '110'   + 9 bits         -256 .. 255
+//       '1110'  + 12 bits        -2048 .. 2047
+//       '11110' + 32 bits
+//       '11111' + 64 bits
+//     each value, x = v XOR previous v (64-bit):
+//       '0'                      x == 0
+//       '10' + bits              x fits the previous leading/trailing-zero
+//                                window: only the bits inside it
+//       '11' + 6 bits leading zeros + 6 bits (length - 1) + length bits
+//   The first record of a block is 64 bits of time and 64 per value.
+// - A block is closed before a record could overflow it (worst case
+//   checked up front), so decoding never needs a length per record.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "tsring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK_HDR           offsetof(struct tsr_block, data)
+#define STORE(field, val)   atomic_store_explicit(&(field), (val), memory_order_relaxed)
+#define LOAD(field)         atomic_load_explicit(&(field), memory_order_relaxed)
+
+_Static_assert(offsetof(struct tsr_block, data) == 64, "tsr_block header: 64 bytes");
+
+static struct tsr_block *block_at(const struct tsr *t, uint32_t i)
+{
+    return (struct tsr_block *)(t->base + TSR_HEADER_SIZE + (size_t)i * t->hdr->block_size);
+}
+
+static uint32_t data_bits(const struct tsr *t)
+{
+    return (t->hdr->block_size - (uint32_t)BLOCK_HDR) * 8;
+}
+
+static uint32_t crc32(const uint8_t *p, size_t n)
+{
+    uint32_t crc = 0xffffffffu;
+
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = crc >> 1 ^ (0xedb88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---- Bit stream ----
+
+static void put_bits(uint8_t *data, uint32_t *pos, uint64_t v, unsigned int n)
+{
+    while (n) {
+        unsigned int room = 8 - (*pos & 7);
+        unsigned int take = n < room ? n : room;
+        uint8_t bits = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+
+        data[*pos >> 3] |= (uint8_t)(bits << (room - take));
+        *pos += take;
+        n -= take;
+    }
+}
+
+struct bit_reader {
+    const uint8_t *data;
+    uint32_t pos, end;
+    bool overrun;
+};
+
+static uint64_t get_bits(struct bit_reader *br, unsigned int n)
+{
+    uint64_t v = 0;
+
+    if (br->pos + n > br->end) {
+        br->overrun = true;
+        return 0;
+    }
+    while (n) {
+        unsigned int room = 8 - (br->pos & 7);
+        unsigned int take = n < room ? n : room;
+        uint8_t byte = br->data[br->pos >> 3];
+
+        v = v << take | ((byte >> (room - take)) & ((1u << take) - 1));
+        br->pos += take;
+        n -= take;
+    }
+    return v;
+}
+
+static int64_t sign_extend(uint64_t v, unsigned int bits)
+{
+    return bits >= 64 ? (int64_t)v : (int64_t)(v << (64 - bits)) >> (64 - bits);
+}
+
+static bool fits(int64_t v, unsigned int bits)
+{
+    return v >= -(1LL << (bits - 1)) && v < (1LL << (bits - 1));
+}
+
+// ---- Writer ----
+
+static uint32_t worst_bits(unsigned int nvals)
+{
+    return 5 + 64 + nvals * (2 + 6 + 6 + 64);
+}
+
+static void seal(struct tsr *t, struct tsr_block *b)
+{
+    uint32_t bytes = (LOAD(b->nbits) + 7) / 8;
+    uintptr_t page = (uintptr_t)b & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+
+    if (LOAD(b->sealed))
+        return;
+    b->crc = crc32(b->data, bytes);
+    atomic_store_explicit(&b->sealed, 1, memory_order_release);
+    if (t->writable)
+        msync((void *)page, (uintptr_t)b->data + bytes - page, MS_ASYNC);
+}
+
+static void stream_seal(struct tsr *t, struct tsr_stream *s)
+{
+    if (s->block < 0)
+        return;
+    seal(t, block_at(t, (uint32_t)s->block));
+    s->block = -1;
+}
+
+// Take the next block of the ring for s (overwriting the oldest).
+static void stream_new_block(struct tsr *t, struct tsr_stream *s)
+{
+    uint32_t i = t->next_block;
+    struct tsr_block *b = block_at(t, i);
+
+    // Any other stream still writing there loses its block first
+    for (unsigned int k = 0; k < t->num_streams; k++) {
+        if (t->streams[k].block == (int32_t)i)
+            stream_seal(t, &t->streams[k]);
+    }
+    atomic_store_explicit(&b->seq, 0, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    memset(b->data, 0, t->hdr->block_size - BLOCK_HDR);
+    b->magic = TSR_BLOCK_MAGIC;
+    b->series = s->series;
+    b->nvals = s->nvals;
+    STORE(b->count, 0);
+    STORE(b->nbits, 0);
+    STORE(b->sealed, 0);
+    b->crc = 0;
+    STORE(b->t_first_us, 0);
+    STORE(b->t_last_us, 0);
+    atomic_store_explicit(&b->seq, t->next_seq++, memory_order_release);
+
+    s->block = (int32_t)i;
+    s->bitpos = 0;
+    t->next_block = (i + 1) % t->hdr->num_blocks;
+}
+
+static int map_file(struct tsr *t, int fd, size_t size, int prot)
+{
+    void *p = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+    if (p == MAP_FAILED)
+        return -1;
+    t->base = p;
+    t->hdr = p;
+    t->size = size;
+    return 0;
+}
+
+static bool header_ok(const struct tsr_header *h, size_t size)
+{
+    return size >= TSR_HEADER_SIZE && h->magic == TSR_MAGIC && h->version == TSR_VERSION &&
+           h->header_size == TSR_HEADER_SIZE && h->block_size >= 512 &&
+           h->block_size % 64 == 0 && h->num_blocks >= 2 &&
+           TSR_HEADER_SIZE + (uint64_t)h->num_blocks * h->block_size <= size;
+}
+
+int tsr_open(struct tsr *t, const char *path, size_t size)
+{
+    struct stat st;
+    int fd;
+
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size) {
+        // Never reformat something that is not ours
+        if ((size_t)st.st_size < TSR_HEADER_SIZE) {
+            errno = EPROTO;
+            goto fail;
+        }
+        if (map_file(t, fd, (size_t)st.st_size, PROT_READ | PROT_WRITE) < 0)
+            goto fail;
+        if (!header_ok(t->hdr, t->size)) {
+            errno = EPROTO;
+            goto fail;
+        }
+    } else {
+        // New file: lay out a fresh ring, space reserved up front
+        uint32_t blocks = size > TSR_HEADER_SIZE
+                              ? (uint32_t)((size - TSR_HEADER_SIZE) / TSR_BLOCK_SIZE) : 0;
+        struct tsr_header h = {
+            .magic = TSR_MAGIC, .version = TSR_VERSION, .header_size = TSR_HEADER_SIZE,
+            .block_size = TSR_BLOCK_SIZE, .num_blocks = blocks, .created_us = now_us(),
+        };
+
+        if (blocks < 2) {
+            errno = EINVAL;
+            goto fail;
+        }
+        size = TSR_HEADER_SIZE + (size_t)blocks * TSR_BLOCK_SIZE;
+        if (ftruncate(fd, (off_t)size) < 0)
+            goto fail;
+        errno = posix_fallocate(fd, 0, (off_t)size);
+        if (errno)
+            goto fail;
+        if (map_file(t, fd, size, PROT_READ | PROT_WRITE) < 0)
+            goto fail;
+        memcpy(t->hdr, &h, sizeof(h));
+        msync(t->base, TSR_HEADER_SIZE, MS_SYNC);
+    }
+    t->fd = fd;
+    t->writable = true;
+
+    // Continue after the newest block; seal what a crash left open
+    uint64_t max_seq = 0;
+    for (uint32_t i = 0; i < t->hdr->num_blocks; i++) {
+        struct tsr_block *b = block_at(t, i);
+        uint64_t seq = LOAD(b->seq);
+
+        if (b->magic != TSR_BLOCK_MAGIC || !seq)
+            continue;
+        if (!LOAD(b->sealed))
+            seal(t, b);
+        if (seq > max_seq) {
+            max_seq = seq;
+            t->next_block = (i + 1) % t->hdr->num_blocks;
+        }
+    }
+    t->next_seq = max_seq + 1;
+    return 0;
+
+fail: {
+        int err = errno;
+        if (t->base)
+            munmap(t->base, t->size);
+        t->base = NULL;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+}
+
+static struct tsr_stream *stream_get(struct tsr *t, enum tsr_series series, unsigned int nvals)
+{
+    for (unsigned int k = 0; k < t->num_streams; k++) {
+        if (t->streams[k].series == series)
+            return &t->streams[k];
+    }
+    if (t->num_streams == TSR_MAX_SERIES)
+        return NULL;
+    struct tsr_stream *s = &t->streams[t->num_streams++];
+    memset(s, 0, sizeof(*s));
+    s->series = (uint16_t)series;
+    s->nvals = (uint16_t)nvals;
+    s->block = -1;
+    return s;
+}
+
+static void put_value(uint8_t *data, uint32_t *pos, struct tsr_stream *s, unsigned int k,
+                      uint64_t v)
+{
+    uint64_t x = v ^ s->prev_v[k];
+    unsigned int lead, trail, len;
+
+    s->prev_v[k] = v;
+    if (!x) {
+        put_bits(data, pos, 0, 1);
+        return;
+    }
+    lead = (unsigned int)__builtin_clzll(x);
+    trail = (unsigned int)__builtin_ctzll(x);
+    if (lead > 63)
+        lead = 63;
+    if (s->lead[k] + s->trail[k] && lead >= s->lead[k] && trail >= s->trail[k]) {
+        put_bits(data, pos, 2, 2);
+        put_bits(data, pos, x >> s->trail[k], 64 - s->lead[k] - s->trail[k]);
+        return;
+    }
+    len = 64 - lead - trail;
+    put_bits(data, pos, 3, 2);
+    put_bits(data, pos, lead, 6);
+    put_bits(data, pos, len - 1, 6);
+    put_bits(data, pos, x >> trail, len);
+    s->lead[k] = (uint8_t)lead;
+    s->trail[k] = (uint8_t)trail;
+}
+
+int tsr_append(struct tsr *t, enum tsr_series series, int64_t t_us, const int64_t *v,
+               unsigned int nvals)
+{
+    struct tsr_stream *s;
+    struct tsr_block *b;
+    uint32_t pos;
+
+    if (!t->base || !t->writable || nvals > TSR_MAX_VALS) {
+        errno = EINVAL;
+        return -1;
+    }
+    s = stream_get(t, series, nvals);
+    if (!s || s->nvals != nvals) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Time going backwards (clock step) starts a fresh block
+    if (s->block >= 0 && (s->bitpos + worst_bits(nvals) > data_bits(t) || t_us < s->prev_t))
+        stream_seal(t, s);
+    if (s->block < 0)
+        stream_new_block(t, s);
+    b = block_at(t, (uint32_t)s->block);
+    pos = s->bitpos;
+
+    if (!LOAD(b->count)) {
+        put_bits(b->data, &pos, (uint64_t)t_us, 64);
+        for (unsigned int k = 0; k < nvals; k++) {
+            put_bits(b->data, &pos, (uint64_t)v[k], 64);
+            s->prev_v[k] = (uint64_t)v[k];
+            s->lead[k] = s->trail[k] = 0;
+        }
+        s->prev_delta = 0;
+        STORE(b->t_first_us, t_us);
+    } else {
+        int64_t delta = t_us - s->prev_t;
+        int64_t dod = delta - s->prev_delta;
+
+        if (!dod) {
+            put_bits(b->data, &pos, 0, 1);
+        } else if (fits(dod, 7)) {
+            put_bits(b->data, &pos, 2, 2);
+            put_bits(b->data, &pos, (uint64_t)dod, 7);
+        } else if (fits(dod, 9)) {
+            put_bits(b->data, &pos, 6, 3);
+            put_bits(b->data, &pos, (uint64_t)dod, 9);
+        } else if (fits(dod, 12)) {
+            put_bits(b->data, &pos, 14, 4);
+            put_bits(b->data, &pos, (uint64_t)dod, 12);
+        } else if (fits(dod, 32)) {
+            put_bits(b->data, &pos, 30, 5);
+            put_bits(b->data, &pos, (uint64_t)dod, 32);
+        } else {
+            put_bits(b->data, &pos, 31, 5);
+            put_bits(b->data, &pos, (uint64_t)dod, 64);
+        }
+        s->prev_delta = delta;
+        for (unsigned int k = 0; k < nvals; k++)
+            put_value(b->data, &pos, s, k, (uint64_t)v[k]);
+    }
+    s->prev_t = t_us;
+    s->bitpos = pos;
+
+    // Bits first, then the count that makes them visible
+    STORE(b->t_last_us, t_us);
+    STORE(b->nbits, pos);
+    atomic_store_explicit(&b->count, LOAD(b->count) + 1, memory_order_release);
+    return 0;
+}
+
+void tsr_close(struct tsr *t)
+{
+    if (!t->base)
+        return;
+    if (t->writable) {
+        for (unsigned int k = 0; k < t->num_streams; k++)
+            stream_seal(t, &t->streams[k]);
+        msync(t->base, t->size, MS_ASYNC);
+    }
+    munmap(t->base, t->size);
+    t->base = NULL;
+    t->hdr = NULL;
+    if (t->fd >= 0)
+        close(t->fd);
+    t->fd = -1;
+}
+
+// ---- Reader ----
+
+int tsr_map(struct tsr *t, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < TSR_HEADER_SIZE) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    if (map_file(t, fd, (size_t)st.st_size, PROT_READ) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    if (!header_ok(t->hdr, t->size)) {
+        munmap(t->base, t->size);
+        t->base = NULL;
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void tsr_unmap(struct tsr *t)
+{
+    tsr_close(t);
+}
+
+static int get_value(struct bit_reader *br, uint64_t *prev, uint8_t *lead, uint8_t *trail)
+{
+    uint64_t x;
+
+    if (!get_bits(br, 1))
+        return 0;
+    if (!get_bits(br, 1)) {
+        unsigned int len = 64 - *lead - *trail;
+        if (!len || len > 64)
+            return -1;
+        x = get_bits(br, len) << *trail;
+    } else {
+        unsigned int l = (unsigned int)get_bits(br, 6);
+        unsigned int len = (unsigned int)get_bits(br, 6) + 1;
+        if (l + len > 64)
+            return -1;
+        *lead = (uint8_t)l;
+        *trail = (uint8_t)(64 - l - len);
+        x = get_bits(br, len) << *trail;
+    }
+    *prev ^= x;
+    return br->overrun ? -1 : 0;
+}
+
+// Decode up to count records of b into out. Records decoded, or -1.
+static long decode_block(const struct tsr *t, const struct tsr_block *b, uint32_t count,
+                         struct tsr_record *out)
+{
+    struct bit_reader br = { .data = b->data, .end = data_bits(t) };
+    uint64_t prev[TSR_MAX_VALS];
+    uint8_t lead[TSR_MAX_VALS] = { 0 }, trail[TSR_MAX_VALS] = { 0 };
+    unsigned int nvals = b->nvals;
+    int64_t ts = 0, delta = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!i) {
+            ts = (int64_t)get_bits(&br, 64);
+            for (unsigned int k = 0; k < nvals; k++)
+                prev[k] = get_bits(&br, 64);
+        } else {
+            int64_t dod;
+            unsigned int ones = 0;
+
+            while (ones < 5 && get_bits(&br, 1))
+                ones++;
+            switch (ones) {
+            case 0: dod = 0; break;
+            case 1: dod = sign_extend(get_bits(&br, 7), 7); break;
+            case 2: dod = sign_extend(get_bits(&br, 9), 9); break;
+            case 3: dod = sign_extend(get_bits(&br, 12), 12); break;
+            case 4: dod = sign_extend(get_bits(&br, 32), 32); break;
+            default: dod = (int64_t)get_bits(&br, 64); break;
+            }
+            delta += dod;
+            ts += delta;
+            for (unsigned int k = 0; k < nvals; k++) {
+                if (get_value(&br, &prev[k], &lead[k], &trail[k]) < 0)
+                    return i;
+            }
+        }
+        if (br.overrun)
+            return i;
+        out[i].t_us = ts;
+        for (unsigned int k = 0; k < nvals; k++)
+            out[i].v[k] = (int64_t)prev[k];
+    }
+    return count;
+}
+
+struct block_ref {
+    uint64_t seq;
+    uint32_t index;
+};
+
+static int cmp_seq(const void *a, const void *b)
+{
+    const struct block_ref *x = a, *y = b;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// Blocks of series worth decoding, oldest first. Count, or -1.
+static long collect(const struct tsr *t, enum tsr_series series, int64_t from_us,
+                    int64_t to_us, struct block_ref **refs)
+{
+    long n = 0;
+
+    *refs = malloc(t->hdr->num_blocks * sizeof(**refs));
+    if (!*refs)
+        return -1;
+    for (uint32_t i = 0; i < t->hdr->num_blocks; i++) {
+        struct tsr_block *b = block_at(t, i);
+        uint64_t seq = atomic_load_explicit(&b->seq, memory_order_acquire);
+
+        if (b->magic != TSR_BLOCK_MAGIC || !seq || b->series != series ||
+            b->nvals > TSR_MAX_VALS || !LOAD(b->count))
+            continue;
+        if (LOAD(b->t_last_us) < from_us || LOAD(b->t_first_us) >= to_us)
+            continue;
+        (*refs)[n].seq = seq;
+        (*refs)[n].index = i;
+        n++;
+    }
+    qsort(*refs, (size_t)n, sizeof(**refs), cmp_seq);
+    return n;
+}
+
+long tsr_scan(const struct tsr *t, enum tsr_series series, int64_t from_us, int64_t to_us,
+              tsr_fn fn, void *ctx)
+{
+    struct block_ref *refs;
+    struct tsr_record *recs;
+    long nblocks, visited = 0;
+    size_t max_recs = data_bits(t);     // one bit per record at the very least
+
+    if (!t->base) {
+        errno = EINVAL;
+        return -1;
+    }
+    nblocks = collect(t, series, from_us, to_us, &refs);
+    if (nblocks < 0)
+        return -1;
+    recs = malloc(max_recs * sizeof(*recs));
+    if (!recs) {
+        free(refs);
+        return -1;
+    }
+    for (long i = 0; i < nblocks; i++) {
+        struct tsr_block *b = block_at(t, refs[i].index);
+        uint32_t count = atomic_load_explicit(&b->count, memory_order_acquire);
+        bool sealed = atomic_load_explicit(&b->sealed, memory_order_acquire);
+        long n;
+
+        if (sealed && b->crc != crc32(b->data, (LOAD(b->nbits) + 7) / 8))
+            continue;       // torn by a power cut: skip the whole block
+        if (count > max_recs)
+            count = (uint32_t)max_recs;
+        n = decode_block(t, b, count, recs);
+        // Reused under us: whatever we decoded may be a mix
+        atomic_thread_fence(memory_order_acquire);
+        if (LOAD(b->seq) != refs[i].seq)
+            continue;
+        for (long k = 0; k < n; k++) {
+            if (recs[k].t_us < from_us || recs[k].t_us >= to_us)
+                continue;
+            visited++;
+            if (fn(&recs[k], b->nvals, ctx)) {
+                free(recs);
+                free(refs);
+                return visited;
+            }
+        }
+    }
+    free(recs);
+    free(refs);
+    return visited;
+}
+
+void tsr_usage(const struct tsr *t, enum tsr_series series, struct tsr_usage *u)
+{
+    struct block_ref *refs;
+    long n = collect(t, series, INT64_MIN, INT64_MAX, &refs);
+
+    memset(u, 0, sizeof(*u));
+    for (long i = 0; i < n; i++) {
+        struct tsr_block *b = block_at(t, refs[i].index);
+        int64_t first = LOAD(b->t_first_us), last = LOAD(b->t_last_us);
+
+        u->blocks++;
+        u->records += LOAD(b->count);
+        u->bytes += (LOAD(b->nbits) + 7) / 8;
+        if (!u->first_us || first < u->first_us)
+            u->first_us = first;
+        if (last > u->last_us)
+            u->last_us = last;
+    }
+    if (n >= 0)
+        free(refs);
+}
@@ -0,0 +1,136 @@
+//-----------------------------------------------------------------------------
+// File:         tsring.h
+//
+// Description:  Fixed-size, mmap'ed on-disk ring of compressed time series
+//               (sensor samples, button events).
+//
+// Notes:
+// - File: a 4 KiB header page, then num_blocks blocks of block_size bytes.
+//   Each block holds records of one series, compressed Gorilla-style:
+//   timestamps (µs, CLOCK_REALTIME) as delta-of-delta, each value as the
+//   XOR with the previous one. The first record of a block is stored raw,
+//   so every block decodes on its own.
+// - Blocks are taken round-robin; seq orders them and overwrites the
+//   oldest when the ring is full. A record is appended with plain stores
+//   into the mapping (no syscalls); count is published last (release), so
+//   a concurrent reader decodes exactly what is complete.
+// - A full block is sealed with a CRC of its bits and flushed with
+//   msync(MS_ASYNC). After a crash the open blocks are still readable up
+//   to their count; the writer seals them on its next start.
+// - Readers map the file read-only and scan without locks; a block reused
+//   under a reader (seq changed) is dropped from that scan.
+//-----------------------------------------------------------------------------
+#ifndef TSRING_H
+#define TSRING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TSR_MAGIC           0x31525354u     /* "TSR1" */
+#define TSR_BLOCK_MAGIC     0x4b4c4254u     /* "TBLK" */
+#define TSR_VERSION         1
+#define TSR_HEADER_SIZE     4096
+#define TSR_BLOCK_SIZE      4096
+#define TSR_DEFAULT_SIZE    (4u << 20)
+#define TSR_MAX_VALS        4
+#define TSR_MAX_SERIES      4
+
+enum tsr_series {
+    TSR_SERIES_BME280 = 1,  // temp_mdegc, humidity_mpct, pressure_mpa
+    TSR_SERIES_BUTTON = 2,  // button_bus type, dev, value
+};
+
+struct tsr_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;   // TSR_HEADER_SIZE
+    uint32_t block_size;
+    uint32_t num_blocks;
+    int64_t created_us;     // CLOCK_REALTIME
+};
+
+struct tsr_block {
+    uint32_t magic;         // TSR_BLOCK_MAGIC once initialised
+    uint16_t series;        // enum tsr_series
+    uint16_t nvals;         // values per record
+    _Atomic uint64_t seq;   // 0 while being (re)initialised
+    _Atomic uint32_t count; // complete records
+    _Atomic uint32_t nbits; // bits used by them
+    _Atomic uint32_t sealed;
+    uint32_t crc;           // CRC-32 of the data bytes, once sealed
+    _Atomic int64_t t_first_us;
+    _Atomic int64_t t_last_us;
+    uint8_t reserved[16];
+    uint8_t data[];
+};
+
+struct tsr_record {
+    int64_t t_us;
+    int64_t v[TSR_MAX_VALS];
+};
+
+/* Per-series writer state (private to tsring.c). */
+struct tsr_stream {
+    uint16_t series;
+    uint16_t nvals;
+    int32_t block;          // -1: none open
+    uint32_t bitpos;
+    int64_t prev_t, prev_delta;
+    uint64_t prev_v[TSR_MAX_VALS];
+    uint8_t lead[TSR_MAX_VALS], trail[TSR_MAX_VALS];
+};
+
+struct tsr {
+    int fd;
+    size_t size;
+    bool writable;
+    struct tsr_header *hdr;
+    uint8_t *base;
+    uint64_t next_seq;
+    uint32_t next_block;
+    struct tsr_stream streams[TSR_MAX_SERIES];
+    unsigned int num_streams;
+};
+
+/*
+ * Writer: open or create path. A new file is laid out with size bytes;
+ * an existing ring keeps its geometry and history, and blocks left open
+ * by a crash are sealed. Anything else is refused (EPROTO). 0, or -1.
+ */
+int tsr_open(struct tsr *t, const char *path, size_t size);
+
+/*
+ * Append one record. No syscalls, except msync() when a block fills up.
+ * The first record of a series fixes its value count (nvals). 0 or -1.
+ */
+int tsr_append(struct tsr *t, enum tsr_series series, int64_t t_us, const int64_t *v,
+               unsigned int nvals);
+
+/* Seal open blocks and unmap. */
+void tsr_close(struct tsr *t);
+
+/* Reader: map read-only. 0, or -1 with errno (EPROTO: not a ring). */
+int tsr_map(struct tsr *t, const char *path);
+void tsr_unmap(struct tsr *t);
+
+/*
+ * Call fn for every record of series with from_us <= t_us < to_us, oldest
+ * first; fn returning non-zero stops the scan. Returns the number of
+ * records visited, or -1 with errno.
+ */
+typedef int (*tsr_fn)(const struct tsr_record *r, unsigned int nvals, void *ctx);
+long tsr_scan(const struct tsr *t, enum tsr_series series, int64_t from_us, int64_t to_us,
+              tsr_fn fn, void *ctx);
+
+/* Usage of one series: blocks, records, data bytes, oldest/newest. */
+struct tsr_usage {
+    uint32_t blocks;
+    uint64_t records;
+    uint64_t bytes;
+    int64_t first_us, last_us;
+};
+void tsr_usage(const struct tsr *t, enum tsr_series series, struct tsr_usage *u);
+
+#endif /* TSRING_H */
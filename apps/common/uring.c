@@ -0,0 +1,276 @@
+//-----------------------------------------------------------------------------
+// File:         uring.c
+//
+// Description:  Minimal io_uring ring on the raw syscalls (no liburing).
+//
+// Notes:
+// - The CQ gets four slots per SQ entry, since multishot requests complete
+//   many times per submission; overflowed CQEs are flushed by the next
+//   uring_submit().
+// - COOP_TASKRUN is requested (fallback without it on older kernels): the
+//   loop enters the kernel to wait anyway, so completions need no IPI.
+// - Memory ordering follows the kernel's io_uring.h contract: acquire on
+//   the tails the kernel writes, release on the ones we write.
+//-----------------------------------------------------------------------------
+#include "uring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_CQ_FACTOR 4
+
+static int sys_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                     unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned int op, void *arg, unsigned int nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+int uring_init(struct uring *u, unsigned int entries, unsigned int sqpoll_idle_ms)
+{
+    struct io_uring_params p;
+
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * URING_CQ_FACTOR;
+    if (sqpoll_idle_ms) {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = sqpoll_idle_ms;
+    } else {
+        p.flags |= IORING_SETUP_COOP_TASKRUN;
+    }
+    u->fd = sys_setup(entries, &p);
+    if (u->fd < 0 && errno == EINVAL && (p.flags & IORING_SETUP_COOP_TASKRUN)) {
+        unsigned int cq = p.cq_entries;
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = cq;
+        u->fd = sys_setup(entries, &p);
+    }
+    if (u->fd < 0)
+        return -1;
+    u->sqpoll = (p.flags & IORING_SETUP_SQPOLL) != 0;
+
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_sz > u->sq_ring_sz)
+            u->sq_ring_sz = u->cq_ring_sz;
+        u->cq_ring_sz = 0;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        goto fail;
+    }
+    u->cq_ring = u->sq_ring;
+    if (u->cq_ring_sz) {
+        u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = u->sq_ring, *cq = u->cq_ring;
+    u->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    u->sq_flags = (unsigned int *)(sq + p.sq_off.flags);
+    u->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    u->sq_mask = *(unsigned int *)(sq + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // SQE slot i is always published through array slot i
+    for (unsigned int i = 0; i < u->sq_entries; i++)
+        u->sq_array[i] = i;
+    u->sqe_tail = *u->sq_tail;
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        uring_exit(u);
+        errno = err;
+    }
+    return -1;
+}
+
+void uring_exit(struct uring *u)
+{
+    if (u->sqes)
+        munmap(u->sqes, u->sqes_sz);
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_sz);
+    if (u->sq_ring)
+        munmap(u->sq_ring, u->sq_ring_sz);
+    if (u->fd >= 0)
+        close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *u)
+{
+    unsigned int head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    if (u->sqe_tail - head >= u->sq_entries) {
+        // Full: push what we have; with SQPOLL wait for the thread to eat it
+        if (uring_submit(u, 0) < 0)
+            return NULL;
+        if (u->sqpoll)
+            sys_enter(u->fd, 0, 0, IORING_ENTER_SQ_WAIT);
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sqe_tail - head >= u->sq_entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &u->sqes[u->sqe_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqe_tail++;
+    return sqe;
+}
+
+int uring_submit(struct uring *u, unsigned int wait_nr)
+{
+    unsigned int to_submit = u->sqe_tail - *u->sq_tail;
+    unsigned int flags = 0;
+
+    if (to_submit)
+        __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+    if (u->sqpoll) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (to_submit &&
+            (__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP))
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        to_submit = 0;
+    }
+    if (__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+        flags |= IORING_ENTER_GETEVENTS;
+    if (wait_nr && !uring_peek_cqe(u))
+        flags |= IORING_ENTER_GETEVENTS;
+    else
+        wait_nr = 0;
+    if (!to_submit && !flags)
+        return 0;
+
+    if (sys_enter(u->fd, to_submit, wait_nr, flags) < 0) {
+        if (errno == EAGAIN || errno == EBUSY)
+            return 0;   // CQ backlog: reap, then come back
+        return -1;
+    }
+    return 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *u)
+{
+    unsigned int head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &u->cqes[head & u->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *u)
+{
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_bufs_init(struct uring *u, struct uring_bufs *b, uint16_t bgid,
+                    unsigned int entries, unsigned int size)
+{
+    struct io_uring_buf_reg reg;
+
+    memset(b, 0, sizeof(*b));
+    if (!entries || (entries & (entries - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+    b->br_sz = entries * sizeof(struct io_uring_buf);
+    b->br = mmap(NULL, b->br_sz, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->br == MAP_FAILED) {
+        b->br = NULL;
+        return -1;
+    }
+    b->data = calloc(entries, size);
+    if (!b->data) {
+        munmap(b->br, b->br_sz);
+        b->br = NULL;
+        return -1;
+    }
+    b->entries = entries;
+    b->mask = entries - 1;
+    b->size = size;
+    b->bgid = bgid;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)b->br;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (sys_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int err = errno;
+        free(b->data);
+        munmap(b->br, b->br_sz);
+        memset(b, 0, sizeof(*b));
+        errno = err;
+        return -1;
+    }
+    for (unsigned int i = 0; i < entries; i++)
+        uring_bufs_put(b, i);
+    return 0;
+}
+
+void uring_bufs_exit(struct uring *u, struct uring_bufs *b)
+{
+    struct io_uring_buf_reg reg;
+
+    if (!b->br)
+        return;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = b->bgid;
+    if (u->fd >= 0)
+        sys_register(u->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(b->data);
+    munmap(b->br, b->br_sz);
+    memset(b, 0, sizeof(*b));
+}
+
+void uring_bufs_put(struct uring_bufs *b, unsigned int bid)
+{
+    struct io_uring_buf *buf = &b->br->bufs[b->tail & b->mask];
+
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(b, bid);
+    buf->len = b->size;
+    buf->bid = (uint16_t)bid;
+    b->tail++;
+    __atomic_store_n(&b->br->tail, b->tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+// File:         uring.h
+//
+// Description:  Minimal io_uring ring on the raw syscalls (no liburing).
+//
+// Notes:
+// - One ring, one submitting thread. SQEs are prepared with uring_get_sqe()
+//   and go to the kernel in uring_submit(), which also waits for
+//   completions, so a loop that reaps a batch and re-arms costs one
+//   io_uring_enter() per batch.
+// - With SQPOLL a kernel thread picks up submissions; uring_submit() then
+//   only enters the kernel to wake that thread or to sleep for a CQE.
+// - Provided-buffer rings (5.19+) back multishot reads: the kernel picks a
+//   buffer per completion and the loop hands it back after use, with no
+//   syscall in either direction.
+//-----------------------------------------------------------------------------
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Newer than some distro headers (6.7+); the kernel is asked regardless. */
+#define URING_OP_READ_MULTISHOT     49
+
+struct uring {
+    int fd;
+    bool sqpoll;
+    /* submission queue */
+    unsigned int *sq_head, *sq_tail, *sq_flags, *sq_array;
+    unsigned int sq_mask, sq_entries, sqe_tail;
+    struct io_uring_sqe *sqes;
+    /* completion queue */
+    unsigned int *cq_head, *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    /* mappings */
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+};
+
+struct uring_bufs {
+    struct io_uring_buf_ring *br;
+    size_t br_sz;
+    unsigned char *data;
+    unsigned int entries, mask, size;
+    uint16_t bgid, tail;
+};
+
+/*
+ * Set up a ring with room for entries SQEs. sqpoll_idle_ms > 0 asks for a
+ * kernel submission thread that sleeps after that much idle time. 0, or -1
+ * with errno set.
+ */
+int uring_init(struct uring *u, unsigned int entries, unsigned int sqpoll_idle_ms);
+void uring_exit(struct uring *u);
+
+/* Next free SQE, zeroed; submits what is queued first if the SQ is full. */
+struct io_uring_sqe *uring_get_sqe(struct uring *u);
+
+/*
+ * Hand prepared SQEs to the kernel and, if wait_nr > 0 and no completion is
+ * pending yet, sleep until wait_nr have arrived. 0, or -1 with errno set
+ * (EINTR included).
+ */
+int uring_submit(struct uring *u, unsigned int wait_nr);
+
+/* Oldest unreaped CQE or NULL; uring_cqe_seen() releases it. */
+struct io_uring_cqe *uring_peek_cqe(struct uring *u);
+void uring_cqe_seen(struct uring *u);
+
+/*
+ * Register entries (power of two) buffers of size bytes as buffer group
+ * bgid and hand them all to the kernel. 0, or -1 with errno set (EINVAL on
+ * kernels without provided-buffer rings).
+ */
+int uring_bufs_init(struct uring *u, struct uring_bufs *b, uint16_t bgid,
+                    unsigned int entries, unsigned int size);
+void uring_bufs_exit(struct uring *u, struct uring_bufs *b);
+
+static inline void *uring_buf(const struct uring_bufs *b, unsigned int bid)
+{
+    return b->data + (size_t)bid * b->size;
+}
+
+/* Give buffer bid back to the kernel once its contents are consumed. */
+void uring_bufs_put(struct uring_bufs *b, unsigned int bid);
+
+#endif /* URING_H */
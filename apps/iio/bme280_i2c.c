@@ -0,0 +1,434 @@
+//-----------------------------------------------------------------------------
+// File:         bme280_i2c.c
+//
+// Description:  Direct i2c-dev BME280 backend (see bme280_i2c.h).
+//
+// Notes:
+// - Register map: chip id 0xD0, calibration 0x88..0xA1 and 0xE1..0xE7,
+//   ctrl_hum 0xF2, ctrl_meas 0xF4, config 0xF5, data 0xF7..0xFE (press
+//   20 bit, temp 20 bit, hum 16 bit, big-endian). A skipped measurement
+//   reads as 0x80000 / 0x8000 and is left out of the sample.
+// - The datasheet shifts negative values left; that is written as
+//   multiplication here, with identical results.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include "bme280_i2c.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REG_CALIB0      0x88        /* .. 0xA1 */
+#define CALIB0_LEN      26
+#define REG_ID          0xD0
+#define REG_CALIB1      0xE1        /* .. 0xE7 */
+#define CALIB1_LEN      7
+#define REG_CTRL_HUM    0xF2
+#define REG_CTRL_MEAS   0xF4
+#define REG_CONFIG      0xF5
+#define REG_DATA        0xF7        /* .. 0xFE */
+#define DATA_LEN        8
+
+#define ID_BME280       0x60
+#define MODE_MASK       0x03
+#define CTRL_HUM_X1     0x01
+#define CTRL_MEAS_X1_NORMAL 0x27    /* osrs_t x1, osrs_p x1, normal mode */
+#define CONFIG_SB_0_5MS 0x00        /* 0.5 ms standby, filter off */
+#define FIRST_CONV_US   10000       /* max measurement time at x1/x1/x1 */
+
+#define STUB_ADAPTER    "SMBus stub driver"
+
+// ---- Register access ----
+
+static int smbus_access(int fd, char rw, uint8_t cmd, int size, union i2c_smbus_data *data)
+{
+    struct i2c_smbus_ioctl_data args = {
+        .read_write = rw, .command = cmd, .size = size, .data = data,
+    };
+    return ioctl(fd, I2C_SMBUS, &args);
+}
+
+static int read_regs(struct bme280_i2c *d, uint8_t reg, uint8_t *buf, unsigned int len)
+{
+    if (d->fd < 0) {
+        memcpy(buf, d->image + reg, len);
+        return 0;
+    }
+    if (d->smbus) {
+        union i2c_smbus_data data;
+
+        data.block[0] = (uint8_t)len;
+        if (smbus_access(d->fd, I2C_SMBUS_READ, reg, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0)
+            return -1;
+        if (data.block[0] < len) {
+            errno = EIO;
+            return -1;
+        }
+        memcpy(buf, data.block + 1, len);
+        return 0;
+    }
+
+    // Address write + repeated-start read: one bus transaction
+    struct i2c_msg msgs[2] = {
+        { .addr = (uint16_t)d->addr, .flags = 0, .len = 1, .buf = &reg },
+        { .addr = (uint16_t)d->addr, .flags = I2C_M_RD, .len = (uint16_t)len, .buf = buf },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+    return ioctl(d->fd, I2C_RDWR, &xfer) == 2 ? 0 : -1;
+}
+
+static int write_reg(struct bme280_i2c *d, uint8_t reg, uint8_t val)
+{
+    if (d->fd < 0) {
+        d->image[reg] = val;
+        return 0;
+    }
+    if (d->smbus) {
+        union i2c_smbus_data data = { .byte = val };
+        return smbus_access(d->fd, I2C_SMBUS_WRITE, reg, I2C_SMBUS_BYTE_DATA, &data);
+    }
+
+    uint8_t buf[2] = { reg, val };
+    struct i2c_msg msg = { .addr = (uint16_t)d->addr, .flags = 0, .len = 2, .buf = buf };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = &msg, .nmsgs = 1 };
+    return ioctl(d->fd, I2C_RDWR, &xfer) == 1 ? 0 : -1;
+}
+
+// ---- Calibration and compensation ----
+
+static uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static int read_calib(struct bme280_i2c *d)
+{
+    uint8_t c[CALIB0_LEN], h[CALIB1_LEN];
+    struct bme280_calib *cal = &d->cal;
+
+    if (read_regs(d, REG_CALIB0, c, sizeof(c)) < 0)
+        return -1;
+    cal->T1 = le16(c + 0);
+    cal->T2 = (int16_t)le16(c + 2);
+    cal->T3 = (int16_t)le16(c + 4);
+    cal->P1 = le16(c + 6);
+    cal->P2 = (int16_t)le16(c + 8);
+    cal->P3 = (int16_t)le16(c + 10);
+    cal->P4 = (int16_t)le16(c + 12);
+    cal->P5 = (int16_t)le16(c + 14);
+    cal->P6 = (int16_t)le16(c + 16);
+    cal->P7 = (int16_t)le16(c + 18);
+    cal->P8 = (int16_t)le16(c + 20);
+    cal->P9 = (int16_t)le16(c + 22);
+    cal->H1 = c[25];
+    if (!d->humidity)
+        return 0;
+
+    if (read_regs(d, REG_CALIB1, h, sizeof(h)) < 0)
+        return -1;
+    cal->H2 = (int16_t)le16(h + 0);
+    cal->H3 = h[2];
+    // 12-bit signed values sharing 0xE5 between them
+    cal->H4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0f));
+    cal->H5 = (int16_t)((int8_t)h[5] * 16 | h[4] >> 4);
+    cal->H6 = (int8_t)h[6];
+    return 0;
+}
+
+// 0.01 °C; t_fine feeds the other two.
+static int32_t comp_temp(const struct bme280_calib *c, int32_t adc, int32_t *t_fine)
+{
+    int32_t var1 = ((adc >> 3) - ((int32_t)c->T1 * 2)) * c->T2 >> 11;
+    int32_t var2 = (((adc >> 4) - c->T1) * ((adc >> 4) - c->T1) >> 12) * c->T3 >> 14;
+
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+// Pa in Q24.8.
+static uint32_t comp_press(const struct bme280_calib *c, int32_t adc, int32_t t_fine)
+{
+    int64_t var1 = (int64_t)t_fine - 128000;
+    int64_t var2 = var1 * var1 * c->P6;
+    int64_t p;
+
+    var2 += var1 * c->P5 * 131072;
+    var2 += (int64_t)c->P4 * 34359738368LL;
+    var1 = (var1 * var1 * c->P3 >> 8) + var1 * c->P2 * 4096;
+    var1 = ((140737488355328LL + var1) * c->P1) >> 33;
+    if (var1 == 0)
+        return 0;   // avoid division by zero
+    p = 1048576 - adc;
+    p = ((p * 2147483648LL - var2) * 3125) / var1;
+    var1 = (int64_t)c->P9 * (p >> 13) * (p >> 13) >> 25;
+    var2 = (int64_t)c->P8 * p >> 19;
+    return (uint32_t)(((p + var1 + var2) >> 8) + (int64_t)c->P7 * 16);
+}
+
+// %RH in Q22.10.
+static uint32_t comp_hum(const struct bme280_calib *c, int32_t adc, int32_t t_fine)
+{
+    int32_t x = t_fine - 76800;
+    int32_t v;
+
+    v = ((((adc * 16384) - (c->H4 * 1048576) - (c->H5 * x)) + 16384) >> 15) *
+        (((((((x * c->H6) >> 10) * (((x * c->H3) >> 11) + 32768)) >> 10) + 2097152) *
+          c->H2 + 8192) >> 14);
+    v -= (((v >> 15) * (v >> 15)) >> 7) * c->H1 >> 4;
+    if (v < 0)
+        v = 0;
+    if (v > 419430400)
+        v = 419430400;
+    return (uint32_t)(v >> 12);
+}
+
+void bme280_compensate(const struct bme280_calib *cal, bool humidity, const uint8_t raw[8],
+                       struct bme280_sample *s)
+{
+    int32_t adc_p = raw[0] << 12 | raw[1] << 4 | raw[2] >> 4;
+    int32_t adc_t = raw[3] << 12 | raw[4] << 4 | raw[5] >> 4;
+    int32_t adc_h = raw[6] << 8 | raw[7];
+    int32_t t_fine;
+
+    s->have = 0;
+    if (adc_t == 0x80000)
+        return;     // temperature skipped: nothing can be compensated
+    s->temp_mdegc = comp_temp(cal, adc_t, &t_fine) * 10;
+    s->have |= BME280_HAVE_TEMP;
+    if (adc_p != 0x80000) {
+        s->pressure_mpa = (uint32_t)((uint64_t)comp_press(cal, adc_p, t_fine) * 1000 / 256);
+        s->have |= BME280_HAVE_PRESSURE;
+    }
+    if (humidity && adc_h != 0x8000) {
+        s->humidity_mpct = (uint32_t)((uint64_t)comp_hum(cal, adc_h, t_fine) * 1000 / 1024);
+        s->have |= BME280_HAVE_HUMIDITY;
+    }
+}
+
+// ---- Open / sample ----
+
+static int probe(struct bme280_i2c *d)
+{
+    if (read_regs(d, REG_ID, &d->chip_id, 1) < 0)
+        return -1;
+    // BMP280 engineering samples and production parts: no humidity
+    if (d->chip_id != ID_BME280 && (d->chip_id < 0x56 || d->chip_id > 0x58)) {
+        errno = ENODEV;
+        return -1;
+    }
+    d->humidity = d->chip_id == ID_BME280;
+    return read_calib(d);
+}
+
+int bme280_i2c_bus(const char *arg)
+{
+    char path[64], name[64];
+    char *end;
+    long bus;
+
+    if (!strncmp(arg, "i2c-", 4))
+        arg += 4;
+    if (strcmp(arg, "stub")) {
+        bus = strtol(arg, &end, 10);
+        return end == arg || *end || bus < 0 ? -1 : (int)bus;
+    }
+    for (bus = 0; bus < 256; bus++) {
+        FILE *f;
+
+        snprintf(path, sizeof(path), "/sys/bus/i2c/devices/i2c-%ld/name", bus);
+        if (!(f = fopen(path, "r")))
+            continue;
+        if (fgets(name, sizeof(name), f) && !strncmp(name, STUB_ADAPTER, strlen(STUB_ADAPTER))) {
+            fclose(f);
+            return (int)bus;
+        }
+        fclose(f);
+    }
+    errno = ENODEV;
+    return -1;
+}
+
+int bme280_i2c_open(struct bme280_i2c *d, int bus, unsigned int addr)
+{
+    char path[32];
+    unsigned long funcs = 0;
+    uint8_t meas;
+
+    memset(d, 0, sizeof(*d));
+    d->addr = addr;
+    snprintf(path, sizeof(path), "/dev/i2c-%d", bus);
+    d->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (d->fd < 0)
+        return -1;
+    if (ioctl(d->fd, I2C_FUNCS, &funcs) < 0)
+        goto fail;
+    if (!(funcs & I2C_FUNC_I2C)) {
+        if (!(funcs & I2C_FUNC_SMBUS_I2C_BLOCK)) {
+            errno = EOPNOTSUPP;
+            goto fail;
+        }
+        // SMBus transfers go to the I2C_SLAVE address (EBUSY: driver bound)
+        d->smbus = true;
+        if (ioctl(d->fd, I2C_SLAVE, addr) < 0)
+            goto fail;
+    }
+    if (probe(d) < 0 || read_regs(d, REG_CTRL_MEAS, &meas, 1) < 0)
+        goto fail;
+    if ((meas & MODE_MASK) == 0) {
+        // ctrl_hum only takes effect with the following ctrl_meas write
+        if ((d->humidity && write_reg(d, REG_CTRL_HUM, CTRL_HUM_X1) < 0) ||
+            write_reg(d, REG_CONFIG, CONFIG_SB_0_5MS) < 0 ||
+            write_reg(d, REG_CTRL_MEAS, CTRL_MEAS_X1_NORMAL) < 0)
+            goto fail;
+        usleep(FIRST_CONV_US);
+    }
+    return 0;
+
+fail: {
+        int err = errno;
+        close(d->fd);
+        d->fd = -1;
+        errno = err;
+        return -1;
+    }
+}
+
+// i2cdump "b" output: "f0: 00 11 ... " rows; XX (unreadable) is skipped.
+static int parse_image(const char *path, uint8_t regs[256], bool present[256])
+{
+    char line[256];
+    int rows = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    memset(present, 0, 256 * sizeof(present[0]));
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line, *end;
+        unsigned long base = strtoul(p, &end, 16);
+
+        if (end == p || *end != ':' || base > 0xf0 || base % 16)
+            continue;
+        p = end + 1;
+        for (unsigned int i = 0; i < 16; i++) {
+            unsigned long v;
+
+            while (*p == ' ')
+                p++;
+            if (!strncmp(p, "XX", 2)) {
+                p += 2;
+                continue;
+            }
+            v = strtoul(p, &end, 16);
+            if (end != p + 2)
+                break;
+            regs[base + i] = (uint8_t)v;
+            present[base + i] = true;
+            p = end;
+        }
+        rows++;
+    }
+    fclose(f);
+    if (!rows) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int bme280_i2c_open_image(struct bme280_i2c *d, const char *path)
+{
+    bool present[256];
+
+    memset(d, 0, sizeof(*d));
+    d->fd = -1;
+    if (parse_image(path, d->image, present) < 0)
+        return -1;
+    return probe(d);
+}
+
+int bme280_i2c_sample(struct bme280_i2c *d, struct bme280_sample *s)
+{
+    uint8_t raw[DATA_LEN];
+    struct timespec ts;
+
+    if (read_regs(d, REG_DATA, raw, d->humidity ? DATA_LEN : DATA_LEN - 2) < 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (!d->humidity)
+        raw[6] = 0x80, raw[7] = 0x00;
+    bme280_compensate(&d->cal, d->humidity, raw, s);
+    s->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    return 0;
+}
+
+int bme280_i2c_load_stub(int bus, unsigned int addr, const char *path)
+{
+    char attr[64], name[64] = "";
+    uint8_t regs[256];
+    bool present[256];
+    FILE *f;
+    int fd, rc = 0;
+
+    // Only ever write a whole register image into the emulator
+    snprintf(attr, sizeof(attr), "/sys/bus/i2c/devices/i2c-%d/name", bus);
+    if ((f = fopen(attr, "r")) != NULL) {
+        if (!fgets(name, sizeof(name), f))
+            name[0] = '\0';
+        fclose(f);
+    }
+    if (strncmp(name, STUB_ADAPTER, strlen(STUB_ADAPTER))) {
+        errno = EPERM;
+        return -1;
+    }
+    if (parse_image(path, regs, present) < 0)
+        return -1;
+
+    snprintf(attr, sizeof(attr), "/dev/i2c-%d", bus);
+    fd = open(attr, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (ioctl(fd, I2C_SLAVE, addr) < 0) {
+        close(fd);
+        return -1;
+    }
+    // Runs of present registers, up to an SMBus block (32) per write
+    for (unsigned int r = 0; r < 256 && rc == 0;) {
+        union i2c_smbus_data data;
+        unsigned int n = 0;
+
+        if (!present[r]) {
+            r++;
+            continue;
+        }
+        while (r + n < 256 && present[r + n] && n < I2C_SMBUS_BLOCK_MAX) {
+            data.block[1 + n] = regs[r + n];
+            n++;
+        }
+        data.block[0] = (uint8_t)n;
+        rc = smbus_access(fd, I2C_SMBUS_WRITE, (uint8_t)r, I2C_SMBUS_I2C_BLOCK_DATA, &data);
+        r += n;
+    }
+    if (rc < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+void bme280_i2c_close(struct bme280_i2c *d)
+{
+    if (d->fd >= 0)
+        close(d->fd);
+    d->fd = -1;
+}
@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------------------
+// File:         bme280_i2c.h
+//
+// Description:  Direct i2c-dev access to a BME280 (or BMP280), bypassing
+//               the kernel IIO driver.
+//
+// Notes:
+// - The calibration block is read once at open; a sample is then a single
+//   burst of the data registers (0xF7..0xFE): one I2C_RDWR ioctl with a
+//   write of the register address and a repeated-start read. Adapters
+//   without plain I2C (i2c-stub is SMBus-only) get the same burst as one
+//   SMBus I2C-block read.
+// - Compensation is the datasheet's integer code (32-bit temperature and
+//   humidity, 64-bit pressure); results go into struct bme280_sample units.
+// - The chip must not be driven by the kernel driver at the same time:
+//   unbind bmp280-i2c first. A chip found in sleep mode is put into normal
+//   mode (x1 oversampling, 0.5 ms standby), so reads return the latest
+//   finished conversion.
+// - Register images in i2cdump format ("i2cdump -y BUS 0x76 b") can be
+//   decoded without a bus, or loaded into an i2c-stub adapter to exercise
+//   the whole path.
+//-----------------------------------------------------------------------------
+#ifndef BME280_I2C_H
+#define BME280_I2C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bme280_sample.h"
+
+#define BME280_I2C_ADDR     0x76
+
+struct bme280_calib {
+    uint16_t T1;
+    int16_t T2, T3;
+    uint16_t P1;
+    int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t H1, H3;
+    int16_t H2, H4, H5;
+    int8_t H6;
+};
+
+struct bme280_i2c {
+    int fd;                     // -1 when decoding an image
+    unsigned int addr;
+    bool smbus;                 // no I2C_RDWR on this adapter
+    bool humidity;              // BME280 (BMP280 has none)
+    uint8_t chip_id;
+    struct bme280_calib cal;
+    uint8_t image[256];         // register image (fd < 0)
+};
+
+/* "1", "i2c-1" or "stub" (the i2c-stub adapter) -> bus number, or -1. */
+int bme280_i2c_bus(const char *arg);
+
+/* Open /dev/i2c-bus, check the chip id and read the calibration. 0 or -1. */
+int bme280_i2c_open(struct bme280_i2c *d, int bus, unsigned int addr);
+
+/* Same on an i2cdump register image instead of a bus. 0 or -1. */
+int bme280_i2c_open_image(struct bme280_i2c *d, const char *path);
+
+/* One burst read + compensation; ts_ns is taken right after the read. */
+int bme280_i2c_sample(struct bme280_i2c *d, struct bme280_sample *s);
+
+/* Write an i2cdump image into an i2c-stub adapter (refused on real buses). */
+int bme280_i2c_load_stub(int bus, unsigned int addr, const char *path);
+
+void bme280_i2c_close(struct bme280_i2c *d);
+
+/* Datasheet compensation of the data registers (0xF7.., 8 bytes). */
+void bme280_compensate(const struct bme280_calib *cal, bool humidity, const uint8_t raw[8],
+                       struct bme280_sample *s);
+
+#endif /* BME280_I2C_H */
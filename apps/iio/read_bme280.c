@@ -0,0 +1,661 @@
+//-----------------------------------------------------------------------------
+// File:         read_bme280.c
+//
+// Description:  Reads temperature, humidity and pressure from a BME280 via
+//               the kernel's IIO sysfs interface, bme280d's sample cache or
+//               directly over i2c-dev.
+//
+// Notes:
+// - The device is found by its IIO `name` attribute (-n, default bme280)
+//   rather than by index: iio:deviceN changes with probe order.
+// - Channel attributes are opened once and re-read with pread() at offset
+//   0 (sysfs regenerates the value on every read from the start), so a
+//   reading costs one syscall per channel and no fork.
+// - Processed in_<chan>_input is used when the driver has it; otherwise
+//   (in_<chan>_raw + in_<chan>_offset) * in_<chan>_scale. All values are
+//   parsed into fixed point with nine decimals (IIO's INT_PLUS_NANO, see
+//   iio.h) and converted with 64/128-bit integer math, no floating point.
+// - While bme280d runs, readings come from its shared-memory cache (-M,
+//   see bme280_shm.h) instead: the driver refuses sysfs reads while the
+//   daemon's buffer is enabled, and the cache costs no I2C transfer. A
+//   stale cache (daemon stopped) falls back to sysfs.
+// - -a BUS[:ADDR] talks to the chip over /dev/i2c-BUS instead (see
+//   bme280_i2c.h): one burst read per reading, compensated here. --image
+//   decodes a recorded i2cdump register image without any bus, and
+//   --stub-load first writes one into an i2c-stub adapter. -x prints the
+//   unrounded values, which `make check` compares for the datasheet image.
+// - --bench times readings on every path that is available (sysfs, cache,
+//   i2c) and prints readings/s, latency percentiles and CPU per reading.
+// - Default output keeps the old shell script's lines (°F and %RH) and
+//   adds pressure; --interval streams one line per reading on an absolute
+//   monotonic schedule.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "bme280_i2c.h"
+#include "bme280_shm.h"
+#include "hist.h"
+#include "iio.h"
+
+#define DEFAULT_NAME    "bme280"
+
+enum { CH_TEMP, CH_HUMIDITY, CH_PRESSURE, CH_COUNT };
+
+struct channel {
+    const char *attr;       // in_<attr>_input / _raw / _scale / _offset
+    int fd;                 // -1 if the device lacks the channel
+    bool raw;               // fd is _raw: apply offset and scale
+    int64_t scale_nano;
+    int64_t offset_nano;
+};
+
+static struct channel chans[CH_COUNT] = {
+    [CH_TEMP]     = { .attr = "temp",             .fd = -1 },  // milli °C
+    [CH_HUMIDITY] = { .attr = "humidityrelative", .fd = -1 },  // milli %RH
+    [CH_PRESSURE] = { .attr = "pressure",         .fd = -1 },  // kPa
+};
+
+static volatile sig_atomic_t keep_running = 1;
+
+static struct bme280_shm *cache;
+static const char *dev_name = DEFAULT_NAME;
+static const char *dev_arg;
+static bool sysfs_open;
+static struct bme280_i2c i2c = { .fd = -1 };
+static bool use_i2c;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    keep_running = 0;
+}
+
+// Open the channels the device has; scale and offset are read once.
+static int open_channels(const char *dir)
+{
+    int found = 0;
+
+    for (int i = 0; i < CH_COUNT; i++) {
+        struct channel *c = &chans[i];
+        char path[512], attr[64];
+
+        snprintf(path, sizeof(path), "%s/in_%s_input", dir, c->attr);
+        c->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (c->fd >= 0) {
+            found++;
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/in_%s_raw", dir, c->attr);
+        c->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (c->fd < 0)
+            continue;
+        c->raw = true;
+        c->scale_nano = IIO_NANO;
+        c->offset_nano = 0;
+        snprintf(attr, sizeof(attr), "in_%s_scale", c->attr);
+        iio_attr_read_fixed(dir, attr, &c->scale_nano);
+        snprintf(attr, sizeof(attr), "in_%s_offset", c->attr);
+        iio_attr_read_fixed(dir, attr, &c->offset_nano);
+        found++;
+    }
+    if (!found) {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
+
+// Find the device and open its channels, once. 0 or -1 (reported).
+static int sysfs_setup(void)
+{
+    char dir[320];
+
+    if (sysfs_open)
+        return 0;
+    if (dev_arg) {
+        if (strchr(dev_arg, '/'))
+            snprintf(dir, sizeof(dir), "%s", dev_arg);
+        else
+            snprintf(dir, sizeof(dir), IIO_DEVICES "/%s", dev_arg);
+    } else if (iio_find_device(dev_name, dir, sizeof(dir)) < 0) {
+        fprintf(stderr, "No IIO device named %s: %s\n", dev_name, strerror(errno));
+        return -1;
+    }
+    if (open_channels(dir) < 0) {
+        fprintf(stderr, "%s: no temperature, humidity or pressure channel\n", dir);
+        return -1;
+    }
+    sysfs_open = true;
+    return 0;
+}
+
+// One channel in its IIO unit, nano-scaled. 0 or -1.
+static int read_channel(const struct channel *c, int64_t *nano)
+{
+    int64_t v;
+
+    if (iio_read_fixed(c->fd, &v) < 0)
+        return -1;
+    if (c->raw)
+        v = iio_apply_scale(v, c->offset_nano, c->scale_nano);
+    *nano = v;
+    return 0;
+}
+
+// a / b rounded half away from zero.
+static int64_t div_round(int64_t a, int64_t b)
+{
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// Tenths as "12.3" / "-0.4".
+static const char *tenths(char *buf, size_t len, int64_t t)
+{
+    snprintf(buf, len, "%s%lld.%lld", t < 0 ? "-" : "", (long long)(llabs(t) / 10),
+             (long long)(llabs(t) % 10));
+    return buf;
+}
+
+struct reading {
+    bool have[CH_COUNT];
+    int64_t temp_t;         // tenths of °C or °F
+    int64_t hum_t;          // tenths of %RH
+    int64_t press_t;        // tenths of hPa
+    int64_t exact[CH_COUNT];    // bme280_sample units: m°C, m%RH, mPa
+};
+
+// A bme280_sample as channel values in nano-scaled IIO units.
+static void sample_values(const struct bme280_sample *s, int64_t v[CH_COUNT],
+                          bool have[CH_COUNT])
+{
+    have[CH_TEMP] = s->have & BME280_HAVE_TEMP;
+    have[CH_HUMIDITY] = s->have & BME280_HAVE_HUMIDITY;
+    have[CH_PRESSURE] = s->have & BME280_HAVE_PRESSURE;
+    v[CH_TEMP] = (int64_t)s->temp_mdegc * IIO_NANO;         // milli °C
+    v[CH_HUMIDITY] = (int64_t)s->humidity_mpct * IIO_NANO;  // milli %RH
+    v[CH_PRESSURE] = (int64_t)s->pressure_mpa * 1000;       // mPa -> kPa
+}
+
+// The reading paths: channel values, 0 or -1 (quiet, errno set).
+static int read_cache(int64_t v[CH_COUNT], bool have[CH_COUNT])
+{
+    struct bme280_sample s;
+
+    if (!cache || bme280_shm_get(cache, 0, &s) < 0)
+        return -1;
+    sample_values(&s, v, have);
+    return 0;
+}
+
+static int read_sysfs(int64_t v[CH_COUNT], bool have[CH_COUNT])
+{
+    for (int i = 0; i < CH_COUNT; i++) {
+        have[i] = false;
+        if (chans[i].fd < 0)
+            continue;
+        if (read_channel(&chans[i], &v[i]) < 0)
+            return -1;
+        have[i] = true;
+    }
+    return 0;
+}
+
+static int read_i2c(int64_t v[CH_COUNT], bool have[CH_COUNT])
+{
+    struct bme280_sample s;
+
+    if (bme280_i2c_sample(&i2c, &s) < 0)
+        return -1;
+    sample_values(&s, v, have);
+    return 0;
+}
+
+static int take_reading(struct reading *r, bool celsius)
+{
+    int64_t vals[CH_COUNT];
+    bool have[CH_COUNT] = { false };
+
+    memset(r, 0, sizeof(*r));
+    if (use_i2c) {
+        if (read_i2c(vals, have) < 0) {
+            fprintf(stderr, "i2c read: %s\n", strerror(errno));
+            return -1;
+        }
+    } else if (read_cache(vals, have) < 0) {
+        if (sysfs_setup() < 0)
+            return -1;
+        if (read_sysfs(vals, have) < 0) {
+            fprintf(stderr, "read: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    for (int i = 0; i < CH_COUNT; i++) {
+        int64_t v = vals[i];
+
+        if (!have[i])
+            continue;
+        r->have[i] = true;
+        r->exact[i] = i == CH_PRESSURE ? div_round(v, 1000) : div_round(v, IIO_NANO);
+        switch (i) {
+        case CH_TEMP:
+            // milli °C (nano-scaled): tenths of °C = v / 1e11
+            r->temp_t = celsius ? div_round(v, IIO_NANO * 100)
+                                : div_round(v * 9 / 5 + 32000 * IIO_NANO, IIO_NANO * 100);
+            break;
+        case CH_HUMIDITY:
+            r->hum_t = div_round(v, IIO_NANO * 100);
+            break;
+        case CH_PRESSURE:
+            // kPa: tenths of hPa = kPa * 100
+            r->press_t = div_round(v, IIO_NANO / 100);
+            break;
+        }
+    }
+    return 0;
+}
+
+static void print_block(const struct reading *r, bool celsius)
+{
+    char b[32];
+
+    if (r->have[CH_TEMP])
+        printf("Temperature: %s °%c\n", tenths(b, sizeof(b), r->temp_t), celsius ? 'C' : 'F');
+    if (r->have[CH_HUMIDITY])
+        printf("Humidity:    %s %%RH\n", tenths(b, sizeof(b), r->hum_t));
+    if (r->have[CH_PRESSURE])
+        printf("Pressure:    %s hPa\n", tenths(b, sizeof(b), r->press_t));
+}
+
+static void print_line(const struct reading *r, bool celsius)
+{
+    struct timespec ts;
+    char b[32];
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    printf("%lld.%03ld", (long long)ts.tv_sec, ts.tv_nsec / 1000000);
+    if (r->have[CH_TEMP])
+        printf(" temp_%c=%s", celsius ? 'c' : 'f', tenths(b, sizeof(b), r->temp_t));
+    if (r->have[CH_HUMIDITY])
+        printf(" humidity_rh=%s", tenths(b, sizeof(b), r->hum_t));
+    if (r->have[CH_PRESSURE])
+        printf(" pressure_hpa=%s", tenths(b, sizeof(b), r->press_t));
+    printf("\n");
+}
+
+// -x: full resolution, no rounding to tenths, for comparing against
+// reference values.
+static void print_exact(const struct reading *r)
+{
+    static const char *const names[CH_COUNT] = {
+        [CH_TEMP]     = "temp_mdegc",
+        [CH_HUMIDITY] = "humidity_mpct",
+        [CH_PRESSURE] = "pressure_mpa",
+    };
+
+    for (int i = 0, first = 1; i < CH_COUNT; i++) {
+        if (!r->have[i])
+            continue;
+        printf("%s%s=%lld", first ? "" : " ", names[i], (long long)r->exact[i]);
+        first = 0;
+    }
+    printf("\n");
+}
+
+// "2", "2s", "500ms" -> ns; 0 on error.
+static uint64_t parse_interval(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v <= 0)
+        return 0;
+    if (!strcmp(end, "ms"))
+        return (uint64_t)(v * 1e6);
+    if (!*end || !strcmp(end, "s"))
+        return (uint64_t)(v * 1e9);
+    return 0;
+}
+
+static void print_stat(const char *label, const int64_t v[3], int64_t div, const char *unit)
+{
+    char b[3][32];
+
+    printf("%-12s %s / %s / %s %s\n", label, tenths(b[0], sizeof(b[0]), div_round(v[0], div)),
+           tenths(b[1], sizeof(b[1]), div_round(v[1], div)),
+           tenths(b[2], sizeof(b[2]), div_round(v[2], div)), unit);
+}
+
+// Rolling min / mean / max from the cache, in print_block() units.
+static int print_stats(bool celsius)
+{
+    struct bme280_shm_stats st;
+    struct bme280_sample s;
+    uint64_t samples;
+
+    if (bme280_shm_read_latest(cache, &s, &samples) < 0 ||
+        bme280_shm_read_stats(cache, &st) < 0) {
+        fprintf(stderr, "Cache unreadable: %s\n", strerror(errno));
+        return -1;
+    }
+    if (!st.count) {
+        fprintf(stderr, "No samples in the cache yet\n");
+        return -1;
+    }
+    printf("Window:      %u samples over %llu s (%llu total, %llu missed)%s\n", st.count,
+           (unsigned long long)(cache->window_ns / IIO_NANO), (unsigned long long)samples,
+           (unsigned long long)st.missed,
+           atomic_load(&cache->live) ? "" : ", bme280d not running");
+    if (s.have & BME280_HAVE_TEMP) {
+        if (!celsius) {
+            for (int i = 0; i < 3; i++)
+                st.temp[i] = st.temp[i] * 9 / 5 + 32000;
+        }
+        print_stat("Temperature:", st.temp, 100, celsius ? "°C" : "°F");
+    }
+    if (s.have & BME280_HAVE_HUMIDITY)
+        print_stat("Humidity:", st.humidity, 100, "%RH");
+    if (s.have & BME280_HAVE_PRESSURE)
+        print_stat("Pressure:", st.pressure, 10000, "hPa");
+    return 0;
+}
+
+// ---- --bench ----
+
+#define BENCH_WARMUP    10
+
+struct bench_path {
+    const char *name;
+    int (*read)(int64_t v[CH_COUNT], bool have[CH_COUNT]);
+};
+
+static struct hist bench_hist;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t tv_ns(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000ULL;
+}
+
+// Time readings on one path; -1 if it is not usable here.
+static int bench_one(const struct bench_path *bp, unsigned long count, uint64_t limit_ns)
+{
+    int64_t v[CH_COUNT];
+    bool have[CH_COUNT];
+    unsigned long n = 0;
+    struct rusage ru0, ru1;
+
+    for (int i = 0; i < BENCH_WARMUP; i++) {
+        if (bp->read(v, have) < 0) {
+            printf("%-8s unavailable: %s\n", bp->name, strerror(errno));
+            return -1;
+        }
+    }
+    hist_init(&bench_hist);
+    getrusage(RUSAGE_THREAD, &ru0);
+    uint64_t start = mono_ns(), t1 = start;
+    while (keep_running && (limit_ns ? t1 - start < limit_ns : n < count)) {
+        uint64_t t0 = mono_ns();
+        if (bp->read(v, have) < 0) {
+            printf("%-8s read failed after %lu: %s\n", bp->name, n, strerror(errno));
+            return -1;
+        }
+        t1 = mono_ns();
+        hist_record(&bench_hist, t1 - t0);
+        n++;
+    }
+    uint64_t elapsed = mono_ns() - start;
+    getrusage(RUSAGE_THREAD, &ru1);
+
+    double d = n ? (double)n : 1.0;
+    printf("%-8s %10lu %12.0f %8llu %8llu %10llu %9.0f %9.0f\n", bp->name, n,
+           elapsed ? (double)n * 1e9 / (double)elapsed : 0.0,
+           (unsigned long long)hist_percentile(&bench_hist, 50.0),
+           (unsigned long long)hist_percentile(&bench_hist, 99.0),
+           (unsigned long long)HIST_PEEK(bench_hist.max),
+           (double)(tv_ns(&ru1.ru_utime) - tv_ns(&ru0.ru_utime)) / d,
+           (double)(tv_ns(&ru1.ru_stime) - tv_ns(&ru0.ru_stime)) / d);
+    return 0;
+}
+
+// "N" readings or "Ns" / "Nms" per path. 0 if at least one path ran.
+static int bench_run(const char *arg)
+{
+    const struct bench_path paths[] = {
+        { "sysfs", read_sysfs },
+        { "cache", read_cache },
+        { "i2c",   read_i2c },
+    };
+    unsigned long count = 0;
+    uint64_t limit_ns = 0;
+    char *end;
+    double v = strtod(arg, &end);
+    int ran = 0;
+
+    if (end == arg || !(v > 0) ||
+        (*end && strcmp(end, "s") && strcmp(end, "ms"))) {
+        fprintf(stderr, "Bad --bench argument: %s\n", arg);
+        return -1;
+    }
+    if (*end)
+        limit_ns = (uint64_t)(v * (*end == 'm' ? 1e6 : 1e9));
+    else
+        count = (unsigned long)v;
+
+    if (limit_ns)
+        printf("# %.3fs of readings per path\n", (double)limit_ns / 1e9);
+    else
+        printf("# %lu readings per path\n", count);
+    printf("%-8s %10s %12s %8s %8s %10s %9s %9s\n", "path", "readings", "readings/s",
+           "p50_ns", "p99_ns", "max_ns", "usr_ns", "sys_ns");
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        const struct bench_path *bp = &paths[i];
+
+        if (bp->read == read_sysfs && !sysfs_open) {
+            printf("%-8s unavailable: no IIO device\n", bp->name);
+            continue;
+        }
+        if (bp->read == read_cache && !cache) {
+            printf("%-8s unavailable: no bme280d cache\n", bp->name);
+            continue;
+        }
+        if (bp->read == read_i2c && !use_i2c) {
+            printf("%-8s unavailable: no -a BUS\n", bp->name);
+            continue;
+        }
+        ran += bench_one(bp, count, limit_ns) == 0;
+    }
+    return ran ? 0 : -1;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-n NAME | -d DIR | -a BUS[:ADDR] | --image FILE] [-M NAME] [-C]\n"
+        "          [-i INTERVAL [-c COUNT]] [-l | -x | -s] [--bench N|Ns]\n"
+        "  -n NAME       IIO device name attribute to look for (default: " DEFAULT_NAME ")\n"
+        "  -d DIR        Use this IIO device directory (or iio:deviceN) instead\n"
+        "  -a, --i2c BUS[:ADDR]  Read the chip directly over /dev/i2c-BUS (\"stub\":\n"
+        "                the i2c-stub adapter; ADDR default 0x76)\n"
+        "  --image FILE  Decode an i2cdump register image instead of a bus\n"
+        "  --stub-load FILE  Write an i2cdump image into the i2c-stub at -a first\n"
+        "  -M NAME       bme280d sample cache to prefer over sysfs\n"
+        "                (default: " BME280_SHM_NAME ", empty for sysfs only)\n"
+        "  -C            Temperature in °C (default: °F)\n"
+        "  -i, --interval T  Keep reading every T (2, 2s, 500ms) until\n"
+        "                interrupted; one line per reading\n"
+        "  -c COUNT      Stop after COUNT readings\n"
+        "  -l            One-line output for a single reading too\n"
+        "  -x            One line in full resolution (m°C, m%%RH, mPa), no rounding\n"
+        "  -s            Print the cache's rolling min/mean/max instead\n"
+        "  --bench N|Ns  Time N readings (or N seconds) on each available path:\n"
+        "                sysfs (-n/-d), cache (-M), i2c (-a/--image)\n"
+        "  -h            Show this help\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_opts[] = {
+        { "interval", required_argument, NULL, 'i' },
+        { "count",    required_argument, NULL, 'c' },
+        { "i2c",       required_argument, NULL, 'a' },
+        { "image",     required_argument, NULL, 'I' },
+        { "stub-load", required_argument, NULL, 'L' },
+        { "bench",     required_argument, NULL, 'B' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    const char *shm_name = BME280_SHM_NAME;
+    const char *i2c_arg = NULL, *image = NULL, *stub_image = NULL, *bench = NULL;
+    bool celsius = false, line = false, exact = false, stats = false;
+    uint64_t interval_ns = 0;
+    unsigned long count = 0;
+    struct reading r;
+    int opt, rc = EXIT_SUCCESS;
+
+    while ((opt = getopt_long(argc, argv, "n:d:a:M:Ci:c:lxsh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n': dev_name = optarg; break;
+        case 'd': dev_arg = optarg; break;
+        case 'a': i2c_arg = optarg; break;
+        case 'I': image = optarg; break;
+        case 'L': stub_image = optarg; break;
+        case 'B': bench = optarg; break;
+        case 'M': shm_name = optarg; break;
+        case 'C': celsius = true; break;
+        case 'i':
+            interval_ns = parse_interval(optarg);
+            if (!interval_ns) {
+                fprintf(stderr, "Bad interval: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            line = true;
+            break;
+        case 'c': count = strtoul(optarg, NULL, 0); break;
+        case 'l': line = true; break;
+        case 'x': exact = true; break;
+        case 's': stats = true; break;
+        case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+        default:  print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (i2c_arg || image) {
+        int bus = -1;
+        unsigned long addr = BME280_I2C_ADDR;
+
+        if (i2c_arg) {
+            char spec[64], *colon;
+
+            snprintf(spec, sizeof(spec), "%s", i2c_arg);
+            if ((colon = strchr(spec, ':')) != NULL) {
+                *colon = '\0';
+                addr = strtoul(colon + 1, NULL, 0);
+            }
+            bus = bme280_i2c_bus(spec);
+            if (bus < 0 || addr < 0x03 || addr > 0x77) {
+                fprintf(stderr, "Bad i2c bus/address: %s\n", i2c_arg);
+                return EXIT_FAILURE;
+            }
+        }
+        if (stub_image) {
+            if (bus < 0) {
+                fprintf(stderr, "--stub-load needs -a BUS\n");
+                return EXIT_FAILURE;
+            }
+            if (bme280_i2c_load_stub(bus, (unsigned int)addr, stub_image) < 0) {
+                fprintf(stderr, "Load %s into i2c-%d: %s%s\n", stub_image, bus, strerror(errno),
+                        errno == EPERM ? " (not an i2c-stub adapter)" : "");
+                return EXIT_FAILURE;
+            }
+        }
+        if (image ? bme280_i2c_open_image(&i2c, image) < 0
+                  : bme280_i2c_open(&i2c, bus, (unsigned int)addr) < 0) {
+            fprintf(stderr, "%s: no BME280/BMP280: %s\n", image ? image : i2c_arg,
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+        use_i2c = true;
+    }
+
+    if (*shm_name)
+        cache = bme280_shm_attach(shm_name);
+    if (bench) {
+        // Every path the options make available; errors show in the table
+        if (!use_i2c || dev_arg)
+            sysfs_setup();
+        signal(SIGINT, sig_handler);
+        rc = bench_run(bench) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        bme280_i2c_close(&i2c);
+        return rc;
+    }
+    if (stats) {
+        if (!cache) {
+            fprintf(stderr, "No sample cache %s (is bme280d running?)\n", shm_name);
+            return EXIT_FAILURE;
+        }
+        return print_stats(celsius) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (!interval_ns) {
+        if (take_reading(&r, celsius) < 0)
+            return EXIT_FAILURE;
+        if (exact)
+            print_exact(&r);
+        else if (line)
+            print_line(&r, celsius);
+        else
+            print_block(&r, celsius);
+        return EXIT_SUCCESS;
+    }
+
+    struct sigaction sa = { .sa_handler = sig_handler };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Absolute schedule: slow reads do not push later readings back
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (unsigned long n = 0; keep_running && (!count || n < count); n++) {
+        if (take_reading(&r, celsius) == 0)
+            print_line(&r, celsius);
+        else
+            rc = EXIT_FAILURE;
+
+        uint64_t t = (uint64_t)next.tv_nsec + interval_ns;
+        next.tv_sec += (time_t)(t / IIO_NANO);
+        next.tv_nsec = (long)(t % IIO_NANO);
+        if (!count || n + 1 < count) {
+            while (keep_running &&
+                   clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+                ;
+        }
+    }
+
+    for (int i = 0; i < CH_COUNT; i++) {
+        if (chans[i].fd >= 0)
+            close(chans[i].fd);
+    }
+    bme280_i2c_close(&i2c);
+    return rc;
+}
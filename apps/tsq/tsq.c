@@ -0,0 +1,365 @@
+//-----------------------------------------------------------------------------
+// File:         tsq.c
+//
+// Description:  Query the history ring written by bme280d -H: records,
+//               aggregates and per-bucket rows over a time range.
+//
+// Notes:
+// - Works on the mapped file directly (tsring.h), read-only and without
+//   locks, so it can run next to the daemon or on the file it left behind
+//   after a crash; records still being appended are seen up to the last
+//   complete one.
+// - Times are CLOCK_REALTIME: epoch seconds, "now", or relative to now
+//   ("-90s", "-30m", "-1h", "-2d"). The range is [FROM, TO).
+// - bme280 values are printed in the units of read_bme280 (°C, %RH, hPa);
+//   button records carry the bus event type, device index and value.
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "button_bus_wire.h"
+#include "tsring.h"
+
+#define USEC_PER_SEC        1000000LL
+#define NVALS               3
+
+static const char *const button_names[BUTTON_BUS_TYPES] = {
+    [BUTTON_BUS_PRESS] = "press", [BUTTON_BUS_DOUBLE] = "double",
+    [BUTTON_BUS_LED] = "led", [BUTTON_BUS_DEVICE] = "device",
+};
+
+// Value v of the bme280 series: name and divisor to its printed unit.
+static const struct {
+    const char *name;
+    int64_t div;
+} bme280_vals[NVALS] = {
+    { "temp_c", 1000 },             // m°C
+    { "humidity_rh", 1000 },        // m%RH
+    { "pressure_hpa", 100000 },     // mPa
+};
+
+struct agg {
+    uint64_t count;
+    int64_t min[NVALS], max[NVALS];
+    int64_t sum[NVALS];
+    uint64_t types[BUTTON_BUS_TYPES];
+    int64_t first_us, last_us;
+};
+
+struct query {
+    enum tsr_series series;
+    bool aggregate;
+    int64_t bucket_us;      // 0: one aggregate over the range
+    int64_t bucket_start;
+    struct agg agg;
+};
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+// "now", "-30m" (s/m/h/d), or epoch seconds with an optional fraction.
+static int parse_time(const char *s, int64_t *out)
+{
+    char *end;
+    double v;
+
+    if (strcmp(s, "now") == 0) {
+        *out = now_us();
+        return 0;
+    }
+    errno = 0;
+    v = strtod(s, &end);
+    if (errno || end == s)
+        return -1;
+    if (s[0] == '-' || s[0] == '+') {
+        int64_t unit = 1;
+        switch (*end) {
+        case 'd': unit *= 24; /* fall through */
+        case 'h': unit *= 60; /* fall through */
+        case 'm': unit *= 60; /* fall through */
+        case 's': end++; /* fall through */
+        case '\0': break;
+        default:  return -1;
+        }
+        if (*end)
+            return -1;
+        *out = now_us() + (int64_t)(v * (double)(unit * USEC_PER_SEC));
+        return 0;
+    }
+    if (*end)
+        return -1;
+    *out = (int64_t)(v * USEC_PER_SEC);
+    return 0;
+}
+
+// "90", "90s", "5m", "1h", "1d" -> µs, or -1.
+static int64_t parse_duration(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    int64_t unit = USEC_PER_SEC;
+
+    switch (*end) {
+    case 'd': unit *= 24; /* fall through */
+    case 'h': unit *= 60; /* fall through */
+    case 'm': unit *= 60; /* fall through */
+    case 's': end++; /* fall through */
+    case '\0': break;
+    default:  return -1;
+    }
+    if (*end || end == s || v <= 0)
+        return -1;
+    return (int64_t)(v * (double)unit);
+}
+
+static int64_t div_round(int64_t a, int64_t b)
+{
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// v / div with three decimals: "21.534", "-0.004".
+static const char *fixed(char *buf, size_t len, int64_t v, int64_t div)
+{
+    int64_t m = div_round(v * 1000, div);
+
+    snprintf(buf, len, "%s%lld.%03lld", m < 0 ? "-" : "", (long long)(llabs(m) / 1000),
+             (long long)(llabs(m) % 1000));
+    return buf;
+}
+
+static void print_time(int64_t t_us)
+{
+    printf("%lld.%06lld", (long long)(t_us / USEC_PER_SEC), (long long)(t_us % USEC_PER_SEC));
+}
+
+static void print_record(enum tsr_series series, const struct tsr_record *r)
+{
+    char b[32];
+
+    print_time(r->t_us);
+    if (series == TSR_SERIES_BME280) {
+        for (int i = 0; i < NVALS; i++)
+            printf(" %s=%s", bme280_vals[i].name,
+                   fixed(b, sizeof(b), r->v[i], bme280_vals[i].div));
+    } else {
+        const char *name = r->v[0] >= 0 && r->v[0] < BUTTON_BUS_TYPES
+                               ? button_names[r->v[0]] : "?";
+        printf(" %s dev=%lld value=%lld", name, (long long)r->v[1], (long long)r->v[2]);
+    }
+    printf("\n");
+}
+
+static void agg_add(struct agg *a, const struct tsr_record *r)
+{
+    if (!a->count) {
+        for (int i = 0; i < NVALS; i++) {
+            a->min[i] = INT64_MAX;
+            a->max[i] = INT64_MIN;
+        }
+        a->first_us = r->t_us;
+    }
+    a->count++;
+    a->last_us = r->t_us;
+    for (int i = 0; i < NVALS; i++) {
+        a->sum[i] += r->v[i];
+        if (r->v[i] < a->min[i])
+            a->min[i] = r->v[i];
+        if (r->v[i] > a->max[i])
+            a->max[i] = r->v[i];
+    }
+    if (r->v[0] >= 0 && r->v[0] < BUTTON_BUS_TYPES)
+        a->types[r->v[0]]++;
+}
+
+static void agg_print(enum tsr_series series, const struct agg *a)
+{
+    char lo[32], mean[32], hi[32];
+
+    printf(" count=%llu", (unsigned long long)a->count);
+    if (!a->count) {
+        printf("\n");
+        return;
+    }
+    if (series == TSR_SERIES_BME280) {
+        for (int i = 0; i < NVALS; i++) {
+            int64_t div = bme280_vals[i].div;
+            printf(" %s=%s/%s/%s", bme280_vals[i].name, fixed(lo, sizeof(lo), a->min[i], div),
+                   fixed(mean, sizeof(mean), div_round(a->sum[i], (int64_t)a->count), div),
+                   fixed(hi, sizeof(hi), a->max[i], div));
+        }
+    } else {
+        for (int i = 0; i < BUTTON_BUS_TYPES; i++)
+            printf(" %s=%llu", button_names[i], (unsigned long long)a->types[i]);
+    }
+    printf("\n");
+}
+
+static void bucket_flush(struct query *q)
+{
+    if (!q->agg.count)
+        return;
+    print_time(q->bucket_start);
+    agg_print(q->series, &q->agg);
+    memset(&q->agg, 0, sizeof(q->agg));
+}
+
+static int on_record(const struct tsr_record *r, unsigned int nvals, void *ctx)
+{
+    struct query *q = ctx;
+    struct tsr_record rec = *r;
+
+    // A series written with fewer values reads as zeros in the rest
+    for (unsigned int i = nvals; i < NVALS; i++)
+        rec.v[i] = 0;
+    if (!q->aggregate) {
+        print_record(q->series, &rec);
+        return 0;
+    }
+    if (q->bucket_us) {
+        int64_t start = r->t_us - ((r->t_us % q->bucket_us) + q->bucket_us) % q->bucket_us;
+        if (start != q->bucket_start)
+            bucket_flush(q);
+        q->bucket_start = start;
+    }
+    agg_add(&q->agg, &rec);
+    return 0;
+}
+
+static void print_info(const struct tsr *t)
+{
+    static const struct {
+        enum tsr_series series;
+        const char *name;
+    } series[] = {
+        { TSR_SERIES_BME280, "bme280" },
+        { TSR_SERIES_BUTTON, "button" },
+    };
+
+    printf("file: %zu bytes, %u blocks of %u bytes, created ", t->size, t->hdr->num_blocks,
+           t->hdr->block_size);
+    print_time(t->hdr->created_us);
+    printf("\n");
+    for (size_t i = 0; i < sizeof(series) / sizeof(series[0]); i++) {
+        struct tsr_usage u;
+        tsr_usage(t, series[i].series, &u);
+        printf("%s: blocks=%u records=%llu bytes=%llu", series[i].name, u.blocks,
+               (unsigned long long)u.records, (unsigned long long)u.bytes);
+        if (u.records) {
+            // Uncompressed: a 64-bit timestamp and NVALS 64-bit values
+            uint64_t raw = u.records * (1 + NVALS) * sizeof(int64_t);
+            printf(" bytes_per_record=%.2f ratio=%.1f span=", (double)u.bytes / u.records,
+                   (double)raw / (u.bytes ? u.bytes : 1));
+            print_time(u.first_us);
+            printf("..");
+            print_time(u.last_us);
+        }
+        printf("\n");
+    }
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-s bme280|button] [-f FROM] [-t TO] [-a | -b BUCKET] [-i] FILE\n"
+        "  -s SERIES  bme280 samples (default) or button events\n"
+        "  -f FROM    Start of the range: epoch seconds, now, or -90s/-30m/-1h/-2d\n"
+        "             (default: everything)\n"
+        "  -t TO      End of the range, exclusive (default: everything)\n"
+        "  -a         Print count and min/mean/max (events per type for button)\n"
+        "             instead of the records\n"
+        "  -b BUCKET  Same, one row per BUCKET (90s, 5m, 1h, 1d)\n"
+        "  -i         Print file usage and compression per series\n"
+        "  -h         Show this help\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct query q = { .series = TSR_SERIES_BME280 };
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    bool info = false;
+    struct tsr t;
+    long n;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:f:t:ab:ih")) != -1) {
+        switch (opt) {
+        case 's':
+            if (strcmp(optarg, "bme280") == 0) {
+                q.series = TSR_SERIES_BME280;
+            } else if (strcmp(optarg, "button") == 0) {
+                q.series = TSR_SERIES_BUTTON;
+            } else {
+                fprintf(stderr, "Unknown series: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+        case 't':
+            if (parse_time(optarg, opt == 'f' ? &from : &to) < 0) {
+                fprintf(stderr, "Bad time: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a': q.aggregate = true; break;
+        case 'b':
+            q.bucket_us = parse_duration(optarg);
+            if (q.bucket_us <= 0) {
+                fprintf(stderr, "Bad bucket: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            q.aggregate = true;
+            break;
+        case 'i': info = true; break;
+        case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+        default:  print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (tsr_map(&t, argv[optind]) < 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind],
+                errno == EPROTO ? "not a history ring" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (info) {
+        print_info(&t);
+        tsr_unmap(&t);
+        return EXIT_SUCCESS;
+    }
+
+    n = tsr_scan(&t, q.series, from, to, on_record, &q);
+    if (n < 0) {
+        fprintf(stderr, "%s: scan: %s\n", argv[optind], strerror(errno));
+        tsr_unmap(&t);
+        return EXIT_FAILURE;
+    }
+    if (q.bucket_us) {
+        bucket_flush(&q);
+    } else if (q.aggregate) {
+        if (q.agg.count) {
+            print_time(q.agg.first_us);
+            printf("..");
+            print_time(q.agg.last_us);
+        } else {
+            printf("-");
+        }
+        agg_print(q.series, &q.agg);
+    }
+    tsr_unmap(&t);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,428 @@
+//-----------------------------------------------------------------------------
+// File:         wavecheck.c
+//
+// Description:  Waveform acceptance check for blinky against a gpio-sim chip.
+//
+// Notes:
+// - Starts the command after "--" (normally blinky on a gpio-sim line),
+//   samples the simulated line for -t seconds and compares the captured
+//   transitions with the schedule given by -i/-p or -f/-d, which must
+//   match the options blinky was started with.
+// - gpio-sim does not raise edge events on the consumer's output lines, so
+//   the line is captured by polling sim_gpioN/value with pread() on one fd
+//   as fast as the CPU allows; the effective sample period and the worst
+//   gap between samples are part of the report. Use -R to pin the sampler
+//   away from blinky.
+// - The schedule is anchored on the first captured edge and the pattern
+//   phase is fitted from the first few intervals, so startup latency is
+//   not counted as error. Each later edge is matched to its scheduled time
+//   within half the shortest step.
+// - Report (JSON, stdout or -o): drift (least-squares slope of the edge
+//   error, ppm), jitter (standard deviation of the error), missed edges,
+//   glitches (pulses shorter than -g) and unmatched extra edges. Exit
+//   status is 0 only if nothing was missed, no glitch or extra edge was
+//   seen and the jitter is within -J (if given).
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "rt_profile.h"
+
+#define NSEC_PER_SEC        1000000000LL
+#define MAX_STEPS           64
+#define SETTLE_MS           200     /* let the child request its lines */
+#define FIT_EDGES           16      /* intervals used to fit the pattern phase */
+
+struct edge {
+    int64_t t;
+    int val;
+};
+
+static const char *value_path;
+static char value_buf[256];
+static const char *chip = "gpiochip0";
+static unsigned int line;
+static int64_t steps[MAX_STEPS];
+static int num_steps;
+static int interval_ms = 1000;
+static int pwm_hz;
+static double pwm_duty = 50.0;
+static double duration_s = 10.0;
+static int64_t glitch_ns;           /* 0 = a quarter of the shortest step */
+static int64_t max_jitter_ns;       /* 0 = not checked */
+static const char *out_path;
+static struct rt_profile rt;
+
+static struct edge *edges;
+static size_t num_edges, cap_edges;
+static uint64_t samples;
+static int64_t max_gap_ns;
+
+static volatile sig_atomic_t stop_flag;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    stop_flag = 1;
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int parse_pattern(const char *arg)
+{
+    const char *s = arg;
+
+    num_steps = 0;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > 600000 || num_steps == MAX_STEPS)
+            return -1;
+        steps[num_steps++] = (int64_t)v * 1000000LL;
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return -1;
+    }
+    return num_steps ? 0 : -1;
+}
+
+static int add_edge(int64_t t, int val)
+{
+    if (num_edges == cap_edges) {
+        size_t cap = cap_edges ? cap_edges * 2 : 4096;
+        struct edge *e = realloc(edges, cap * sizeof(*e));
+        if (!e)
+            return -1;
+        edges = e;
+        cap_edges = cap;
+    }
+    edges[num_edges].t = t;
+    edges[num_edges].val = val;
+    num_edges++;
+    return 0;
+}
+
+/* Poll the sim value file until the deadline, keeping only transitions. */
+static int capture(int fd, int64_t until)
+{
+    char c[4];
+    int last = -1;
+    int64_t prev = now_ns();
+
+    while (!stop_flag) {
+        ssize_t n = pread(fd, c, sizeof(c), 0);
+        int64_t t = now_ns();
+        if (n < 1) {
+            fprintf(stderr, "read %s: %s\n", value_path, n < 0 ? strerror(errno) : "empty");
+            return -1;
+        }
+        samples++;
+        if (t - prev > max_gap_ns)
+            max_gap_ns = t - prev;
+        prev = t;
+
+        int val = c[0] == '1';
+        if (val != last) {
+            if (last >= 0 && add_edge(t, val) < 0) {
+                fprintf(stderr, "Out of memory after %zu edges\n", num_edges);
+                return -1;
+            }
+            last = val;
+        }
+        if (t >= until)
+            break;
+    }
+    return 0;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Pattern phase whose step sequence best fits the first captured intervals */
+static int fit_phase(const struct edge *e, size_t n)
+{
+    int best = 0;
+    int64_t best_cost = INT64_MAX;
+
+    for (int p = 0; p < num_steps; p++) {
+        int64_t cost = 0;
+        for (size_t i = 0; i + 1 < n && i < FIT_EDGES; i++)
+            cost += llabs((e[i + 1].t - e[i].t) - steps[(p + (int)i) % num_steps]);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = p;
+        }
+    }
+    return best;
+}
+
+static int report(FILE *out, int64_t span_ns)
+{
+    uint64_t glitches = 0, extra = 0, missed = 0, expected = 0;
+    int64_t min_step = INT64_MAX;
+    struct edge *clean;
+    size_t n = 0;
+
+    for (int i = 0; i < num_steps; i++)
+        if (steps[i] < min_step)
+            min_step = steps[i];
+    int64_t gl = glitch_ns ? glitch_ns : min_step / 4;
+    int64_t win = min_step / 2;
+
+    /* Drop pulses shorter than the glitch threshold (both of their edges) */
+    clean = malloc((num_edges ? num_edges : 1) * sizeof(*clean));
+    int64_t *err = malloc((num_edges ? num_edges : 1) * sizeof(*err));
+    if (!clean || !err) {
+        free(clean);
+        free(err);
+        return -1;
+    }
+    for (size_t i = 0; i < num_edges; i++) {
+        if (i + 1 < num_edges && edges[i + 1].t - edges[i].t < gl) {
+            glitches++;
+            i++;
+            continue;
+        }
+        clean[n++] = edges[i];
+    }
+
+    /* Walk the schedule anchored on the first edge, matching edges to it */
+    size_t matched = 0, j = 0;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    if (n) {
+        int k = fit_phase(clean, n);
+        int64_t t0 = clean[0].t;
+        int64_t last = clean[n - 1].t;
+        for (int64_t te = t0; te <= last + win; te += steps[k++ % num_steps]) {
+            expected++;
+            while (j < n && clean[j].t < te - win) {
+                extra++;
+                j++;
+            }
+            if (j < n && clean[j].t <= te + win) {
+                int64_t e = clean[j].t - te;
+                double x = (double)(te - t0) / 1e9;
+                err[matched++] = e;
+                sx += x;
+                sy += (double)e;
+                sxx += x * x;
+                sxy += x * (double)e;
+                j++;
+            } else {
+                missed++;
+            }
+        }
+        extra += n - j;
+    }
+
+    double mean = 0, var = 0, drift_ppm = 0;
+    int64_t emin = 0, emax = 0, p99 = 0;
+    if (matched) {
+        mean = sy / (double)matched;
+        emin = emax = err[0];
+        for (size_t i = 0; i < matched; i++) {
+            double d = (double)err[i] - mean;
+            var += d * d;
+            if (err[i] < emin) emin = err[i];
+            if (err[i] > emax) emax = err[i];
+            err[i] = llabs(err[i]);
+        }
+        var /= (double)matched;
+        double den = (double)matched * sxx - sx * sx;
+        if (den > 0)
+            drift_ppm = ((double)matched * sxy - sx * sy) / den / 1e3; /* ns/s -> ppm */
+        qsort(err, matched, sizeof(*err), cmp_i64);
+        p99 = err[(matched - 1) * 99 / 100];
+    }
+    double jitter = sqrt(var);
+    bool pass = matched && !missed && !glitches && !extra &&
+                (!max_jitter_ns || jitter <= (double)max_jitter_ns);
+
+    fprintf(out,
+        "{\n"
+        "  \"source\": \"%s\",\n"
+        "  \"mode\": \"%s\",\n"
+        "  \"duration_s\": %.3f,\n"
+        "  \"samples\": %llu,\n"
+        "  \"sample_period_ns\": %.0f,\n"
+        "  \"max_sample_gap_ns\": %lld,\n"
+        "  \"expected_edges\": %llu,\n"
+        "  \"captured_edges\": %zu,\n"
+        "  \"matched_edges\": %zu,\n"
+        "  \"missed_edges\": %llu,\n"
+        "  \"glitches\": %llu,\n"
+        "  \"glitch_threshold_ns\": %lld,\n"
+        "  \"extra_edges\": %llu,\n"
+        "  \"error_ns\": { \"mean\": %.0f, \"min\": %lld, \"max\": %lld, \"p99_abs\": %lld },\n"
+        "  \"jitter_ns\": %.0f,\n"
+        "  \"drift_ppm\": %.3f,\n"
+        "  \"pass\": %s\n"
+        "}\n",
+        value_path, pwm_hz ? "pwm" : "blink", (double)span_ns / 1e9,
+        (unsigned long long)samples,
+        samples ? (double)span_ns / (double)samples : 0.0,
+        (long long)max_gap_ns, (unsigned long long)expected, num_edges, matched,
+        (unsigned long long)missed, (unsigned long long)glitches, (long long)gl,
+        (unsigned long long)extra, mean, (long long)emin, (long long)emax,
+        (long long)p99, jitter, drift_ppm, pass ? "true" : "false");
+
+    free(clean);
+    free(err);
+    return pass ? 0 : 1;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-c CHIP] [-l LINE | -v PATH] [-i MS | -p MS,... | -f HZ [-d PCT]]\n"
+        "          [-t SEC] [-g NS] [-J NS] [-o FILE] [-R SPEC] [-- COMMAND...]\n"
+        "  -c CHIP   gpio-sim chip, e.g. gpiochip5 (default: gpiochip0)\n"
+        "  -l LINE   Line offset on CHIP (default: 0)\n"
+        "  -v PATH   sim_gpioN/value file instead of -c/-l\n"
+        "  -i MS     Expected blink interval (default: 1000)\n"
+        "  -p MS,... Expected blink pattern\n"
+        "  -f HZ     Expected PWM frequency\n"
+        "  -d PCT    Expected PWM duty cycle (default: 50)\n"
+        "  -t SEC    Capture duration (default: 10)\n"
+        "  -g NS     Pulses shorter than NS are glitches (default: step/4)\n"
+        "  -J NS     Fail if jitter exceeds NS\n"
+        "  -o FILE   Write the JSON report to FILE (default: stdout)\n"
+        "  -R SPEC   Realtime profile for the sampler, e.g. fifo:90@2\n"
+        "  COMMAND   Started before, and stopped (SIGTERM) after, the capture\n"
+        "  -h        Show this help\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    pid_t child = -1;
+    int rc = EXIT_FAILURE;
+
+    rt_profile_init(&rt);
+    while ((opt = getopt(argc, argv, "+c:l:v:i:p:f:d:t:g:J:o:R:h")) != -1) {
+        switch (opt) {
+        case 'c': chip = optarg; break;
+        case 'l': line = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'v': value_path = optarg; break;
+        case 'i': {
+            long v = strtol(optarg, NULL, 0);
+            if (v < 1 || v > 600000) { fprintf(stderr, "Bad interval: %s\n", optarg); return EXIT_FAILURE; }
+            interval_ms = (int)v;
+            break;
+        }
+        case 'p':
+            if (parse_pattern(optarg) < 0) { fprintf(stderr, "Bad pattern: %s\n", optarg); return EXIT_FAILURE; }
+            break;
+        case 'f': pwm_hz = (int)strtol(optarg, NULL, 0); break;
+        case 'd': pwm_duty = strtod(optarg, NULL); break;
+        case 't': duration_s = strtod(optarg, NULL); break;
+        case 'g': glitch_ns = strtoll(optarg, NULL, 0); break;
+        case 'J': max_jitter_ns = strtoll(optarg, NULL, 0); break;
+        case 'o': out_path = optarg; break;
+        case 'R':
+            if (rt_profile_parse(&rt, optarg) < 0) { fprintf(stderr, "Bad realtime profile: %s\n", optarg); return EXIT_FAILURE; }
+            break;
+        case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+        default:  print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    /* The expected schedule as a step list, same shape as blinky's */
+    if (pwm_hz) {
+        int64_t period = NSEC_PER_SEC / pwm_hz;
+        int64_t high = (int64_t)((double)period * pwm_duty / 100.0);
+        if (pwm_hz < 1 || high <= 0 || high >= period) {
+            fprintf(stderr, "PWM %d Hz at %.2f%% has no edges to check\n", pwm_hz, pwm_duty);
+            return EXIT_FAILURE;
+        }
+        steps[0] = high;
+        steps[1] = period - high;
+        num_steps = 2;
+    } else if (!num_steps) {
+        steps[0] = (int64_t)interval_ms * 1000000LL;
+        num_steps = 1;
+    }
+    if (duration_s <= 0) {
+        fprintf(stderr, "Bad duration: %.3f\n", duration_s);
+        return EXIT_FAILURE;
+    }
+    if (!value_path) {
+        snprintf(value_buf, sizeof(value_buf), "/sys/bus/gpio/devices/%s/sim_gpio%u/value",
+                 chip, line);
+        value_path = value_buf;
+    }
+
+    int fd = open(value_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s (is %s a gpio-sim chip?)\n",
+                value_path, strerror(errno), chip);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (optind < argc) {
+        child = fork();
+        if (child < 0) {
+            fprintf(stderr, "fork: %s\n", strerror(errno));
+            goto out;
+        }
+        if (child == 0) {
+            close(fd);
+            execvp(argv[optind], &argv[optind]);
+            fprintf(stderr, "exec %s: %s\n", argv[optind], strerror(errno));
+            _exit(127);
+        }
+        usleep(SETTLE_MS * 1000);
+    }
+
+    rt_profile_apply_process(&rt);
+    rt_profile_apply_thread(&rt);
+
+    int64_t start = now_ns();
+    if (capture(fd, start + (int64_t)(duration_s * 1e9)) == 0) {
+        int64_t span = now_ns() - start;
+        FILE *out = out_path ? fopen(out_path, "w") : stdout;
+        if (!out) {
+            fprintf(stderr, "Cannot write %s: %s\n", out_path, strerror(errno));
+        } else {
+            int r = report(out, span);
+            if (out != stdout)
+                fclose(out);
+            rc = r == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+out:
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+    close(fd);
+    free(edges);
+    return rc;
+}
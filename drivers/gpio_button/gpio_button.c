@@ -9,6 +9,9 @@
 // - Uses Device Tree for GPIO mapping (custom,gpio-button compatible)
 // - Implements hardware debouncing with 50ms timer and atomic locks
 // - Creates character device /dev/gpio_button for blocking button event reads
+//   (one '1' byte, or a timestamped gpio_button_event record when the read
+//   buffer is large enough);
+//   a one-byte write (0/1) to it sets the LED without sysfs parsing
 // - Exposes sysfs attribute at /sys/.../led_status for LED state control
 // - Handles active-low buttons and supports configurable LED polarity
 // - Features interrupt-driven button detection with GPIO IRQ handling
@@ -31,6 +34,11 @@
 #include <linux/atomic.h>
 #include <linux/version.h>
 #include <linux/timer.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+#include "gpio_button_event.h"
 
 #define DRIVER_NAME "gpio_button"
 
@@ -56,6 +64,15 @@ static struct class *cl;
 static DECLARE_WAIT_QUEUE_HEAD(button_wait);
 static atomic_t button_event_flag = ATOMIC_INIT(0);
 static volatile int led_status = 0;
+static u64 press_irq_ns;	/* ISR time of the press being debounced */
+/*
+ * last_event and the setting/clearing of button_event_flag go together
+ * under event_lock (timer softirq vs. read()), so a reader never sees the
+ * flag without both timestamps, or a pair from two different presses.
+ * poll() and the wait condition only peek at the flag.
+ */
+static DEFINE_SPINLOCK(event_lock);
+static struct gpio_button_event last_event;
 
 static void debounce_timer_callback(struct timer_list *timer)
 {
@@ -63,7 +80,11 @@ static void debounce_timer_callback(struct timer_list *timer)
 
 	/* Assuming active-low button: pressed -> 0 */
 	if (button_state == 0) {
+		spin_lock(&event_lock);
+		last_event.irq_ns = READ_ONCE(press_irq_ns);
+		last_event.ready_ns = ktime_get_ns();
 		atomic_set(&button_event_flag, 1);
+		spin_unlock(&event_lock);
 		wake_up(&button_wait);
 	}
 
@@ -78,6 +99,7 @@ static irqreturn_t gpio_button_isr(int irq, void *dev_id)
 		return IRQ_HANDLED;
 
 	/* Start debounce timer */
+	WRITE_ONCE(press_irq_ns, ktime_get_ns());
 	atomic_set(&debounce_active, 1);
 	mod_timer(&debounce_timer, jiffies + msecs_to_jiffies(50)); /* 50ms */
 
@@ -87,29 +109,73 @@ static irqreturn_t gpio_button_isr(int irq, void *dev_id)
 static ssize_t gpio_button_read(struct file *file, char __user *buffer,
 				size_t len, loff_t *offset)
 {
+	struct gpio_button_event ev = { 0 };
 	char event_char;
+	bool taken;
 	int ret;
 
-	/* Block until an event arrives */
-	ret = wait_event_interruptible(button_wait,
-				       atomic_read(&button_event_flag));
-	if (ret)
-		return -ERESTARTSYS; /* interrupted */
-
-	/* Event occurred, translate it to ASCII '1' */
-	pr_info("gpio_button: %s():%d: Button event occurred\n",
+	do {
+		/* O_NONBLOCK readers (epoll loops) get -EAGAIN instead of sleeping */
+		if (!atomic_read(&button_event_flag) && (file->f_flags & O_NONBLOCK))
+			return -EAGAIN;
+
+		/* Block until an event arrives */
+		ret = wait_event_interruptible(button_wait,
+					       atomic_read(&button_event_flag));
+		if (ret)
+			return -ERESTARTSYS; /* interrupted */
+
+		/* Event and timestamps in one go; another reader may have won */
+		spin_lock_bh(&event_lock);
+		taken = atomic_read(&button_event_flag);
+		if (taken) {
+			ev = last_event;
+			atomic_set(&button_event_flag, 0);
+		}
+		spin_unlock_bh(&event_lock);
+	} while (!taken);
+
+	pr_debug("gpio_button: %s():%d: Button event occurred\n",
 		__func__, __LINE__);
-	event_char = '1';
 
-	/* Clear flag before copying to user */
-	atomic_set(&button_event_flag, 0);
+	/* Large enough buffer: binary record with the press timestamps */
+	if (len >= sizeof(struct gpio_button_event)) {
+		if (copy_to_user(buffer, &ev, sizeof(ev)))
+			return -EFAULT;
+		return sizeof(ev);
+	}
 
+	/* Event occurred, translate it to ASCII '1' */
+	event_char = '1';
 	if (copy_to_user(buffer, &event_char, sizeof(event_char)))
 		return -EFAULT;
 
 	return sizeof(event_char);
 }
 
+/*
+ * LED fast path: a single byte, 0/1 or '0'/'1'. Same effect as writing
+ * led_status, without the string parsing and logging of the sysfs path.
+ */
+static ssize_t gpio_button_write(struct file *file, const char __user *buffer,
+				 size_t len, loff_t *offset)
+{
+	char val;
+
+	if (len != 1)
+		return -EINVAL;
+	if (get_user(val, buffer))
+		return -EFAULT;
+	if (val == '0' || val == '1')
+		val -= '0';
+	if (val != 0 && val != 1)
+		return -EINVAL;
+
+	led_status = val;
+	gpiod_set_value(led_gpio, led_status);
+	return 1;
+}
+
 static unsigned int gpio_button_poll(struct file *file, poll_table *wait)
 {
 	poll_wait(file, &button_wait, wait);
@@ -126,6 +192,7 @@ static const struct file_operations fops = {
 	.owner = THIS_MODULE,
 	.open  = gpio_button_open,
 	.read  = gpio_button_read,
+	.write = gpio_button_write,
 	.poll  = gpio_button_poll,
 };
 
@@ -155,7 +222,7 @@ static ssize_t led_status_store(struct device *dev,
 	if (count && local_buf[count - 1] == '\n')
 		local_buf[count - 1] = '\0';
 
-	pr_info("gpio_button: Processed input: '%s'\n", local_buf);
+	pr_debug("gpio_button: Processed input: '%s'\n", local_buf);
 
 	ret = kstrtoul(local_buf, 10, &val);
 	if (ret) {
@@ -169,7 +236,7 @@ static ssize_t led_status_store(struct device *dev,
 
 	led_status = val;
 	gpiod_set_value(led_gpio, led_status);
-	pr_info("gpio_button: LED status set to %lu\n", val);
+	pr_debug("gpio_button: LED status set to %lu\n", val);
 
 	return count;
 }
@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// File:   gpio_button_event.h
+//
+// Description:
+// Binary event record returned by read() on /dev/gpio_button, shared by the
+// driver and userspace.
+//
+// Notes:
+// - A read() with a buffer of at least sizeof(struct gpio_button_event)
+//   gets one record; smaller buffers get the legacy single '1' byte.
+// - Timestamps are CLOCK_MONOTONIC nanoseconds (ktime_get_ns()), directly
+//   comparable with clock_gettime(CLOCK_MONOTONIC) in userspace.
+//-----------------------------------------------------------------------------
+#ifndef GPIO_BUTTON_EVENT_H
+#define GPIO_BUTTON_EVENT_H
+
+#include <linux/types.h>
+
+struct gpio_button_event {
+	__u64 irq_ns;		/* first edge of the press (ISR) */
+	__u64 ready_ns;		/* debounce confirmed, readers woken */
+};
+
+#endif /* GPIO_BUTTON_EVENT_H */